@@ -39,40 +39,51 @@ bus_sync_handler(GstBus *bus, GstMessage *message, GstPipeline *pipeline)
 				const gchar *name = gst_structure_nth_field_name(structure, i);
 				GType type = gst_structure_get_field_type(structure, name);
 				const GValue *value = gst_structure_get_value(structure, name);
-				type == G_TYPE_STRING ?
-						g_print("-%s[%s]{%s}\n", name, g_type_name(type), g_value_get_string(value)) :
-						g_print("-%s[%s]{%d}\n", name, g_type_name(type), g_value_get_uint(value));
+				if(type == G_TYPE_STRING)
+					g_print("-%s[%s]{%s}\n", name, g_type_name(type), g_value_get_string(value));
+				else{
+					/* whatever the type, e.g. the guint64 timestamp */
+					gchar *contents = g_strdup_value_contents(value);
+					g_print("-%s[%s]{%s}\n", name, g_type_name(type), contents);
+					g_free(contents);
+				}
 			}
 			g_print("\n");
 
-			/* media operation */
-			if(g_value_get_uint(gst_structure_get_value(structure, "x")) > 120)
+			/* media operation, on the gestures posted by handdetect */
+			const gchar *gesture = gst_structure_get_string(structure, "gesture");
+			if(g_strcmp0(gesture, "palm-open") == 0)
 				gst_element_set_state(playbin, GST_STATE_PAUSED);
-			else
+			else if(g_strcmp0(gesture, "palm-close") == 0)
 				gst_element_set_state(playbin, GST_STATE_PLAYING);
 
 			/* change volume */
-			const GValue *x_value = gst_structure_get_value(structure, "x");
-			gint x = g_value_get_uint(x_value);
-			const GValue *y_value = gst_structure_get_value(structure, "y");
-			gint y = g_value_get_uint(y_value);
-			g_object_set(G_OBJECT(playbin), "volume", (gdouble)(9 - y/24 ), NULL);
-
-			/* seek event */
-			gint64 position, length;
-			GstFormat format = GST_FORMAT_TIME;
-			gst_element_query_duration(playbin, &format, &length);
-			position = length * x / 320;
-			gst_element_set_state(playbin, GST_STATE_PAUSED);
-			gst_element_seek(GST_ELEMENT(playbin),
-					1.0,
-					format,
-					GST_SEEK_FLAG_FLUSH,
-					GST_SEEK_TYPE_SET,
-					position,
-					GST_SEEK_TYPE_NONE,
-					GST_CLOCK_TIME_NONE );
-			gst_element_set_state(GST_ELEMENT(playbin), GST_STATE_PLAYING);
+			else if(g_strcmp0(gesture, "swipe-up") == 0 || g_strcmp0(gesture, "swipe-down") == 0){
+				/* steps of 10% of the normal volume, within the range of the property (1.0 is 100%) */
+				GParamSpecDouble *pspec = G_PARAM_SPEC_DOUBLE(
+						g_object_class_find_property(G_OBJECT_GET_CLASS(playbin), "volume"));
+				gdouble volume;
+				g_object_get(G_OBJECT(playbin), "volume", &volume, NULL);
+				volume += g_strcmp0(gesture, "swipe-up") == 0 ? 0.1 : -0.1;
+				g_object_set(G_OBJECT(playbin), "volume", CLAMP(volume, pspec->minimum, pspec->maximum), NULL);
+			}
+
+			/* seek event, 10s forward/backward */
+			else if(g_strcmp0(gesture, "swipe-left") == 0 || g_strcmp0(gesture, "swipe-right") == 0){
+				gint64 position;
+				GstFormat format = GST_FORMAT_TIME;
+				if(gst_element_query_position(playbin, &format, &position)){
+					position += (g_strcmp0(gesture, "swipe-right") == 0 ? 10 : -10) * GST_SECOND;
+					gst_element_seek(GST_ELEMENT(playbin),
+							1.0,
+							format,
+							GST_SEEK_FLAG_FLUSH,
+							GST_SEEK_TYPE_SET,
+							MAX(position, 0),
+							GST_SEEK_TYPE_NONE,
+							GST_CLOCK_TIME_NONE );
+				}
+			}
 		}
 
 	gst_message_unref(message);
@@ -111,6 +122,8 @@ int main(gint argc, gchar **argv) {
 	/* set values */
 	g_object_set(G_OBJECT(playbin), "uri", video_file, NULL);
 	g_object_set(G_OBJECT(v4l2src), "device", video_device, NULL);
+	/* only discrete gestures, not every hand position */
+	g_object_set(G_OBJECT(handdetect), "gestures", TRUE, NULL);
 
 	/* set caps */
 	caps = gst_caps_from_string("video/x-raw-rgb, width=320, height=240, framerate=(fraction)30/1");
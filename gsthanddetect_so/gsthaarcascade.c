@@ -0,0 +1,1299 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarcascade.c: native haar cascade representation and evaluator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* The evaluation follows cvRunHaarClassifierCascade() step by step (same
+ * rectangle rounding, weight normalisation, variance normalisation and
+ * stage bias) so that a window accepted by the legacy code is accepted
+ * here too. Sums are done in single precision, several windows at a time.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "gsthaarcascade.h"
+#include "gsthaarsimd.h"
+
+/* the sub-second part of the file times, where struct stat has one */
+#if defined (__APPLE__)
+#define GST_HAAR_STAT_NSEC(st, t) ((st)->st_##t##espec.tv_nsec)
+#elif defined (G_OS_UNIX)
+#define GST_HAAR_STAT_NSEC(st, t) ((st)->st_##t.tv_nsec)
+#else
+#define GST_HAAR_STAT_NSEC(st, t) 0
+#endif
+
+/* cvRunHaarClassifierCascade() compares stage sums against
+ * threshold - icv_stage_threshold_bias */
+#define GST_HAAR_STAGE_BIAS 0.0001
+
+/* the first stage runs on blocks of that many windows, one node at a time,
+ * from stumps aligned on a cache line */
+#define GST_HAAR_FIRST_BLOCK 256
+#define GST_HAAR_STUMP_ALIGN 64
+
+/* Binary cascades are the GstHaarCascade arrays dumped one after the other
+ * behind a GstHaarFileHeader, each array starting on a cache line, in host
+ * byte order. They are mapped read-only and used in place.
+ */
+#define GST_HAAR_FILE_MAGIC "GSTHAAR\0"
+#define GST_HAAR_FILE_VERSION 1
+#define GST_HAAR_FILE_BYTE_ORDER 0x01020304
+#define GST_HAAR_FILE_ALIGN 64
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 byte_order;
+  guint32 version;
+  gint32 window_width;
+  gint32 window_height;
+  gint32 has_tilted;
+  gint32 n_stages;
+  gint32 n_classifiers;
+  gint32 n_nodes;
+  gint32 n_alphas;
+  guint8 padding[20];
+} GstHaarFileHeader;
+
+enum
+{
+  GST_HAAR_N_STAGES,
+  GST_HAAR_N_CLASSIFIERS,
+  GST_HAAR_N_NODES,
+  GST_HAAR_N_ALPHAS
+};
+
+/* the arrays of the file, in order */
+static const struct
+{
+  glong offset;                 /* of the array pointer in GstHaarCascade */
+  gint size;                    /* of an element */
+  gint count;                   /* GST_HAAR_N_* */
+  gint per;                     /* elements per counted item */
+} gst_haar_file_arrays[] = {
+#define GST_HAAR_FILE_ARRAY(field, type, count, per) \
+  { G_STRUCT_OFFSET (GstHaarCascade, field), sizeof (type), count, per }
+  GST_HAAR_FILE_ARRAY (stage_first, gint32, GST_HAAR_N_STAGES, 1),
+  GST_HAAR_FILE_ARRAY (stage_count, gint32, GST_HAAR_N_STAGES, 1),
+  GST_HAAR_FILE_ARRAY (stage_threshold, gfloat, GST_HAAR_N_STAGES, 1),
+  GST_HAAR_FILE_ARRAY (classifier_node, gint32, GST_HAAR_N_CLASSIFIERS, 1),
+  GST_HAAR_FILE_ARRAY (classifier_count, gint32, GST_HAAR_N_CLASSIFIERS, 1),
+  GST_HAAR_FILE_ARRAY (classifier_alpha, gint32, GST_HAAR_N_CLASSIFIERS, 1),
+  GST_HAAR_FILE_ARRAY (node_threshold, gfloat, GST_HAAR_N_NODES, 1),
+  GST_HAAR_FILE_ARRAY (node_left, gint32, GST_HAAR_N_NODES, 1),
+  GST_HAAR_FILE_ARRAY (node_right, gint32, GST_HAAR_N_NODES, 1),
+  GST_HAAR_FILE_ARRAY (node_tilted, guint8, GST_HAAR_N_NODES, 1),
+  GST_HAAR_FILE_ARRAY (node_n_rects, guint8, GST_HAAR_N_NODES, 1),
+  GST_HAAR_FILE_ARRAY (rect, gint16, GST_HAAR_N_NODES, GST_HAAR_MAX_RECTS * 4),
+  GST_HAAR_FILE_ARRAY (rect_weight, gfloat, GST_HAAR_N_NODES,
+      GST_HAAR_MAX_RECTS),
+  GST_HAAR_FILE_ARRAY (alpha, gfloat, GST_HAAR_N_ALPHAS, 1),
+#undef GST_HAAR_FILE_ARRAY
+};
+
+GstHaarCascade *
+gst_haar_cascade_new_from_cv (CvHaarClassifierCascade * cv)
+{
+  GstHaarCascade *cascade;
+  gint i, j, k, r;
+  gint cl, node, alpha;
+
+  g_return_val_if_fail (cv != NULL, NULL);
+
+  cascade = g_new0 (GstHaarCascade, 1);
+  cascade->refcount = 1;
+  cascade->window_width = cv->orig_window_size.width;
+  cascade->window_height = cv->orig_window_size.height;
+  cascade->n_stages = cv->count;
+
+  for (i = 0; i < cv->count; i++) {
+    CvHaarStageClassifier *stage = cv->stage_classifier + i;
+
+    cascade->n_classifiers += stage->count;
+    for (j = 0; j < stage->count; j++) {
+      cascade->n_nodes += stage->classifier[j].count;
+      cascade->n_alphas += stage->classifier[j].count + 1;
+    }
+  }
+
+  cascade->stage_first = g_new (gint32, cascade->n_stages);
+  cascade->stage_count = g_new (gint32, cascade->n_stages);
+  cascade->stage_threshold = g_new (gfloat, cascade->n_stages);
+  cascade->classifier_node = g_new (gint32, cascade->n_classifiers);
+  cascade->classifier_count = g_new (gint32, cascade->n_classifiers);
+  cascade->classifier_alpha = g_new (gint32, cascade->n_classifiers);
+  cascade->node_threshold = g_new (gfloat, cascade->n_nodes);
+  cascade->node_left = g_new (gint32, cascade->n_nodes);
+  cascade->node_right = g_new (gint32, cascade->n_nodes);
+  cascade->node_tilted = g_new0 (guint8, cascade->n_nodes);
+  cascade->node_n_rects = g_new0 (guint8, cascade->n_nodes);
+  cascade->rect = g_new0 (gint16, cascade->n_nodes * GST_HAAR_MAX_RECTS * 4);
+  cascade->rect_weight = g_new0 (gfloat, cascade->n_nodes * GST_HAAR_MAX_RECTS);
+  cascade->alpha = g_new (gfloat, cascade->n_alphas);
+
+  cl = node = alpha = 0;
+  for (i = 0; i < cv->count; i++) {
+    CvHaarStageClassifier *stage = cv->stage_classifier + i;
+
+    cascade->stage_first[i] = cl;
+    cascade->stage_count[i] = stage->count;
+    cascade->stage_threshold[i] = stage->threshold - GST_HAAR_STAGE_BIAS;
+
+    for (j = 0; j < stage->count; j++, cl++) {
+      CvHaarClassifier *classifier = stage->classifier + j;
+
+      cascade->classifier_node[cl] = node;
+      cascade->classifier_count[cl] = classifier->count;
+      cascade->classifier_alpha[cl] = alpha;
+
+      for (k = 0; k < classifier->count; k++, node++) {
+        CvHaarFeature *feature = classifier->haar_feature + k;
+        gint16 *rect = cascade->rect + node * GST_HAAR_MAX_RECTS * 4;
+
+        cascade->node_threshold[node] = classifier->threshold[k];
+        cascade->node_left[node] = classifier->left[k];
+        cascade->node_right[node] = classifier->right[k];
+        cascade->node_tilted[node] = feature->tilted != 0;
+        if (feature->tilted)
+          cascade->has_tilted = TRUE;
+
+        for (r = 0; r < GST_HAAR_MAX_RECTS; r++) {
+          if (feature->rect[r].r.width == 0)
+            break;
+          rect[r * 4 + 0] = feature->rect[r].r.x;
+          rect[r * 4 + 1] = feature->rect[r].r.y;
+          rect[r * 4 + 2] = feature->rect[r].r.width;
+          rect[r * 4 + 3] = feature->rect[r].r.height;
+          cascade->rect_weight[node * GST_HAAR_MAX_RECTS + r] =
+              feature->rect[r].weight;
+        }
+        cascade->node_n_rects[node] = r;
+      }
+
+      for (k = 0; k <= classifier->count; k++)
+        cascade->alpha[alpha++] = classifier->alpha[k];
+    }
+  }
+
+  return cascade;
+}
+
+GstHaarCascade *
+gst_haar_cascade_load (const gchar * filename)
+{
+  CvHaarClassifierCascade *cv;
+  GstHaarCascade *cascade;
+
+  cv = (CvHaarClassifierCascade *) cvLoad (filename, 0, 0, 0);
+  if (!cv)
+    return NULL;
+
+  cascade = gst_haar_cascade_new_from_cv (cv);
+  cvReleaseHaarClassifierCascade (&cv);
+  return cascade;
+}
+
+void
+gst_haar_cascade_free (GstHaarCascade * cascade)
+{
+  if (!cascade)
+    return;
+
+  g_free (cascade->cache_path);
+  if (cascade->mapped) {
+    g_mapped_file_unref (cascade->mapped);
+    g_free (cascade);
+    return;
+  }
+
+  g_free (cascade->stage_first);
+  g_free (cascade->stage_count);
+  g_free (cascade->stage_threshold);
+  g_free (cascade->classifier_node);
+  g_free (cascade->classifier_count);
+  g_free (cascade->classifier_alpha);
+  g_free (cascade->node_threshold);
+  g_free (cascade->node_left);
+  g_free (cascade->node_right);
+  g_free (cascade->node_tilted);
+  g_free (cascade->node_n_rects);
+  g_free (cascade->rect);
+  g_free (cascade->rect_weight);
+  g_free (cascade->alpha);
+  g_free (cascade);
+}
+
+/* walks the arrays of a binary cascade with @counts items, returns the
+ * file size */
+static gsize
+gst_haar_file_layout (const gint32 * counts, gsize * offsets)
+{
+  gsize pos = sizeof (GstHaarFileHeader);
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (gst_haar_file_arrays); i++) {
+    pos = (pos + GST_HAAR_FILE_ALIGN - 1) & ~(gsize) (GST_HAAR_FILE_ALIGN - 1);
+    offsets[i] = pos;
+    pos += (gsize) counts[gst_haar_file_arrays[i].count] *
+        gst_haar_file_arrays[i].per * gst_haar_file_arrays[i].size;
+  }
+  return pos;
+}
+
+gboolean
+gst_haar_cascade_is_binary (const gchar * filename)
+{
+  gchar magic[8];
+  gboolean ret = FALSE;
+  FILE *f;
+
+  if (!filename || !(f = g_fopen (filename, "rb")))
+    return FALSE;
+  if (fread (magic, sizeof (magic), 1, f) == 1)
+    ret = memcmp (magic, GST_HAAR_FILE_MAGIC, sizeof (magic)) == 0;
+  fclose (f);
+  return ret;
+}
+
+gboolean
+gst_haar_cascade_save (const GstHaarCascade * cascade, const gchar * filename,
+    GError ** err)
+{
+  gsize offsets[G_N_ELEMENTS (gst_haar_file_arrays)];
+  GstHaarFileHeader *header;
+  gint32 counts[4];
+  gchar *data;
+  gsize size;
+  gboolean ret;
+  gint i;
+
+  g_return_val_if_fail (cascade != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  counts[GST_HAAR_N_STAGES] = cascade->n_stages;
+  counts[GST_HAAR_N_CLASSIFIERS] = cascade->n_classifiers;
+  counts[GST_HAAR_N_NODES] = cascade->n_nodes;
+  counts[GST_HAAR_N_ALPHAS] = cascade->n_alphas;
+  size = gst_haar_file_layout (counts, offsets);
+
+  data = g_malloc0 (size);
+  header = (GstHaarFileHeader *) data;
+  memcpy (header->magic, GST_HAAR_FILE_MAGIC, sizeof (header->magic));
+  header->byte_order = GST_HAAR_FILE_BYTE_ORDER;
+  header->version = GST_HAAR_FILE_VERSION;
+  header->window_width = cascade->window_width;
+  header->window_height = cascade->window_height;
+  header->has_tilted = cascade->has_tilted;
+  header->n_stages = cascade->n_stages;
+  header->n_classifiers = cascade->n_classifiers;
+  header->n_nodes = cascade->n_nodes;
+  header->n_alphas = cascade->n_alphas;
+
+  for (i = 0; i < G_N_ELEMENTS (gst_haar_file_arrays); i++) {
+    gsize len = (gsize) counts[gst_haar_file_arrays[i].count] *
+        gst_haar_file_arrays[i].per * gst_haar_file_arrays[i].size;
+
+    memcpy (data + offsets[i], G_STRUCT_MEMBER (gpointer, cascade,
+            gst_haar_file_arrays[i].offset), len);
+  }
+
+  ret = g_file_set_contents (filename, data, size, err);
+  g_free (data);
+  return ret;
+}
+
+static guint32
+gst_haar_fnv1a (guint32 hash, gconstpointer data, gsize size)
+{
+  const guint8 *p = data;
+  gsize i;
+
+  for (i = 0; i < size; i++)
+    hash = (hash ^ p[i]) * 16777619u;
+  return hash;
+}
+
+/* FNV-1a of the window size and of the arrays in host byte order, which
+ * is enough to tell whether two cascades evaluate the same way */
+guint32
+gst_haar_cascade_checksum (const GstHaarCascade * cascade)
+{
+  gint32 counts[4], size[2];
+  guint32 hash = 2166136261u;
+  gint i;
+
+  g_return_val_if_fail (cascade != NULL, 0);
+
+  counts[GST_HAAR_N_STAGES] = cascade->n_stages;
+  counts[GST_HAAR_N_CLASSIFIERS] = cascade->n_classifiers;
+  counts[GST_HAAR_N_NODES] = cascade->n_nodes;
+  counts[GST_HAAR_N_ALPHAS] = cascade->n_alphas;
+  size[0] = cascade->window_width;
+  size[1] = cascade->window_height;
+  hash = gst_haar_fnv1a (hash, size, sizeof (size));
+  hash = gst_haar_fnv1a (hash, counts, sizeof (counts));
+
+  for (i = 0; i < G_N_ELEMENTS (gst_haar_file_arrays); i++)
+    hash = gst_haar_fnv1a (hash, G_STRUCT_MEMBER (gpointer, cascade,
+            gst_haar_file_arrays[i].offset),
+        (gsize) counts[gst_haar_file_arrays[i].count] *
+        gst_haar_file_arrays[i].per * gst_haar_file_arrays[i].size);
+  return hash;
+}
+
+/* whether the rectangles of node @n lie within the window, tilted ones
+ * being rotated by 45 degrees around their first corner */
+static gboolean
+gst_haar_cascade_check_rects (const GstHaarCascade * cascade, gint n)
+{
+  const gint16 *rect = cascade->rect + n * GST_HAAR_MAX_RECTS * 4;
+  gint r;
+
+  for (r = 0; r < cascade->node_n_rects[n]; r++) {
+    gint x = rect[r * 4 + 0], y = rect[r * 4 + 1];
+    gint w = rect[r * 4 + 2], h = rect[r * 4 + 3];
+
+    if (x < 0 || y < 0 || w < 0 || h < 0 || (r == 0 && (w == 0 || h == 0)))
+      return FALSE;
+    if (!cascade->node_tilted[n] ? x + w > cascade->window_width ||
+        y + h > cascade->window_height : x - h < 0 ||
+        x + w > cascade->window_width || y + w + h > cascade->window_height)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/* a corrupt file must not send the evaluator outside the arrays */
+static gboolean
+gst_haar_cascade_check (const GstHaarCascade * cascade)
+{
+  gint i, j, k;
+
+  /* the variance window is the window minus a one pixel border */
+  if (cascade->window_width <= 2 || cascade->window_height <= 2 ||
+      cascade->n_stages <= 0)
+    return FALSE;
+
+  for (i = 0; i < cascade->n_stages; i++) {
+    if (cascade->stage_first[i] < 0 || cascade->stage_count[i] < 0 ||
+        cascade->stage_first[i] + cascade->stage_count[i] >
+        cascade->n_classifiers)
+      return FALSE;
+  }
+
+  for (i = 0; i < cascade->n_classifiers; i++) {
+    gint node = cascade->classifier_node[i];
+    gint count = cascade->classifier_count[i];
+
+    if (node < 0 || count < 1 || node + count > cascade->n_nodes ||
+        cascade->classifier_alpha[i] < 0 ||
+        cascade->classifier_alpha[i] + count + 1 > cascade->n_alphas)
+      return FALSE;
+
+    for (j = 0; j < count; j++) {
+      gint child[2];
+
+      child[0] = cascade->node_left[node + j];
+      child[1] = cascade->node_right[node + j];
+      /* inner nodes only lead forward, so the walk ends */
+      for (k = 0; k < 2; k++)
+        if (child[k] >= count || -child[k] > count ||
+            (child[k] > 0 && child[k] <= j))
+          return FALSE;
+      if (cascade->node_n_rects[node + j] < 1 ||
+          cascade->node_n_rects[node + j] > GST_HAAR_MAX_RECTS ||
+          !gst_haar_cascade_check_rects (cascade, node + j))
+        return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* Maps a cascade written by gst_haar_cascade_save(): no parsing and no
+ * copy, the pages are shared by every process using the same file. */
+GstHaarCascade *
+gst_haar_cascade_map (const gchar * filename, GError ** err)
+{
+  gsize offsets[G_N_ELEMENTS (gst_haar_file_arrays)];
+  const GstHaarFileHeader *header;
+  GstHaarCascade *cascade;
+  GMappedFile *mapped;
+  gint32 counts[4];
+  gchar *data;
+  gint i;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  mapped = g_mapped_file_new (filename, FALSE, err);
+  if (!mapped)
+    return NULL;
+
+  data = g_mapped_file_get_contents (mapped);
+  header = (const GstHaarFileHeader *) data;
+  if (g_mapped_file_get_length (mapped) < sizeof (GstHaarFileHeader) ||
+      memcmp (header->magic, GST_HAAR_FILE_MAGIC, sizeof (header->magic)) ||
+      header->byte_order != GST_HAAR_FILE_BYTE_ORDER ||
+      header->version != GST_HAAR_FILE_VERSION ||
+      header->n_stages < 0 || header->n_classifiers < 0 ||
+      header->n_nodes < 0 || header->n_alphas < 0)
+    goto invalid;
+
+  counts[GST_HAAR_N_STAGES] = header->n_stages;
+  counts[GST_HAAR_N_CLASSIFIERS] = header->n_classifiers;
+  counts[GST_HAAR_N_NODES] = header->n_nodes;
+  counts[GST_HAAR_N_ALPHAS] = header->n_alphas;
+  if (gst_haar_file_layout (counts, offsets) >
+      g_mapped_file_get_length (mapped))
+    goto invalid;
+
+  cascade = g_new0 (GstHaarCascade, 1);
+  cascade->refcount = 1;
+  cascade->window_width = header->window_width;
+  cascade->window_height = header->window_height;
+  cascade->has_tilted = header->has_tilted;
+  cascade->n_stages = header->n_stages;
+  cascade->n_classifiers = header->n_classifiers;
+  cascade->n_nodes = header->n_nodes;
+  cascade->n_alphas = header->n_alphas;
+  for (i = 0; i < G_N_ELEMENTS (gst_haar_file_arrays); i++)
+    G_STRUCT_MEMBER (gpointer, cascade, gst_haar_file_arrays[i].offset) =
+        data + offsets[i];
+  cascade->mapped = mapped;
+
+  if (!gst_haar_cascade_check (cascade)) {
+    gst_haar_cascade_free (cascade);
+    mapped = NULL;
+    goto invalid;
+  }
+  return cascade;
+
+invalid:
+  g_set_error (err, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+      "%s is not a valid binary haar cascade", filename);
+  if (mapped)
+    g_mapped_file_unref (mapped);
+  return NULL;
+}
+
+/* Process-wide cache of the cascades opened by path: every user of the
+ * same file gets the same immutable cascade, which is dropped from the cache
+ * when its last reference goes away. A file whose times, size or inode
+ * changed is loaded again, the users of the old version keep it until they unref it.
+ * Concurrent first opens of a file may each parse it, all but one copy is
+ * dropped again.
+ */
+G_LOCK_DEFINE_STATIC (cache);
+static GHashTable *cache = NULL;
+
+#define GST_HAAR_STAT_TIME(st, t) \
+    ((gint64) (st)->st_##t##e * G_GINT64_CONSTANT (1000000000) + \
+    GST_HAAR_STAT_NSEC (st, t))
+
+static void
+gst_haar_cascade_set_stamp (GstHaarCascade * cascade, const struct stat *st)
+{
+  cascade->cache_mtime = GST_HAAR_STAT_TIME (st, mtim);
+  cascade->cache_ctime = GST_HAAR_STAT_TIME (st, ctim);
+  cascade->cache_size = st->st_size;
+  cascade->cache_ino = st->st_ino;
+  cascade->cache_dev = st->st_dev;
+}
+
+/* whether @cascade was read from the file @st describes, as it is now: a
+ * rewrite within the same second keeps neither the nanoseconds of the
+ * change time nor, when renamed into place, the inode */
+static gboolean
+gst_haar_cascade_is_current (const GstHaarCascade * cascade,
+    const struct stat *st)
+{
+  return cascade->cache_mtime == GST_HAAR_STAT_TIME (st, mtim) &&
+      cascade->cache_ctime == GST_HAAR_STAT_TIME (st, ctim) &&
+      cascade->cache_size == (gint64) st->st_size &&
+      cascade->cache_ino == (guint64) st->st_ino &&
+      cascade->cache_dev == (guint64) st->st_dev;
+}
+
+GstHaarCascade *
+gst_haar_cascade_open (const gchar * filename, GError ** err)
+{
+  GstHaarCascade *cascade, *cached;
+  struct stat st;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  if (g_stat (filename, &st) != 0) {
+    g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Could not stat %s: %s", filename, g_strerror (errno));
+    return NULL;
+  }
+
+  G_LOCK (cache);
+  if (!cache)
+    cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+  cached = g_hash_table_lookup (cache, filename);
+  if (cached && gst_haar_cascade_is_current (cached, &st)) {
+    cached->refcount++;
+    G_UNLOCK (cache);
+    return cached;
+  }
+  G_UNLOCK (cache);
+
+  /* parse without the lock, which every unref takes: a streaming thread
+   * dropping its old cascade must not wait for a load elsewhere */
+  if (gst_haar_cascade_is_binary (filename)) {
+    cascade = gst_haar_cascade_map (filename, err);
+  } else {
+    cascade = gst_haar_cascade_load (filename);
+    if (!cascade)
+      g_set_error (err, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+          "Could not load haar cascade %s", filename);
+  }
+  if (!cascade)
+    return NULL;
+
+  cascade->cache_path = g_strdup (filename);
+  gst_haar_cascade_set_stamp (cascade, &st);
+
+  G_LOCK (cache);
+  /* an open of the same file that raced with us may have got there first,
+   * its copy is shared and ours thrown away */
+  cached = g_hash_table_lookup (cache, filename);
+  if (cached && gst_haar_cascade_is_current (cached, &st)) {
+    cached->refcount++;
+    G_UNLOCK (cache);
+    gst_haar_cascade_free (cascade);
+    return cached;
+  }
+  /* replaces an outdated version, which then lives on uncached */
+  g_hash_table_replace (cache, cascade->cache_path, cascade);
+  G_UNLOCK (cache);
+
+  return cascade;
+}
+
+GstHaarCascade *
+gst_haar_cascade_ref (GstHaarCascade * cascade)
+{
+  g_return_val_if_fail (cascade != NULL, NULL);
+
+  G_LOCK (cache);
+  cascade->refcount++;
+  G_UNLOCK (cache);
+
+  return cascade;
+}
+
+void
+gst_haar_cascade_unref (GstHaarCascade * cascade)
+{
+  gboolean last;
+
+  if (!cascade)
+    return;
+
+  G_LOCK (cache);
+  last = --cascade->refcount == 0;
+  if (last && cascade->cache_path &&
+      g_hash_table_lookup (cache, cascade->cache_path) == cascade)
+    g_hash_table_remove (cache, cascade->cache_path);
+  G_UNLOCK (cache);
+
+  if (last)
+    gst_haar_cascade_free (cascade);
+}
+
+/* same corner layout as CV_SUM_PTRS / CV_TILTED_PTRS */
+static void
+gst_haar_scale_corners (gint32 * ofs, gint x, gint y, gint w, gint h,
+    gboolean tilted, gint stride)
+{
+  if (!tilted) {
+    ofs[0] = y * stride + x;
+    ofs[1] = y * stride + x + w;
+    ofs[2] = (y + h) * stride + x;
+    ofs[3] = (y + h) * stride + x + w;
+  } else {
+    ofs[0] = y * stride + x;
+    ofs[1] = (y + h) * stride + x - h;
+    ofs[2] = (y + w) * stride + x + w;
+    ofs[3] = (y + w + h) * stride + x + w - h;
+  }
+}
+
+static gint64
+gst_haar_gcd (gint64 a, gint64 b)
+{
+  while (b) {
+    gint64 t = a % b;
+
+    a = b;
+    b = t;
+  }
+  return ABS (a);
+}
+
+/* Quantizes the float tables of @scale. A node's weights are the trained
+ * ones times the area of the first rectangle, rebalanced in integers and
+ * divided by their common divisor: for the usual integral weights that is
+ * exact, a flat feature sums to 0 and most nodes end up with weights like
+ * -1, 2. The node sum must fit 30 bits, rectangle sums are shifted right
+ * as much as needed for that. The rest of the scaling, the window norm
+ * and the node threshold make up the right hand side, T * 2^-e * norm,
+ * each node keeping 13 bits of T whatever the magnitude of its threshold.
+ */
+static void
+gst_haar_scale_init_fixed (GstHaarScale * scale,
+    const GstHaarCascade * cascade, gint area)
+{
+  gint n, r, i;
+
+  scale->area = area;
+  scale->iweight = g_new0 (gint32, cascade->n_nodes * GST_HAAR_MAX_RECTS);
+  scale->ithreshold = g_new0 (gint32, cascade->n_nodes);
+  scale->ishift = g_new0 (guint8, cascade->n_nodes * 3);
+
+  /* the norm is at most 128 * area, keep it within 16 bits */
+  scale->norm_shift = 0;
+  while (((gint64) area << 7 >> scale->norm_shift) >= (1 << 16))
+    scale->norm_shift++;
+
+  for (n = 0; n < cascade->n_nodes; n++) {
+    const gint16 *rect = cascade->rect + n * GST_HAAR_MAX_RECTS * 4;
+    const gfloat *rw = cascade->rect_weight + n * GST_HAAR_MAX_RECTS;
+    gint32 *iweight = scale->iweight + n * GST_HAAR_MAX_RECTS;
+    gboolean tilted = cascade->node_tilted[n];
+    gint n_rects = cascade->node_n_rects[n];
+    gint64 weight[GST_HAAR_MAX_RECTS] = { 0 };
+    gint64 rect_area[GST_HAAR_MAX_RECTS] = { 0 };
+    gint64 max_weight = 0, bound = 0, sum0 = 0, div = 0;
+    gboolean exact = TRUE;
+    gdouble t;
+    gint shift = 0, e = 0, p;
+
+    for (r = 0; r < n_rects; r++)
+      rect_area[r] = (gint64) cvRound (rect[r * 4 + 2] * scale->factor) *
+          cvRound (rect[r * 4 + 3] * scale->factor);
+
+    for (r = 1; r < n_rects; r++) {
+      weight[r] = (gint64) floor (rw[r] * rect_area[0] + 0.5);
+      exact &= weight[r] == rw[r] * rect_area[0];
+      sum0 += weight[r] * rect_area[r];
+    }
+    if (exact && sum0 % rect_area[0] == 0) {
+      weight[0] = -sum0 / rect_area[0];
+      for (r = 0; r < n_rects; r++)
+        div = gst_haar_gcd (div, weight[r]);
+    } else {
+      weight[0] = (gint64) floor (-(gdouble) sum0 / rect_area[0] + 0.5);
+    }
+    if (div > 1) {
+      for (r = 0; r < n_rects; r++)
+        weight[r] /= div;
+    } else {
+      div = 1;
+    }
+
+    /* weights that are not small integers are rounded to 13 bits */
+    for (r = 0; r < n_rects; r++)
+      max_weight = MAX (max_weight, ABS (weight[r]));
+    while ((max_weight >> shift) >= (1 << 13))
+      shift++;
+    if (shift > 0) {
+      sum0 = 0;
+      for (r = 1; r < n_rects; r++) {
+        weight[r] = (weight[r] + (1 << (shift - 1))) >> shift;
+        sum0 += weight[r] * rect_area[r];
+      }
+      weight[0] = (gint64) floor (-(gdouble) sum0 / rect_area[0] + 0.5);
+    }
+    t = cascade->node_threshold[n] * ldexp ((gdouble) rect_area[0] / div,
+        -shift) * (tilted ? 2. : 1.);
+
+    /* a tilted rectangle covers 2 * w * h pixels */
+    for (r = 0; r < n_rects; r++) {
+      iweight[r] = (gint32) weight[r];
+      bound += ABS (weight[r]) * 255 * (tilted ? 2 : 1) * rect_area[r];
+    }
+    shift = 0;
+    while ((bound >> shift) >= (G_GINT64_CONSTANT (1) << 30))
+      shift++;
+    scale->ishift[n * 3] = shift;
+    t = ldexp (t, -shift);
+
+    if (t != 0.)
+      frexp (t, &e);
+    e = 13 - e;
+    /* compare sum >> p against T * norm, or sum against T * norm >> -p
+     * rounded up, both exact on integers */
+    p = scale->norm_shift - e;
+    if (p < -30) {
+      p = -30;
+      e = scale->norm_shift + 30;
+    }
+    p = MIN (p, 31);
+    scale->ithreshold[n] = (gint32) floor (ldexp (t, e) + 0.5);
+    scale->ishift[n * 3 + 1] = MAX (p, 0);
+    scale->ishift[n * 3 + 2] = MAX (-p, 0);
+  }
+
+  scale->ialpha = g_new (gint32, cascade->n_alphas);
+  for (i = 0; i < cascade->n_alphas; i++)
+    scale->ialpha[i] = (gint32) floor (ldexp (cascade->alpha[i],
+            GST_HAAR_ALPHA_BITS) + 0.5);
+  scale->istage_threshold = g_new (gint32, cascade->n_stages);
+  for (i = 0; i < cascade->n_stages; i++)
+    scale->istage_threshold[i] = (gint32) floor (ldexp
+        (cascade->stage_threshold[i], GST_HAAR_ALPHA_BITS) + 0.5);
+}
+
+/* packs the first stage of @scale if it is made of stumps only */
+static void
+gst_haar_scale_init_stumps (GstHaarScale * scale,
+    const GstHaarCascade * cascade)
+{
+  gint first = cascade->stage_first[0];
+  gint count = cascade->stage_count[0];
+  gint i;
+
+  for (i = first; i < first + count; i++)
+    if (cascade->classifier_count[i] != 1)
+      return;
+
+  scale->stumps_mem = g_malloc (count * sizeof (GstHaarStump) +
+      GST_HAAR_STUMP_ALIGN - 1);
+  scale->stumps = (GstHaarStump *) (((gsize) scale->stumps_mem +
+          GST_HAAR_STUMP_ALIGN - 1) & ~(gsize) (GST_HAAR_STUMP_ALIGN - 1));
+  scale->n_stumps = count;
+
+  for (i = 0; i < count; i++) {
+    GstHaarStump *stump = &scale->stumps[i];
+    gint cl = first + i;
+    gint n = cascade->classifier_node[cl];
+    gint a = cascade->classifier_alpha[cl];
+
+    memcpy (stump->ofs, scale->ofs + n * GST_HAAR_MAX_RECTS * 4,
+        sizeof (stump->ofs));
+    memcpy (stump->weight, scale->weight + n * GST_HAAR_MAX_RECTS,
+        sizeof (stump->weight));
+    memcpy (stump->iweight, scale->iweight + n * GST_HAAR_MAX_RECTS,
+        sizeof (stump->iweight));
+    memcpy (stump->ishift, scale->ishift + n * 3, sizeof (stump->ishift));
+    stump->threshold = cascade->node_threshold[n];
+    stump->ithreshold = scale->ithreshold[n];
+    stump->alpha[0] = cascade->alpha[a];
+    stump->alpha[1] = cascade->alpha[a + 1];
+    stump->ialpha[0] = scale->ialpha[a];
+    stump->ialpha[1] = scale->ialpha[a + 1];
+    stump->n_rects = cascade->node_n_rects[n];
+    stump->tilted = cascade->node_tilted[n];
+  }
+}
+
+void
+gst_haar_scale_init (GstHaarScale * scale, const GstHaarCascade * cascade,
+    gdouble factor, gint stride)
+{
+  gint ex, ey, ew, eh;
+  gdouble weight_scale;
+  gint n, r;
+
+  scale->factor = factor;
+  scale->stride = stride;
+  scale->win_width = cvRound (cascade->window_width * factor);
+  scale->win_height = cvRound (cascade->window_height * factor);
+  scale->step = MAX (2., factor);
+
+  /* variance is measured on the window minus a one pixel border */
+  ex = ey = cvRound (factor);
+  ew = cvRound ((cascade->window_width - 2) * factor);
+  eh = cvRound ((cascade->window_height - 2) * factor);
+  gst_haar_scale_corners (scale->norm_ofs, ex, ey, ew, eh, FALSE, stride);
+  weight_scale = 1. / (ew * eh);
+  scale->inv_area = weight_scale;
+
+  scale->ofs = g_new0 (gint32, cascade->n_nodes * GST_HAAR_MAX_RECTS * 4);
+  scale->weight = g_new0 (gfloat, cascade->n_nodes * GST_HAAR_MAX_RECTS);
+
+  for (n = 0; n < cascade->n_nodes; n++) {
+    const gint16 *rect = cascade->rect + n * GST_HAAR_MAX_RECTS * 4;
+    gint32 *ofs = scale->ofs + n * GST_HAAR_MAX_RECTS * 4;
+    gfloat *weight = scale->weight + n * GST_HAAR_MAX_RECTS;
+    gboolean tilted = cascade->node_tilted[n];
+    gdouble correction = weight_scale * (tilted ? 0.5 : 1.);
+    gdouble sum0 = 0, area0 = 0;
+
+    for (r = 0; r < cascade->node_n_rects[n]; r++) {
+      gint x = cvRound (rect[r * 4 + 0] * factor);
+      gint y = cvRound (rect[r * 4 + 1] * factor);
+      gint w = cvRound (rect[r * 4 + 2] * factor);
+      gint h = cvRound (rect[r * 4 + 3] * factor);
+
+      gst_haar_scale_corners (ofs + r * 4, x, y, w, h, tilted, stride);
+      weight[r] = (gfloat) (cascade->rect_weight[n * GST_HAAR_MAX_RECTS + r] *
+          correction);
+      if (r == 0)
+        area0 = w * h;
+      else
+        sum0 += weight[r] * w * h;
+    }
+    /* the first rectangle is rebalanced so that a flat window sums to 0 */
+    weight[0] = (gfloat) (-sum0 / area0);
+  }
+
+  gst_haar_scale_init_fixed (scale, cascade, ew * eh);
+  gst_haar_scale_init_stumps (scale, cascade);
+
+  /* edges are counted on the inner 70% of the window, as Canny pruning */
+  ex = cvRound (scale->win_width * 0.15);
+  ey = cvRound (scale->win_height * 0.15);
+  ew = cvRound (scale->win_width * 0.7);
+  eh = cvRound (scale->win_height * 0.7);
+  gst_haar_scale_corners (scale->edge_ofs, ex, ey, ew, eh, FALSE, stride);
+  scale->edge_area = ew * eh;
+}
+
+void
+gst_haar_scale_clear (GstHaarScale * scale)
+{
+  g_free (scale->ofs);
+  g_free (scale->weight);
+  g_free (scale->iweight);
+  g_free (scale->ithreshold);
+  g_free (scale->ishift);
+  g_free (scale->ialpha);
+  g_free (scale->istage_threshold);
+  g_free (scale->stumps_mem);
+  scale->ofs = NULL;
+  scale->weight = NULL;
+  scale->iweight = NULL;
+  scale->ithreshold = NULL;
+  scale->ishift = NULL;
+  scale->ialpha = NULL;
+  scale->istage_threshold = NULL;
+  scale->stumps_mem = NULL;
+  scale->stumps = NULL;
+  scale->n_stumps = 0;
+}
+
+void
+gst_haar_scale_variance (const GstHaarScale * scale,
+    const GstHaarIntegral * integral, const gint32 * offsets, gint n,
+    gfloat * norm)
+{
+  const gint32 *o = scale->norm_ofs;
+  gint i;
+
+  for (i = 0; i < n; i++) {
+    const gint32 *p = integral->sum + offsets[i];
+    const gint64 *q = integral->sqsum + offsets[i];
+    gdouble mean, var;
+
+    mean = (p[o[0]] - p[o[1]] - p[o[2]] + p[o[3]]) * scale->inv_area;
+    var = (q[o[0]] - q[o[1]] - q[o[2]] + q[o[3]]) * scale->inv_area
+        - mean * mean;
+    norm[i] = var >= 0. ? (gfloat) sqrt (var) : 1.0f;
+  }
+}
+
+/* The first stage of gst_haar_cascade_eval() on @n windows, typically a
+ * whole row: most windows are rejected there, so it is run a node at a
+ * time over blocks of windows, from the packed stumps and with nothing
+ * but the sums depending on the window. result[i] is 1 or 0.
+ */
+void
+gst_haar_cascade_eval_first (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gfloat * norm, gint n, gint * result)
+{
+  gint32 ofs[GST_HAAR_FIRST_BLOCK + HAAR_LANES];
+  gfloat nrm[GST_HAAR_FIRST_BLOCK + HAAR_LANES];
+  gfloat acc[GST_HAAR_FIRST_BLOCK + HAAR_LANES];
+  HaarVec threshold = haar_vec_set1 (cascade->stage_threshold[0]);
+  gint b0, b, i, l;
+
+  if (!scale->stumps) {
+    gst_haar_cascade_eval (cascade, scale, integral, offsets, norm, n, 0, 1,
+        result);
+    return;
+  }
+
+  for (b0 = 0; b0 < n; b0 += GST_HAAR_FIRST_BLOCK) {
+    gint m = MIN (GST_HAAR_FIRST_BLOCK, n - b0);
+
+    /* pad the last batch with the first window */
+    for (b = 0; b < m + HAAR_LANES; b++) {
+      ofs[b] = offsets[b0 + (b < m ? b : 0)];
+      nrm[b] = norm[b0 + (b < m ? b : 0)];
+      acc[b] = 0.0f;
+    }
+
+    for (i = 0; i < scale->n_stumps; i++) {
+      const GstHaarStump *stump = &scale->stumps[i];
+      const gint32 *img = stump->tilted ? integral->tilted : integral->sum;
+      HaarVec w0 = haar_vec_set1 (stump->weight[0]);
+      HaarVec w1 = haar_vec_set1 (stump->weight[1]);
+      HaarVec w2 = haar_vec_set1 (stump->weight[2]);
+      HaarVec t = haar_vec_set1 (stump->threshold);
+      HaarVec a0 = haar_vec_set1 (stump->alpha[0]);
+      HaarVec a1 = haar_vec_set1 (stump->alpha[1]);
+
+      for (b = 0; b < m; b += HAAR_LANES) {
+        HaarIdx idx = haar_idx_load (ofs + b);
+        HaarVec sum;
+
+        sum = haar_vec_mul (haar_rect_sum (img, idx, stump->ofs), w0);
+        sum = haar_vec_add (sum, haar_vec_mul (haar_rect_sum (img, idx,
+                    stump->ofs + 4), w1));
+        if (stump->n_rects > 2)
+          sum = haar_vec_add (sum, haar_vec_mul (haar_rect_sum (img, idx,
+                      stump->ofs + 8), w2));
+        haar_vec_store (acc + b, haar_vec_add (haar_vec_load (acc + b),
+                haar_vec_select_lt (sum, haar_vec_mul (t,
+                        haar_vec_load (nrm + b)), a0, a1)));
+      }
+    }
+
+    for (b = 0; b < m; b += HAAR_LANES) {
+      gint pass = haar_vec_mask_ge (haar_vec_load (acc + b), threshold);
+
+      for (l = 0; l < HAAR_LANES && b + l < m; l++)
+        result[b0 + b + l] = (pass >> l) & 1;
+    }
+  }
+}
+
+/* floor (sqrt (v)), one result bit per step */
+static inline guint32
+gst_haar_isqrt (guint32 v)
+{
+  guint32 root = 0, bit = 1u << 30;
+
+  while (bit > v)
+    bit >>= 2;
+  for (; bit; bit >>= 2) {
+    guint32 t = root + bit;
+    guint32 ge = -(guint32) (v >= t);
+
+    v -= t & ge;
+    root = (root >> 1) + (bit & ge);
+  }
+  return root;
+}
+
+/* area times the standard deviation of the window, shifted by norm_shift */
+void
+gst_haar_scale_variance_fixed (const GstHaarScale * scale,
+    const GstHaarIntegral * integral, const gint32 * offsets, gint n,
+    gint32 * norm)
+{
+  const gint32 *o = scale->norm_ofs;
+  gint shift = scale->norm_shift;
+  gint i;
+
+  for (i = 0; i < n; i++) {
+    const gint32 *p = integral->sum + offsets[i];
+    const gint64 *q = integral->sqsum + offsets[i];
+    gint64 sum, var;
+
+    /* below 2^32 once shifted, as the norm is below 2^16 */
+    sum = p[o[0]] - p[o[1]] - p[o[2]] + p[o[3]];
+    var = (q[o[0]] - q[o[1]] - q[o[2]] + q[o[3]]) * scale->area - sum * sum;
+    norm[i] = var >= 0 ? (gint32) gst_haar_isqrt ((guint32) (var >>
+            (shift * 2))) : scale->area >> shift;
+  }
+}
+
+/* classifiers with more than one node are walked one window at a time */
+static gfloat
+gst_haar_cascade_tree (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    gint cl, gint32 offset, gfloat norm)
+{
+  gint first = cascade->classifier_node[cl];
+  gint idx = 0;
+
+  do {
+    gint n = first + idx;
+    const gint32 *img = (cascade->node_tilted[n] ? integral->tilted :
+        integral->sum) + offset;
+    gfloat sum = haar_node_sum (img, scale->ofs + n * GST_HAAR_MAX_RECTS * 4,
+        scale->weight + n * GST_HAAR_MAX_RECTS, cascade->node_n_rects[n]);
+
+    idx = sum < cascade->node_threshold[n] * norm ?
+        cascade->node_left[n] : cascade->node_right[n];
+  } while (idx > 0);
+
+  return cascade->alpha[cascade->classifier_alpha[cl] - idx];
+}
+
+/* Runs stages [first_stage, last_stage) on @n windows given by their offset
+ * in the integral images. result[i] is 1 when window i passed all of them,
+ * -stage of the rejecting stage otherwise.
+ */
+void
+gst_haar_cascade_eval (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gfloat * norm, gint n,
+    gint first_stage, gint last_stage, gint * result)
+{
+  gint32 lane_ofs[HAAR_LANES];
+  gfloat lane_norm[HAAR_LANES];
+  gfloat lane_val[HAAR_LANES];
+  gint b, l;
+
+  for (b = 0; b < n; b += HAAR_LANES) {
+    gint m = MIN (HAAR_LANES, n - b);
+    gint alive = (1 << m) - 1;
+    HaarIdx idx;
+    HaarVec vnorm;
+    gint st;
+
+    /* pad a partial batch with the first window, its lanes are masked */
+    for (l = 0; l < HAAR_LANES; l++) {
+      lane_ofs[l] = offsets[b + (l < m ? l : 0)];
+      lane_norm[l] = norm[b + (l < m ? l : 0)];
+    }
+    idx = haar_idx_load (lane_ofs);
+    vnorm = haar_vec_load (lane_norm);
+
+    for (st = first_stage; st < last_stage && alive; st++) {
+      gint cl = cascade->stage_first[st];
+      gint end = cl + cascade->stage_count[st];
+      HaarVec acc = haar_vec_zero ();
+      gint pass;
+
+      for (; cl < end; cl++) {
+        gint nd = cascade->classifier_node[cl];
+
+        if (G_LIKELY (cascade->classifier_count[cl] == 1)) {
+          const gint32 *img = cascade->node_tilted[nd] ? integral->tilted :
+              integral->sum;
+          const gfloat *a = cascade->alpha + cascade->classifier_alpha[cl];
+
+          acc = haar_stump (acc, img, idx, vnorm,
+              scale->ofs + nd * GST_HAAR_MAX_RECTS * 4,
+              scale->weight + nd * GST_HAAR_MAX_RECTS,
+              cascade->node_n_rects[nd], cascade->node_threshold[nd], a[0],
+              a[1]);
+        } else {
+          for (l = 0; l < HAAR_LANES; l++)
+            lane_val[l] = gst_haar_cascade_tree (cascade, scale, integral, cl,
+                lane_ofs[l], lane_norm[l]);
+          acc = haar_vec_add (acc, haar_vec_load (lane_val));
+        }
+      }
+
+      pass = haar_vec_mask_ge (acc,
+          haar_vec_set1 (cascade->stage_threshold[st])) & HAAR_LANE_MASK;
+      for (l = 0; l < m; l++)
+        if ((alive & ~pass) & (1 << l))
+          result[b + l] = -st;
+      alive &= pass;
+    }
+
+    for (l = 0; l < m; l++)
+      if (alive & (1 << l))
+        result[b + l] = 1;
+  }
+}
+
+static gint32
+gst_haar_cascade_tree_fixed (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    gint cl, gint32 offset, gint32 norm)
+{
+  gint first = cascade->classifier_node[cl];
+  gint idx = 0;
+
+  do {
+    gint n = first + idx;
+    const gint32 *img = (cascade->node_tilted[n] ? integral->tilted :
+        integral->sum) + offset;
+    const gint32 *o = scale->ofs + n * GST_HAAR_MAX_RECTS * 4;
+    const gint32 *w = scale->iweight + n * GST_HAAR_MAX_RECTS;
+    const guint8 *shift = scale->ishift + n * 3;
+    gint32 sum = 0, t;
+    gint r;
+
+    for (r = 0; r < cascade->node_n_rects[n]; r++, o += 4)
+      sum += ((img[o[0]] - img[o[1]] - img[o[2]] + img[o[3]] +
+              ((1 << shift[0]) >> 1)) >> shift[0]) * w[r];
+
+    t = (scale->ithreshold[n] * norm + (1 << shift[2]) - 1) >> shift[2];
+    idx = (sum >> shift[1]) < t ?
+        cascade->node_left[n] : cascade->node_right[n];
+  } while (idx > 0);
+
+  return scale->ialpha[cascade->classifier_alpha[cl] - idx];
+}
+
+/* gst_haar_cascade_eval() on the fixed point tables of @scale, with @norm
+ * from gst_haar_scale_variance_fixed() */
+void
+gst_haar_cascade_eval_fixed (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gint32 * norm, gint n,
+    gint first_stage, gint last_stage, gint * result)
+{
+  gint32 lane_ofs[HAAR_LANES];
+  gint32 lane_norm[HAAR_LANES];
+  gint32 lane_val[HAAR_LANES];
+  gint b, l;
+
+  for (b = 0; b < n; b += HAAR_LANES) {
+    gint m = MIN (HAAR_LANES, n - b);
+    gint alive = (1 << m) - 1;
+    HaarIdx idx;
+    HaarIVec vnorm;
+    gint st;
+
+    for (l = 0; l < HAAR_LANES; l++) {
+      lane_ofs[l] = offsets[b + (l < m ? l : 0)];
+      lane_norm[l] = norm[b + (l < m ? l : 0)];
+    }
+    idx = haar_idx_load (lane_ofs);
+    vnorm = haar_ivec_load (lane_norm);
+
+    for (st = first_stage; st < last_stage && alive; st++) {
+      gint cl = cascade->stage_first[st];
+      gint end = cl + cascade->stage_count[st];
+      HaarIVec acc = haar_ivec_zero ();
+      gint pass;
+
+      for (; cl < end; cl++) {
+        gint nd = cascade->classifier_node[cl];
+
+        if (G_LIKELY (cascade->classifier_count[cl] == 1)) {
+          const gint32 *img = cascade->node_tilted[nd] ? integral->tilted :
+              integral->sum;
+          const gint32 *o = scale->ofs + nd * GST_HAAR_MAX_RECTS * 4;
+          const gint32 *w = scale->iweight + nd * GST_HAAR_MAX_RECTS;
+          const gint32 *a = scale->ialpha + cascade->classifier_alpha[cl];
+          const guint8 *shift = scale->ishift + nd * 3;
+          HaarIVec sum, t;
+
+          sum = haar_ivec_mul (haar_rect_isum (img, idx, o, shift[0]),
+              haar_ivec_set1 (w[0]));
+          sum = haar_ivec_add (sum, haar_ivec_mul (haar_rect_isum (img, idx,
+                      o + 4, shift[0]), haar_ivec_set1 (w[1])));
+          if (cascade->node_n_rects[nd] > 2)
+            sum = haar_ivec_add (sum, haar_ivec_mul (haar_rect_isum (img,
+                        idx, o + 8, shift[0]), haar_ivec_set1 (w[2])));
+          sum = haar_ivec_sra (sum, shift[1]);
+
+          t = haar_ivec_mul (haar_ivec_set1 (scale->ithreshold[nd]), vnorm);
+          t = haar_ivec_sra (haar_ivec_add (t,
+                  haar_ivec_set1 ((1 << shift[2]) - 1)), shift[2]);
+          acc = haar_ivec_add (acc, haar_ivec_select_lt (sum, t,
+                  haar_ivec_set1 (a[0]), haar_ivec_set1 (a[1])));
+        } else {
+          for (l = 0; l < HAAR_LANES; l++)
+            lane_val[l] = gst_haar_cascade_tree_fixed (cascade, scale,
+                integral, cl, lane_ofs[l], lane_norm[l]);
+          acc = haar_ivec_add (acc, haar_ivec_load (lane_val));
+        }
+      }
+
+      pass = haar_ivec_mask_ge (acc,
+          haar_ivec_set1 (scale->istage_threshold[st])) & HAAR_LANE_MASK;
+      for (l = 0; l < m; l++)
+        if ((alive & ~pass) & (1 << l))
+          result[b + l] = -st;
+      alive &= pass;
+    }
+
+    for (l = 0; l < m; l++)
+      if (alive & (1 << l))
+        result[b + l] = 1;
+  }
+}
+
+/* gst_haar_cascade_eval_first() on the fixed point tables */
+void
+gst_haar_cascade_eval_first_fixed (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gint32 * norm, gint n, gint * result)
+{
+  gint32 ofs[GST_HAAR_FIRST_BLOCK + HAAR_LANES];
+  gint32 nrm[GST_HAAR_FIRST_BLOCK + HAAR_LANES];
+  gint32 acc[GST_HAAR_FIRST_BLOCK + HAAR_LANES];
+  HaarIVec threshold = haar_ivec_set1 (scale->istage_threshold[0]);
+  gint b0, b, i, l;
+
+  if (!scale->stumps) {
+    gst_haar_cascade_eval_fixed (cascade, scale, integral, offsets, norm, n,
+        0, 1, result);
+    return;
+  }
+
+  for (b0 = 0; b0 < n; b0 += GST_HAAR_FIRST_BLOCK) {
+    gint m = MIN (GST_HAAR_FIRST_BLOCK, n - b0);
+
+    for (b = 0; b < m + HAAR_LANES; b++) {
+      ofs[b] = offsets[b0 + (b < m ? b : 0)];
+      nrm[b] = norm[b0 + (b < m ? b : 0)];
+      acc[b] = 0;
+    }
+
+    for (i = 0; i < scale->n_stumps; i++) {
+      const GstHaarStump *stump = &scale->stumps[i];
+      const gint32 *img = stump->tilted ? integral->tilted : integral->sum;
+      const guint8 *shift = stump->ishift;
+      HaarIVec w0 = haar_ivec_set1 (stump->iweight[0]);
+      HaarIVec w1 = haar_ivec_set1 (stump->iweight[1]);
+      HaarIVec w2 = haar_ivec_set1 (stump->iweight[2]);
+      HaarIVec t = haar_ivec_set1 (stump->ithreshold);
+      HaarIVec round = haar_ivec_set1 ((1 << shift[2]) - 1);
+      HaarIVec a0 = haar_ivec_set1 (stump->ialpha[0]);
+      HaarIVec a1 = haar_ivec_set1 (stump->ialpha[1]);
+
+      for (b = 0; b < m; b += HAAR_LANES) {
+        HaarIdx idx = haar_idx_load (ofs + b);
+        HaarIVec sum, rhs;
+
+        sum = haar_ivec_mul (haar_rect_isum (img, idx, stump->ofs, shift[0]),
+            w0);
+        sum = haar_ivec_add (sum, haar_ivec_mul (haar_rect_isum (img, idx,
+                    stump->ofs + 4, shift[0]), w1));
+        if (stump->n_rects > 2)
+          sum = haar_ivec_add (sum, haar_ivec_mul (haar_rect_isum (img, idx,
+                      stump->ofs + 8, shift[0]), w2));
+        sum = haar_ivec_sra (sum, shift[1]);
+        rhs = haar_ivec_sra (haar_ivec_add (haar_ivec_mul (t,
+                    haar_ivec_load (nrm + b)), round), shift[2]);
+        haar_ivec_store (acc + b, haar_ivec_add (haar_ivec_load (acc + b),
+                haar_ivec_select_lt (sum, rhs, a0, a1)));
+      }
+    }
+
+    for (b = 0; b < m; b += HAAR_LANES) {
+      gint pass = haar_ivec_mask_ge (haar_ivec_load (acc + b), threshold);
+
+      for (l = 0; l < HAAR_LANES && b + l < m; l++)
+        result[b0 + b + l] = (pass >> l) & 1;
+    }
+  }
+}
@@ -0,0 +1,194 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarcascade.h: native haar cascade representation and evaluator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAAR_CASCADE_H__
+#define __GST_HAAR_CASCADE_H__
+
+#include <glib.h>
+#include <cv.h>
+
+#include "gsthaarintegral.h"
+
+G_BEGIN_DECLS
+
+#define GST_HAAR_MAX_RECTS 3
+
+/* fractional bits of the fixed point leaf values and stage thresholds */
+#define GST_HAAR_ALPHA_BITS 20
+
+typedef struct _GstHaarCascade GstHaarCascade;
+typedef struct _GstHaarScale GstHaarScale;
+typedef struct _GstHaarStump GstHaarStump;
+
+/* A cascade flattened out of the CvHaarClassifierCascade tree into plain
+ * arrays, one entry per stage, per classifier (tree) and per tree node.
+ * Node rectangles are in window coordinates, unscaled.
+ */
+struct _GstHaarCascade
+{
+  gint window_width;
+  gint window_height;
+  gboolean has_tilted;
+
+  gint n_stages;
+  gint n_classifiers;
+  gint n_nodes;
+  gint n_alphas;
+
+  /* stages */
+  gint32 *stage_first;          /* first classifier */
+  gint32 *stage_count;
+  gfloat *stage_threshold;      /* stage bias already subtracted */
+
+  /* classifiers */
+  gint32 *classifier_node;      /* first node */
+  gint32 *classifier_count;     /* number of nodes, 1 for stumps */
+  gint32 *classifier_alpha;     /* first leaf value */
+
+  /* nodes: left/right > 0 is a node of the same tree, <= 0 is -leaf */
+  gfloat *node_threshold;
+  gint32 *node_left;
+  gint32 *node_right;
+  guint8 *node_tilted;
+  guint8 *node_n_rects;
+  gint16 *rect;                 /* x, y, width, height per node rectangle */
+  gfloat *rect_weight;
+
+  gfloat *alpha;
+
+  /* private */
+  gint refcount;
+  GMappedFile *mapped;          /* holds the arrays of binary cascades */
+  gchar *cache_path;            /* key in the cascade cache, if cached */
+  gint64 cache_mtime;           /* nanoseconds */
+  gint64 cache_ctime;           /* nanoseconds */
+  gint64 cache_size;
+  guint64 cache_ino;
+  guint64 cache_dev;
+};
+
+/* A node of the first stage with everything its evaluation takes, the
+ * float and the fixed point tables of GstHaarScale side by side. The
+ * stumps of a scale are one contiguous block starting on a cache line.
+ */
+struct _GstHaarStump
+{
+  gint32 ofs[GST_HAAR_MAX_RECTS * 4];
+  gfloat weight[GST_HAAR_MAX_RECTS];
+  gfloat threshold;
+  gfloat alpha[2];
+  gint32 iweight[GST_HAAR_MAX_RECTS];
+  gint32 ithreshold;
+  gint32 ialpha[2];
+  guint8 ishift[3];
+  guint8 n_rects;
+  gboolean tilted;
+};
+
+/* The cascade prepared for one window scale on integral images of a given
+ * row stride: every rectangle reduced to four corner offsets relative to
+ * the window origin and weights normalised by the window area.
+ *
+ * The fixed point tables leave the normalisation out. Node weights are
+ * integers, exact for the usual small integral trained weights, rectangle
+ * sums are shifted right where needed to keep a node sum within 32 bits
+ * and the window norm is sqrt (area * sqsum - sum * sum) shifted right by
+ * @norm_shift. The scaling of each node, its threshold and the area go
+ * into a per node threshold with its own exponent, applied as a shift of
+ * either side of the comparison.
+ */
+struct _GstHaarScale
+{
+  gdouble factor;
+  gint win_width;
+  gint win_height;
+  gdouble step;
+  gint stride;
+
+  gint32 norm_ofs[4];           /* corners of the variance window */
+  gdouble inv_area;
+  gint32 edge_ofs[4];           /* corners of the edge density window */
+  gint edge_area;
+
+  gint32 *ofs;                  /* 4 corners x GST_HAAR_MAX_RECTS per node */
+  gfloat *weight;               /* GST_HAAR_MAX_RECTS per node */
+
+  /* fixed point */
+  gint area;                    /* of the variance window */
+  gint norm_shift;
+  gint32 *iweight;              /* GST_HAAR_MAX_RECTS per node */
+  gint32 *ithreshold;           /* per node */
+  guint8 *ishift;               /* rect sum, node sum, threshold per node */
+  gint32 *ialpha;               /* with GST_HAAR_ALPHA_BITS */
+  gint32 *istage_threshold;
+
+  /* the first stage, NULL if it has trees */
+  GstHaarStump *stumps;
+  gint n_stumps;
+  gpointer stumps_mem;
+};
+
+GstHaarCascade *gst_haar_cascade_new_from_cv (CvHaarClassifierCascade * cv);
+GstHaarCascade *gst_haar_cascade_load (const gchar * filename);
+void gst_haar_cascade_free (GstHaarCascade * cascade);
+
+GstHaarCascade *gst_haar_cascade_open (const gchar * filename, GError ** err);
+GstHaarCascade *gst_haar_cascade_ref (GstHaarCascade * cascade);
+void gst_haar_cascade_unref (GstHaarCascade * cascade);
+
+gboolean gst_haar_cascade_is_binary (const gchar * filename);
+GstHaarCascade *gst_haar_cascade_map (const gchar * filename, GError ** err);
+gboolean gst_haar_cascade_save (const GstHaarCascade * cascade,
+    const gchar * filename, GError ** err);
+guint32 gst_haar_cascade_checksum (const GstHaarCascade * cascade);
+
+void gst_haar_scale_init (GstHaarScale * scale,
+    const GstHaarCascade * cascade, gdouble factor, gint stride);
+void gst_haar_scale_clear (GstHaarScale * scale);
+
+void gst_haar_scale_variance (const GstHaarScale * scale,
+    const GstHaarIntegral * integral, const gint32 * offsets, gint n,
+    gfloat * norm);
+
+void gst_haar_cascade_eval (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gfloat * norm, gint n,
+    gint first_stage, gint last_stage, gint * result);
+
+void gst_haar_cascade_eval_first (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gfloat * norm, gint n, gint * result);
+
+void gst_haar_scale_variance_fixed (const GstHaarScale * scale,
+    const GstHaarIntegral * integral, const gint32 * offsets, gint n,
+    gint32 * norm);
+
+void gst_haar_cascade_eval_fixed (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gint32 * norm, gint n,
+    gint first_stage, gint last_stage, gint * result);
+
+void gst_haar_cascade_eval_first_fixed (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const gint32 * offsets, const gint32 * norm, gint n, gint * result);
+
+G_END_DECLS
+#endif /* __GST_HAAR_CASCADE_H__ */
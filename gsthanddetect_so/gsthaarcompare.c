@@ -0,0 +1,424 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarcompare.c: checks the native haar evaluators against OpenCV
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* usage: gst-haar-compare [cascade.xml [image ...]]
+ *
+ * Runs the native evaluators and cvRunHaarClassifierCascade () on every
+ * window of every scale the native detector scans, on the images given or
+ * on a few synthetic ones, and fails when they disagree on the stage a
+ * window is rejected at for more than the tolerance of the evaluator:
+ *
+ *  - float: gst_haar_cascade_eval () on all the stages,
+ *  - stage 0 rows: gst_haar_cascade_eval_first () on the row, then
+ *    gst_haar_cascade_eval () on the windows passing it, as the detector
+ *    scans,
+ *  - generated: the same with the evaluator gst-haar-convert --c built in
+ *    for the cascade, skipped when there is none,
+ *  - fixed point: the _fixed variants of the stage 0 rows. They round
+ *    the weights and the norm, so only whether a window is accepted is
+ *    compared: the stage rejecting a window differs for a few percent of
+ *    them, mostly nearly flat ones.
+ *
+ * The native float sums round like the legacy ones, windows right on a
+ * node threshold may still go the other way. Then
+ * gst_haar_detector_detect (), float and fixed point, is checked against
+ * cvHaarDetectObjects () after grouping with the settings of the element:
+ * a rectangle found by one and not the other is a difference. Few windows
+ * of the synthetic images pass the whole cascade, give it images of hands
+ * to compare groups. make check runs it on fist.xml.
+ */
+
+#include <stdio.h>
+#include <glib.h>
+#include <highgui.h>
+
+#include "gsthaarcascade.h"
+#include "gsthaarcompiled.h"
+#include "gsthaardetector.h"
+#include "gsthaarintegral.h"
+
+#ifndef GST_HAAR_COMPARE_CASCADE
+#define GST_HAAR_COMPARE_CASCADE "fist.xml"
+#endif
+
+/* the settings of the element */
+#define GST_HAAR_COMPARE_SCALE_FACTOR 1.1
+#define GST_HAAR_COMPARE_MIN_NEIGHBORS 2
+#define GST_HAAR_COMPARE_MIN_SIZE 24
+
+#define GST_HAAR_COMPARE_WIDTH 320
+#define GST_HAAR_COMPARE_HEIGHT 240
+
+typedef enum
+{
+  GST_HAAR_COMPARE_FLOAT,
+  GST_HAAR_COMPARE_ROWS,
+  GST_HAAR_COMPARE_GENERATED,
+  GST_HAAR_COMPARE_FIXED,
+  GST_HAAR_COMPARE_DETECT,
+  GST_HAAR_COMPARE_DETECT_FIXED,
+  GST_HAAR_COMPARE_N
+} GstHaarCompareVariant;
+
+/* windows (or grouped detections) compared and how many of them differ,
+ * in the stage rejecting them or only in being accepted */
+typedef struct
+{
+  const gchar *name;
+  gdouble tolerance;
+  gboolean accept_only;
+  gboolean skipped;
+  guint64 n_compared;
+  guint64 n_differ;
+} GstHaarCompareResult;
+
+static GstHaarCompareResult results[GST_HAAR_COMPARE_N] = {
+  {"float", 0.001, FALSE, FALSE, 0, 0},
+  {"stage 0 rows", 0.001, FALSE, FALSE, 0, 0},
+  {"generated", 0.001, FALSE, FALSE, 0, 0},
+  {"fixed point", 0.001, TRUE, FALSE, 0, 0},
+  {"detections", 0.05, FALSE, FALSE, 0, 0},
+  {"fixed point detections", 0.1, FALSE, FALSE, 0, 0}
+};
+
+/* scratch rows, as the detector keeps them */
+typedef struct
+{
+  gint32 *offsets;
+  gpointer norm;
+  gint *first;
+  gint32 *pass_ofs;
+  gpointer pass_norm;
+  gint *keep;
+  gint *pass_result;
+  gint *result;
+  gint *ref;
+} GstHaarCompareRow;
+
+/* smoothed noise with a few bright blobs on it, different for each @seed */
+static IplImage *
+gst_haar_compare_synthetic (guint64 seed)
+{
+  IplImage *gray = cvCreateImage (cvSize (GST_HAAR_COMPARE_WIDTH,
+          GST_HAAR_COMPARE_HEIGHT), IPL_DEPTH_8U, 1);
+  CvRNG rng = cvRNG (seed);
+  gint i;
+
+  cvRandArr (&rng, gray, CV_RAND_UNI, cvScalarAll (0), cvScalarAll (256));
+  cvSmooth (gray, gray, CV_GAUSSIAN, 5, 5, 0, 0);
+  for (i = 0; i < 6; i++) {
+    CvPoint center = cvPoint (cvRandInt (&rng) % GST_HAAR_COMPARE_WIDTH,
+        cvRandInt (&rng) % GST_HAAR_COMPARE_HEIGHT);
+    CvSize axes = cvSize (12 + cvRandInt (&rng) % 40,
+        12 + cvRandInt (&rng) % 40);
+
+    cvEllipse (gray, center, axes, cvRandInt (&rng) % 180, 0, 360,
+        cvScalarAll (128 + cvRandInt (&rng) % 128), CV_FILLED, 8, 0);
+  }
+  cvSmooth (gray, gray, CV_GAUSSIAN, 3, 3, 0, 0);
+  return gray;
+}
+
+static void
+gst_haar_compare_count (GstHaarCompareVariant variant, const gint * ref,
+    const gint * result, gint n)
+{
+  GstHaarCompareResult *r = &results[variant];
+  gint i;
+
+  for (i = 0; i < n; i++)
+    r->n_differ += r->accept_only ? (ref[i] > 0) != (result[i] > 0) :
+        ref[i] != result[i];
+  r->n_compared += n;
+}
+
+/* The stage 0 results of the n windows are in row->first: collects the
+ * ones passing it and gives their final results with the later stages,
+ * float or fixed point. */
+static void
+gst_haar_compare_later_stages (const GstHaarCascade * cascade,
+    const GstHaarScale * scale, const GstHaarIntegral * integral,
+    const GstHaarCompiled * compiled, gboolean fixed_point,
+    GstHaarCompareRow * row, gint n)
+{
+  gint i, n_pass = 0;
+
+  for (i = 0; i < n; i++) {
+    row->result[i] = row->first[i];
+    if (row->first[i] == 1) {
+      row->keep[n_pass] = i;
+      row->pass_ofs[n_pass] = row->offsets[i];
+      ((gint32 *) row->pass_norm)[n_pass++] = ((gint32 *) row->norm)[i];
+    }
+  }
+  if (n_pass == 0)
+    return;
+
+  if (fixed_point)
+    gst_haar_cascade_eval_fixed (cascade, scale, integral, row->pass_ofs,
+        row->pass_norm, n_pass, 1, cascade->n_stages, row->pass_result);
+  else if (compiled)
+    compiled->eval (scale, integral, row->pass_ofs, row->pass_norm, n_pass, 1,
+        cascade->n_stages, row->pass_result);
+  else
+    gst_haar_cascade_eval (cascade, scale, integral, row->pass_ofs,
+        row->pass_norm, n_pass, 1, cascade->n_stages, row->pass_result);
+
+  for (i = 0; i < n_pass; i++)
+    row->result[row->keep[i]] = row->pass_result[i];
+}
+
+/* evaluates all the windows of @gray every way */
+static void
+gst_haar_compare_windows (CvHaarClassifierCascade * cv,
+    const GstHaarCascade * cascade, const GstHaarCompiled * compiled,
+    IplImage * gray)
+{
+  CvMat *sum, *sqsum, *tilted;
+  GstHaarIntegral *integral;
+  GstHaarCompareRow row;
+  gdouble factor;
+
+  sum = cvCreateMat (gray->height + 1, gray->width + 1, CV_32SC1);
+  sqsum = cvCreateMat (gray->height + 1, gray->width + 1, CV_64FC1);
+  tilted = cvCreateMat (gray->height + 1, gray->width + 1, CV_32SC1);
+  cvIntegral (gray, sum, sqsum, tilted);
+
+  integral = gst_haar_integral_new (cascade->has_tilted);
+  gst_haar_integral_compute (integral, (const guint8 *) gray->imageData,
+      gray->width, gray->height, gray->widthStep);
+
+  /* the norms are gfloat or gint32 */
+  row.offsets = g_new (gint32, gray->width);
+  row.norm = g_malloc (gray->width * sizeof (gint32));
+  row.first = g_new (gint, gray->width);
+  row.pass_ofs = g_new (gint32, gray->width);
+  row.pass_norm = g_malloc (gray->width * sizeof (gint32));
+  row.keep = g_new (gint, gray->width);
+  row.pass_result = g_new (gint, gray->width);
+  row.result = g_new (gint, gray->width);
+  row.ref = g_new (gint, gray->width);
+
+  /* the scales gst_haar_detector_detect () scans */
+  for (factor = 1; factor * cascade->window_width < gray->width - 10 &&
+      factor * cascade->window_height < gray->height - 10;
+      factor *= GST_HAAR_COMPARE_SCALE_FACTOR) {
+    GstHaarScale scale;
+    gint rows, cols, ix, iy;
+
+    gst_haar_scale_init (&scale, cascade, factor, integral->stride);
+    cvSetImagesForHaarClassifierCascade (cv, sum, sqsum, tilted, factor);
+
+    rows = cvRound ((gray->height - scale.win_height) / scale.step);
+    cols = cvRound ((gray->width - scale.win_width) / scale.step);
+    for (iy = 0; iy < rows; iy++) {
+      gint y = cvRound (iy * scale.step);
+
+      for (ix = 0; ix < cols; ix++) {
+        CvPoint pt = cvPoint (cvRound (ix * scale.step), y);
+
+        row.offsets[ix] = y * integral->stride + pt.x;
+        row.ref[ix] = cvRunHaarClassifierCascade (cv, pt, 0);
+      }
+
+      gst_haar_scale_variance (&scale, integral, row.offsets, cols,
+          row.norm);
+      gst_haar_cascade_eval (cascade, &scale, integral, row.offsets,
+          row.norm, cols, 0, cascade->n_stages, row.result);
+      gst_haar_compare_count (GST_HAAR_COMPARE_FLOAT, row.ref, row.result,
+          cols);
+
+      gst_haar_cascade_eval_first (cascade, &scale, integral, row.offsets,
+          row.norm, cols, row.first);
+      gst_haar_compare_later_stages (cascade, &scale, integral, NULL, FALSE,
+          &row, cols);
+      gst_haar_compare_count (GST_HAAR_COMPARE_ROWS, row.ref, row.result,
+          cols);
+
+      if (compiled) {
+        gst_haar_compare_later_stages (cascade, &scale, integral, compiled,
+            FALSE, &row, cols);
+        gst_haar_compare_count (GST_HAAR_COMPARE_GENERATED, row.ref,
+            row.result, cols);
+      }
+
+      gst_haar_scale_variance_fixed (&scale, integral, row.offsets, cols,
+          row.norm);
+      gst_haar_cascade_eval_first_fixed (cascade, &scale, integral,
+          row.offsets, row.norm, cols, row.first);
+      gst_haar_compare_later_stages (cascade, &scale, integral, NULL, TRUE,
+          &row, cols);
+      gst_haar_compare_count (GST_HAAR_COMPARE_FIXED, row.ref, row.result,
+          cols);
+    }
+    gst_haar_scale_clear (&scale);
+  }
+
+  g_free (row.ref);
+  g_free (row.result);
+  g_free (row.pass_result);
+  g_free (row.keep);
+  g_free (row.pass_norm);
+  g_free (row.pass_ofs);
+  g_free (row.first);
+  g_free (row.norm);
+  g_free (row.offsets);
+  gst_haar_integral_free (integral);
+  cvReleaseMat (&tilted);
+  cvReleaseMat (&sqsum);
+  cvReleaseMat (&sum);
+}
+
+/* matches the grouped @objects of the detector with the ones of
+ * cvHaarDetectObjects () in @seq, rectangle and neighbors */
+static void
+gst_haar_compare_objects (GstHaarCompareVariant variant, GArray * objects,
+    CvSeq * seq)
+{
+  gboolean *matched = g_new0 (gboolean, objects->len);
+  guint n_matched = 0;
+  gint i;
+  guint j;
+
+  for (i = 0; i < seq->total; i++) {
+    CvAvgComp *comp = (CvAvgComp *) cvGetSeqElem (seq, i);
+
+    for (j = 0; j < objects->len; j++) {
+      GstHaarObject *o = &g_array_index (objects, GstHaarObject, j);
+
+      if (!matched[j] && o->rect.x == comp->rect.x &&
+          o->rect.y == comp->rect.y && o->rect.width == comp->rect.width &&
+          o->rect.height == comp->rect.height &&
+          o->neighbors == comp->neighbors) {
+        matched[j] = TRUE;
+        n_matched++;
+        break;
+      }
+    }
+  }
+
+  results[variant].n_compared += seq->total + objects->len - n_matched;
+  results[variant].n_differ += seq->total + objects->len - 2 * n_matched;
+  g_free (matched);
+}
+
+static void
+gst_haar_compare_detect (CvHaarClassifierCascade * cv,
+    const GstHaarCascade * cascade, IplImage * gray)
+{
+  GstHaarDetector *detector;
+  CvMemStorage *storage = cvCreateMemStorage (0);
+  GArray *objects = g_array_new (FALSE, FALSE, sizeof (GstHaarObject));
+  CvSeq *seq;
+
+  seq = cvHaarDetectObjects (gray, cv, storage, GST_HAAR_COMPARE_SCALE_FACTOR,
+      GST_HAAR_COMPARE_MIN_NEIGHBORS, 0, cvSize (GST_HAAR_COMPARE_MIN_SIZE,
+          GST_HAAR_COMPARE_MIN_SIZE), cvSize (0, 0));
+
+  detector = gst_haar_detector_new (cascade, GST_HAAR_COMPARE_SCALE_FACTOR,
+      GST_HAAR_COMPARE_MIN_NEIGHBORS, GST_HAAR_COMPARE_MIN_SIZE,
+      GST_HAAR_COMPARE_MIN_SIZE);
+  gst_haar_detector_detect (detector, (const guint8 *) gray->imageData,
+      gray->width, gray->height, gray->widthStep, objects);
+  gst_haar_compare_objects (GST_HAAR_COMPARE_DETECT, objects, seq);
+
+  detector->fixed_point = TRUE;
+  gst_haar_detector_detect (detector, (const guint8 *) gray->imageData,
+      gray->width, gray->height, gray->widthStep, objects);
+  gst_haar_compare_objects (GST_HAAR_COMPARE_DETECT_FIXED, objects, seq);
+
+  gst_haar_detector_free (detector);
+  g_array_free (objects, TRUE);
+  cvReleaseMemStorage (&storage);
+}
+
+static void
+gst_haar_compare_image (CvHaarClassifierCascade * cv,
+    const GstHaarCascade * cascade, const GstHaarCompiled * compiled,
+    IplImage * gray)
+{
+  gst_haar_compare_windows (cv, cascade, compiled, gray);
+  gst_haar_compare_detect (cv, cascade, gray);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const gchar *filename = argc > 1 ? argv[1] : GST_HAAR_COMPARE_CASCADE;
+  CvHaarClassifierCascade *cv;
+  GstHaarCascade *cascade;
+  const GstHaarCompiled *compiled;
+  gboolean failed = FALSE;
+  gint i;
+
+  cv = (CvHaarClassifierCascade *) cvLoad (filename, 0, 0, 0);
+  if (!cv) {
+    g_printerr ("Could not load HAAR classifier cascade: %s\n", filename);
+    return 1;
+  }
+  cascade = gst_haar_cascade_new_from_cv (cv);
+  compiled = gst_haar_compiled_find (cascade);
+  results[GST_HAAR_COMPARE_GENERATED].skipped = compiled == NULL;
+
+  if (argc > 2) {
+    for (i = 2; i < argc; i++) {
+      IplImage *gray = cvLoadImage (argv[i], CV_LOAD_IMAGE_GRAYSCALE);
+
+      if (!gray) {
+        g_printerr ("Could not load image: %s\n", argv[i]);
+        return 1;
+      }
+      gst_haar_compare_image (cv, cascade, compiled, gray);
+      cvReleaseImage (&gray);
+    }
+  } else {
+    for (i = 0; i < 4; i++) {
+      IplImage *gray = gst_haar_compare_synthetic (i + 1);
+
+      gst_haar_compare_image (cv, cascade, compiled, gray);
+      cvReleaseImage (&gray);
+    }
+  }
+
+  for (i = 0; i < GST_HAAR_COMPARE_N; i++) {
+    const GstHaarCompareResult *r = &results[i];
+
+    if (r->skipped) {
+      g_print ("%s: %s: skipped, not built in\n", filename, r->name);
+      continue;
+    }
+    g_print ("%s: %s: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+        " differ\n", filename, r->name, r->n_differ, r->n_compared);
+    /* no windows means nothing was compared, no detections on both sides
+     * is an agreement */
+    if ((i < GST_HAAR_COMPARE_DETECT && r->n_compared == 0) ||
+        r->n_differ > r->n_compared * r->tolerance) {
+      g_printerr ("%s: native and legacy engines differ beyond tolerance\n",
+          r->name);
+      failed = TRUE;
+    }
+  }
+
+  gst_haar_cascade_free (cascade);
+  cvReleaseHaarClassifierCascade (&cv);
+
+  return failed ? 1 : 0;
+}
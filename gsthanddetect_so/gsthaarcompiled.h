@@ -0,0 +1,60 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarcompiled.h: evaluators generated for a given cascade
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAAR_COMPILED_H__
+#define __GST_HAAR_COMPILED_H__
+
+#include <glib.h>
+
+#include "gsthaarcascade.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstHaarCompiled GstHaarCompiled;
+
+/* gst_haar_cascade_eval() with the cascade built in */
+typedef void (*GstHaarCompiledEval) (const GstHaarScale * scale,
+    const GstHaarIntegral * integral, const gint32 * offsets,
+    const gfloat * norm, gint n, gint first_stage, gint last_stage,
+    gint * result);
+
+/* An evaluator gst-haar-convert --c generated from one cascade: every
+ * stage unrolled, thresholds and leaf values as constants, the node kinds
+ * and rectangle counts resolved. It takes the float tables of a
+ * GstHaarScale of that cascade and gives the same results as
+ * gst_haar_cascade_eval() on it. The offsets and weights still come from
+ * the scale as they depend on the scale factor and the frame stride.
+ */
+struct _GstHaarCompiled
+{
+  const gchar *name;
+  guint32 checksum;             /* gst_haar_cascade_checksum() */
+  GstHaarCompiledEval eval;
+};
+
+/* the evaluators linked in, terminated by one with a NULL name */
+extern const GstHaarCompiled gst_haar_compiled_cascades[];
+
+const GstHaarCompiled *gst_haar_compiled_find (const GstHaarCascade *
+    cascade);
+
+G_END_DECLS
+#endif /* __GST_HAAR_COMPILED_H__ */
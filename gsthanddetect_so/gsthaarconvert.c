@@ -0,0 +1,305 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarconvert.c: converts OpenCV haar cascades into binary cascades
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* usage: gst-haar-convert fist.xml fist.haar
+ *        gst-haar-convert --c gsthaarcompiled.c fist.xml ...
+ *
+ * The output can be set as handdetect profile/profile_palm, it is mapped
+ * instead of parsed and only drives the native engine. The file is in host
+ * byte order, convert on the machine (or architecture) that uses it.
+ *
+ * With --c, the cascades are turned into C evaluators instead, one per
+ * cascade (see gsthaarcompiled.h), to be built into the plugin. No cascade
+ * gives an empty table.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "gsthaarcascade.h"
+
+/* a float that reads back the same */
+static void
+gst_haar_print_float (FILE * out, gfloat v)
+{
+  fprintf (out, "%#.9gf", v);
+}
+
+static void
+gst_haar_print_indent (FILE * out, gint depth)
+{
+  fprintf (out, "%*s", depth * 2, "");
+}
+
+/* the nodes of a tree as nested conditions, from node @idx */
+static void
+gst_haar_print_tree (FILE * out, const GstHaarCascade * cascade, gint cl,
+    gint idx, gint depth)
+{
+  gint n = cascade->classifier_node[cl] + idx;
+  gint child[2], i;
+
+  gst_haar_print_indent (out, depth);
+  fprintf (out, "if (haar_node_sum (%s + offset, o + %d, w + %d, %d) < ",
+      cascade->node_tilted[n] ? "integral->tilted" : "integral->sum",
+      n * GST_HAAR_MAX_RECTS * 4, n * GST_HAAR_MAX_RECTS,
+      cascade->node_n_rects[n]);
+  gst_haar_print_float (out, cascade->node_threshold[n]);
+  fprintf (out, " * norm) {\n");
+
+  child[0] = cascade->node_left[n];
+  child[1] = cascade->node_right[n];
+  for (i = 0; i < 2; i++) {
+    if (child[i] > 0) {
+      gst_haar_print_tree (out, cascade, cl, child[i], depth + 1);
+    } else {
+      gst_haar_print_indent (out, depth + 1);
+      fprintf (out, "return ");
+      gst_haar_print_float (out,
+          cascade->alpha[cascade->classifier_alpha[cl] - child[i]]);
+      fprintf (out, ";\n");
+    }
+    gst_haar_print_indent (out, depth);
+    fprintf (out, i == 0 ? "} else {\n" : "}\n");
+  }
+}
+
+static void
+gst_haar_print_cascade (FILE * out, const GstHaarCascade * cascade,
+    const gchar * name, const gchar * filename)
+{
+  gint st, cl;
+
+  fprintf (out, "\n/* %s: %d stages, %d classifiers, %d nodes */\n",
+      filename, cascade->n_stages, cascade->n_classifiers, cascade->n_nodes);
+
+  for (cl = 0; cl < cascade->n_classifiers; cl++) {
+    if (cascade->classifier_count[cl] == 1)
+      continue;
+    fprintf (out, "\nstatic gfloat\n%s_tree_%d (const GstHaarScale * scale,\n"
+        "    const GstHaarIntegral * integral, gint32 offset, gfloat norm)\n"
+        "{\n"
+        "  const gint32 *o = scale->ofs;\n"
+        "  const gfloat *w = scale->weight;\n\n", name, cl);
+    gst_haar_print_tree (out, cascade, cl, 0, 1);
+    fprintf (out, "}\n");
+  }
+
+  for (st = 0; st < cascade->n_stages; st++) {
+    gint end = cascade->stage_first[st] + cascade->stage_count[st];
+    gboolean stumps = FALSE, trees = FALSE;
+
+    for (cl = cascade->stage_first[st]; cl < end; cl++) {
+      stumps |= cascade->classifier_count[cl] == 1;
+      trees |= cascade->classifier_count[cl] > 1;
+    }
+
+    fprintf (out, "\nstatic inline gint\n%s_stage_%d (const GstHaarScale * scale,\n"
+        "    const GstHaarIntegral * integral, HaarIdx idx, HaarVec vnorm,\n"
+        "    const gint32 * lane_ofs, const gfloat * lane_norm)\n"
+        "{\n", name, st);
+    if (stumps)
+      fprintf (out, "  const gint32 *o = scale->ofs;\n"
+          "  const gfloat *w = scale->weight;\n");
+    fprintf (out, "  HaarVec acc = haar_vec_zero ();\n");
+    if (trees)
+      fprintf (out, "  gfloat val[HAAR_LANES];\n  gint l;\n");
+    fprintf (out, "\n");
+
+    for (cl = cascade->stage_first[st]; cl < end; cl++) {
+      gint n = cascade->classifier_node[cl];
+      gint a = cascade->classifier_alpha[cl];
+
+      if (cascade->classifier_count[cl] == 1) {
+        fprintf (out, "  acc = haar_stump (acc, %s, idx, vnorm, o + %d, "
+            "w + %d, %d,\n      ",
+            cascade->node_tilted[n] ? "integral->tilted" : "integral->sum",
+            n * GST_HAAR_MAX_RECTS * 4, n * GST_HAAR_MAX_RECTS,
+            cascade->node_n_rects[n]);
+        gst_haar_print_float (out, cascade->node_threshold[n]);
+        fprintf (out, ", ");
+        gst_haar_print_float (out, cascade->alpha[a]);
+        fprintf (out, ", ");
+        gst_haar_print_float (out, cascade->alpha[a + 1]);
+        fprintf (out, ");\n");
+      } else {
+        fprintf (out, "  for (l = 0; l < HAAR_LANES; l++)\n"
+            "    val[l] = %s_tree_%d (scale, integral, lane_ofs[l], "
+            "lane_norm[l]);\n"
+            "  acc = haar_vec_add (acc, haar_vec_load (val));\n", name, cl);
+      }
+    }
+
+    fprintf (out, "\n  return haar_vec_mask_ge (acc, haar_vec_set1 (");
+    gst_haar_print_float (out, cascade->stage_threshold[st]);
+    fprintf (out, ")) &\n      HAAR_LANE_MASK;\n}\n");
+  }
+
+  fprintf (out, "\nstatic void\n%s_eval (const GstHaarScale * scale,\n"
+      "    const GstHaarIntegral * integral, const gint32 * offsets,\n"
+      "    const gfloat * norm, gint n, gint first_stage, gint last_stage,\n"
+      "    gint * result)\n"
+      "{\n"
+      "  gint32 lane_ofs[HAAR_LANES];\n"
+      "  gfloat lane_norm[HAAR_LANES];\n"
+      "  gint b, l;\n\n"
+      "  for (b = 0; b < n; b += HAAR_LANES) {\n"
+      "    gint m = MIN (HAAR_LANES, n - b);\n"
+      "    gint alive = (1 << m) - 1;\n"
+      "    HaarIdx idx;\n"
+      "    HaarVec vnorm;\n"
+      "    gint st, pass;\n\n"
+      "    for (l = 0; l < HAAR_LANES; l++) {\n"
+      "      lane_ofs[l] = offsets[b + (l < m ? l : 0)];\n"
+      "      lane_norm[l] = norm[b + (l < m ? l : 0)];\n"
+      "    }\n"
+      "    idx = haar_idx_load (lane_ofs);\n"
+      "    vnorm = haar_vec_load (lane_norm);\n\n"
+      "    for (st = first_stage; st < last_stage && alive; st++) {\n"
+      "      switch (st) {\n", name);
+  for (st = 0; st < cascade->n_stages; st++)
+    fprintf (out, "        case %d:\n"
+        "          pass = %s_stage_%d (scale, integral, idx, vnorm, lane_ofs,\n"
+        "              lane_norm);\n"
+        "          break;\n", st, name, st);
+  fprintf (out, "        default:\n"
+      "          pass = 0;\n"
+      "          break;\n"
+      "      }\n"
+      "      for (l = 0; l < m; l++)\n"
+      "        if ((alive & ~pass) & (1 << l))\n"
+      "          result[b + l] = -st;\n"
+      "      alive &= pass;\n"
+      "    }\n\n"
+      "    for (l = 0; l < m; l++)\n"
+      "      if (alive & (1 << l))\n"
+      "        result[b + l] = 1;\n"
+      "  }\n"
+      "}\n");
+}
+
+/* a C identifier out of the file name of a cascade */
+static gchar *
+gst_haar_cascade_name (const gchar * filename)
+{
+  gchar *name = g_path_get_basename (filename);
+  gchar *p;
+
+  if ((p = strrchr (name, '.')))
+    *p = '\0';
+  for (p = name; *p; p++)
+    if (!g_ascii_isalnum (*p))
+      *p = '_';
+  if (!g_ascii_isalpha (name[0])) {
+    p = g_strconcat ("c_", name, NULL);
+    g_free (name);
+    name = p;
+  }
+  return name;
+}
+
+static int
+gst_haar_convert_c (const gchar * output, gint n_files, gchar ** files)
+{
+  GstHaarCascade **cascades = g_new0 (GstHaarCascade *, MAX (n_files, 1));
+  gchar **names = g_new0 (gchar *, n_files + 1);
+  FILE *out;
+  gint i, ret = 1;
+
+  for (i = 0; i < n_files; i++) {
+    cascades[i] = gst_haar_cascade_load (files[i]);
+    if (!cascades[i]) {
+      g_printerr ("Could not load HAAR classifier cascade: %s\n", files[i]);
+      goto done;
+    }
+    names[i] = gst_haar_cascade_name (files[i]);
+  }
+
+  out = fopen (output, "w");
+  if (!out) {
+    g_printerr ("Could not write %s\n", output);
+    goto done;
+  }
+
+  fprintf (out, "/* generated by gst-haar-convert, do not edit */\n\n"
+      "#include \"gsthaarcompiled.h\"\n"
+      "#include \"gsthaarsimd.h\"\n");
+  for (i = 0; i < n_files; i++)
+    gst_haar_print_cascade (out, cascades[i], names[i], files[i]);
+
+  fprintf (out, "\nconst GstHaarCompiled gst_haar_compiled_cascades[] = {\n");
+  for (i = 0; i < n_files; i++)
+    fprintf (out, "  {\"%s\", 0x%08xu, %s_eval},\n", names[i],
+        gst_haar_cascade_checksum (cascades[i]), names[i]);
+  fprintf (out, "  {NULL, 0, NULL}\n};\n");
+
+  if (fclose (out) != 0) {
+    g_printerr ("Could not write %s\n", output);
+    goto done;
+  }
+  for (i = 0; i < n_files; i++)
+    g_print ("%s: %s_eval, %d stages\n", output, names[i],
+        cascades[i]->n_stages);
+  ret = 0;
+
+done:
+  for (i = 0; i < n_files; i++)
+    if (cascades[i])
+      gst_haar_cascade_free (cascades[i]);
+  g_free (cascades);
+  g_strfreev (names);
+  return ret;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GstHaarCascade *cascade;
+  GError *err = NULL;
+
+  if (argc >= 3 && strcmp (argv[1], "--c") == 0)
+    return gst_haar_convert_c (argv[2], argc - 3, argv + 3);
+
+  if (argc != 3) {
+    g_printerr ("usage: %s <cascade.xml> <output>\n"
+        "       %s --c <output.c> [<cascade.xml> ...]\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  cascade = gst_haar_cascade_load (argv[1]);
+  if (!cascade) {
+    g_printerr ("Could not load HAAR classifier cascade: %s\n", argv[1]);
+    return 1;
+  }
+
+  if (!gst_haar_cascade_save (cascade, argv[2], &err)) {
+    g_printerr ("Could not write %s: %s\n", argv[2], err->message);
+    g_clear_error (&err);
+    gst_haar_cascade_free (cascade);
+    return 1;
+  }
+
+  g_print ("%s: %d stages, %d classifiers, %d nodes\n", argv[2],
+      cascade->n_stages, cascade->n_classifiers, cascade->n_nodes);
+  gst_haar_cascade_free (cascade);
+  return 0;
+}
@@ -0,0 +1,1066 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaardetector.c: multi-scale object detection with the native cascade
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gsthaardetector.h"
+
+/* cvHaarDetectObjects() groups with this epsilon */
+#define GST_HAAR_GROUP_EPS 0.2
+
+/* each thread gets about this many jobs per frame to even out the load */
+#define GST_HAAR_JOBS_PER_THREAD 4
+
+/* stage 0 result of a window rejected from the history after passing it */
+#define GST_HAAR_CACHED 2
+
+/* the history watches the image in cells of GST_HAAR_CELL pixels square */
+#define GST_HAAR_CELL_SHIFT 3
+#define GST_HAAR_CELL (1 << GST_HAAR_CELL_SHIFT)
+
+/* Looks up the evaluator generated for @cascade, if one was built in: the
+ * cascades are matched by content so a profile loaded from any path (or
+ * converted to the mapped format) still finds it. */
+const GstHaarCompiled *
+gst_haar_compiled_find (const GstHaarCascade * cascade)
+{
+  const GstHaarCompiled *c;
+  guint32 checksum;
+
+  if (!gst_haar_compiled_cascades[0].name)
+    return NULL;
+
+  checksum = gst_haar_cascade_checksum (cascade);
+  for (c = gst_haar_compiled_cascades; c->name; c++)
+    if (c->checksum == checksum)
+      return c;
+  return NULL;
+}
+
+GstHaarDetector *
+gst_haar_detector_new (const GstHaarCascade * cascade, gdouble scale_factor,
+    gint min_neighbors, gint min_width, gint min_height)
+{
+  GstHaarDetector *detector;
+
+  g_return_val_if_fail (cascade != NULL, NULL);
+  g_return_val_if_fail (scale_factor > 1., NULL);
+
+  detector = g_new0 (GstHaarDetector, 1);
+  detector->cascades[0] = cascade;
+  detector->compiled[0] = gst_haar_compiled_find (cascade);
+  detector->n_cascades = 1;
+  detector->integral = gst_haar_integral_new (cascade->has_tilted);
+  detector->scale_factor = scale_factor;
+  detector->min_neighbors = min_neighbors;
+  detector->min_width = min_width;
+  detector->min_height = min_height;
+  detector->n_threads = 1;
+  detector->history_depth = 6;
+  detector->history_tolerance = 2;
+  detector->group = g_array_new (FALSE, FALSE, sizeof (CvRect));
+  detector->group_neighbors = g_array_new (FALSE, FALSE, sizeof (gint));
+  detector->lock = g_mutex_new ();
+  detector->cond = g_cond_new ();
+
+  return detector;
+}
+
+static void
+gst_haar_detector_clear_levels (GstHaarDetector * detector)
+{
+  gint i, c;
+
+  for (i = 0; i < detector->n_levels; i++) {
+    GstHaarLevel *level = &detector->levels[i];
+
+    for (c = 0; c < detector->n_cascades; c++) {
+      gst_haar_scale_clear (&level->scales[c]);
+      if (level->history)
+        g_free (level->history[c].depth);
+    }
+    g_free (level->scales);
+    g_free (level->history);
+  }
+  g_free (detector->levels);
+  detector->levels = NULL;
+  detector->n_levels = 0;
+}
+
+void
+gst_haar_detector_free (GstHaarDetector * detector)
+{
+  gint i;
+
+  if (!detector)
+    return;
+
+  if (detector->pool)
+    g_thread_pool_free (detector->pool, TRUE, TRUE);
+  gst_haar_detector_clear_levels (detector);
+  for (i = 0; i < detector->jobs_allocated; i++) {
+    GstHaarJob *job = &detector->jobs[i];
+
+    g_array_free (job->candidates, TRUE);
+    g_free (job->offsets);
+    g_free (job->norm);
+    g_free (job->result);
+    g_free (job->pass_ofs);
+    g_free (job->pass_norm);
+    g_free (job->keep);
+    g_free (job->fill);
+  }
+  g_free (detector->jobs);
+  g_array_free (detector->group, TRUE);
+  g_array_free (detector->group_neighbors, TRUE);
+  g_free (detector->mask_sum);
+  g_free (detector->cell_mean);
+  g_free (detector->cell_sum);
+  gst_haar_integral_free (detector->integral);
+  g_mutex_free (detector->lock);
+  g_cond_free (detector->cond);
+  g_free (detector);
+}
+
+/* Adds a cascade to evaluate in the same scan as the others, returns the
+ * label of its detections or -1 when no more cascades fit. */
+gint
+gst_haar_detector_add_cascade (GstHaarDetector * detector,
+    const GstHaarCascade * cascade)
+{
+  g_return_val_if_fail (detector != NULL, -1);
+  g_return_val_if_fail (cascade != NULL, -1);
+
+  if (detector->n_cascades == GST_HAAR_MAX_CASCADES)
+    return -1;
+
+  gst_haar_detector_clear_levels (detector);
+  if (cascade->has_tilted && !detector->integral->with_tilted) {
+    gst_haar_integral_free (detector->integral);
+    detector->integral = gst_haar_integral_new (TRUE);
+  }
+  detector->cascades[detector->n_cascades] = cascade;
+  detector->compiled[detector->n_cascades] = gst_haar_compiled_find (cascade);
+  return detector->n_cascades++;
+}
+
+static gboolean
+gst_haar_detector_fits (const GstHaarCascade * cascade, gdouble factor,
+    gint width, gint height)
+{
+  return factor * cascade->window_width < width - 10 &&
+      factor * cascade->window_height < height - 10;
+}
+
+/* (re)build the per-scale tables when the frame size changed. The integral
+ * stride is pinned to the frame width so the tables also serve the cropped
+ * regions scanned by gst_haar_detector_detect_region(). */
+static void
+gst_haar_detector_ensure_levels (GstHaarDetector * detector, gint width,
+    gint height)
+{
+  gdouble factor;
+  gint n, c;
+
+  if (detector->levels && detector->frame_width == width &&
+      detector->frame_height == height)
+    return;
+
+  gst_haar_detector_clear_levels (detector);
+  gst_haar_integral_reserve (detector->integral, width, height);
+
+  /* the pyramid runs until the last cascade stops fitting the frame */
+  n = 0;
+  for (factor = 1;; factor *= detector->scale_factor, n++) {
+    for (c = 0; c < detector->n_cascades; c++)
+      if (gst_haar_detector_fits (detector->cascades[c], factor, width,
+              height))
+        break;
+    if (c == detector->n_cascades)
+      break;
+  }
+
+  detector->levels = g_new0 (GstHaarLevel, MAX (n, 1));
+  detector->n_levels = n;
+  for (n = 0, factor = 1; n < detector->n_levels;
+      n++, factor *= detector->scale_factor) {
+    GstHaarLevel *level = &detector->levels[n];
+
+    level->factor = factor;
+    level->step = MAX (2., factor);
+    level->scales = g_new0 (GstHaarScale, detector->n_cascades);
+
+    for (c = 0; c < detector->n_cascades; c++) {
+      const GstHaarCascade *cascade = detector->cascades[c];
+
+      if (!gst_haar_detector_fits (cascade, factor, width, height) ||
+          cvRound (cascade->window_width * factor) < detector->min_width ||
+          cvRound (cascade->window_height * factor) < detector->min_height)
+        continue;
+      gst_haar_scale_init (&level->scales[c], cascade, factor,
+          detector->integral->stride);
+    }
+  }
+
+  detector->frame_width = width;
+  detector->frame_height = height;
+}
+
+static gboolean
+gst_haar_detector_use_scale (const GstHaarScale * scale, CvSize min_size,
+    CvSize max_size)
+{
+  if (!scale->ofs)
+    return FALSE;
+  if (scale->win_width < min_size.width || scale->win_height < min_size.height)
+    return FALSE;
+  if ((max_size.width > 0 && scale->win_width > max_size.width) ||
+      (max_size.height > 0 && scale->win_height > max_size.height))
+    return FALSE;
+  return TRUE;
+}
+
+/* Window rows and columns of every cascade on the current image, 0 for the
+ * cascades not used. Returns the largest of each. */
+static void
+gst_haar_detector_grid (const GstHaarDetector * detector,
+    const GstHaarLevel * level, CvSize min_size, CvSize max_size,
+    gint * rows, gint * cols, gint * max_rows, gint * max_cols)
+{
+  const GstHaarIntegral *integral = detector->integral;
+  gint c;
+
+  *max_rows = *max_cols = 0;
+  for (c = 0; c < detector->n_cascades; c++) {
+    const GstHaarScale *scale = &level->scales[c];
+
+    rows[c] = cols[c] = 0;
+    if (!gst_haar_detector_use_scale (scale, min_size, max_size))
+      continue;
+    rows[c] = cvRound ((integral->height - scale->win_height) / scale->step);
+    cols[c] = cvRound ((integral->width - scale->win_width) / scale->step);
+    if (rows[c] <= 0 || cols[c] <= 0) {
+      rows[c] = cols[c] = 0;
+      continue;
+    }
+    *max_rows = MAX (*max_rows, rows[c]);
+    *max_cols = MAX (*max_cols, cols[c]);
+  }
+}
+
+/* Splits the levels in use over the current image into jobs of roughly
+ * equal window count: the small, expensive levels are cut into row bands,
+ * the large ones stay whole. Jobs are ordered by level, then by row, so
+ * concatenating their candidates gives the same list as a serial scan
+ * whatever the thread count.
+ */
+static void
+gst_haar_detector_plan (GstHaarDetector * detector, CvSize min_size,
+    CvSize max_size)
+{
+  gint rows[GST_HAAR_MAX_CASCADES], cols[GST_HAAR_MAX_CASCADES];
+  gint max_rows, max_cols;
+  gint64 total = 0, target;
+  gint i, n;
+
+  for (i = 0; i < detector->n_levels; i++) {
+    gst_haar_detector_grid (detector, &detector->levels[i], min_size,
+        max_size, rows, cols, &max_rows, &max_cols);
+    total += (gint64) max_rows * max_cols;
+  }
+  target = total / (detector->n_threads * GST_HAAR_JOBS_PER_THREAD);
+  target = MAX (target, 1);
+
+  /* two passes, counting then filling */
+  for (n = 0; n < 2; n++) {
+    gint count = 0;
+
+    for (i = 0; i < detector->n_levels; i++) {
+      gint band, y;
+
+      gst_haar_detector_grid (detector, &detector->levels[i], min_size,
+          max_size, rows, cols, &max_rows, &max_cols);
+      if (max_rows == 0)
+        continue;
+      band = detector->n_threads > 1 ?
+          CLAMP (target / max_cols, 1, max_rows) : max_rows;
+
+      for (y = 0; y < max_rows; y += band, count++) {
+        if (n == 0)
+          continue;
+        detector->jobs[count].level = i;
+        detector->jobs[count].y_start = y;
+        detector->jobs[count].y_end = MIN (y + band, max_rows);
+      }
+    }
+
+    if (n == 0 && count > detector->jobs_allocated) {
+      detector->jobs = g_renew (GstHaarJob, detector->jobs, count);
+      memset (detector->jobs + detector->jobs_allocated, 0,
+          (count - detector->jobs_allocated) * sizeof (GstHaarJob));
+      for (i = detector->jobs_allocated; i < count; i++)
+        detector->jobs[i].candidates =
+            g_array_new (FALSE, FALSE, sizeof (GstHaarObject));
+      detector->jobs_allocated = count;
+    }
+    detector->n_jobs = count;
+  }
+}
+
+/* Compares the mean of each cell of the image to the one it had when the
+ * windows over it were last evaluated, which they all are on this frame
+ * if it moved by more than history_tolerance, and builds the integral of
+ * the cells that did. All of them did after a reset. */
+static void
+gst_haar_detector_update_cells (GstHaarDetector * detector, gboolean reset)
+{
+  const GstHaarIntegral *integral = detector->integral;
+  const gint32 *p = integral->sum;
+  gint stride = integral->stride;
+  gint cols = (integral->width + GST_HAAR_CELL - 1) >> GST_HAAR_CELL_SHIFT;
+  gint rows = (integral->height + GST_HAAR_CELL - 1) >> GST_HAAR_CELL_SHIFT;
+  gint32 *sum;
+  gint r, c;
+
+  if (cols != detector->cell_cols || rows != detector->cell_rows) {
+    g_free (detector->cell_mean);
+    g_free (detector->cell_sum);
+    detector->cell_mean = g_new (guint8, cols * rows);
+    detector->cell_sum = g_new (gint32, (cols + 1) * (rows + 1));
+    detector->cell_cols = cols;
+    detector->cell_rows = rows;
+    reset = TRUE;
+  }
+
+  sum = detector->cell_sum;
+  memset (sum, 0, (cols + 1) * sizeof (gint32));
+  for (r = 0; r < rows; r++) {
+    gint y0 = r << GST_HAAR_CELL_SHIFT;
+    gint y1 = MIN (y0 + GST_HAAR_CELL, integral->height);
+    guint8 *mean = detector->cell_mean + r * cols;
+    gint32 *row = sum + (r + 1) * (cols + 1);
+    gint32 s = 0;
+
+    row[0] = 0;
+    for (c = 0; c < cols; c++) {
+      gint x0 = c << GST_HAAR_CELL_SHIFT;
+      gint x1 = MIN (x0 + GST_HAAR_CELL, integral->width);
+      gint m = (p[y0 * stride + x0] - p[y0 * stride + x1] -
+          p[y1 * stride + x0] + p[y1 * stride + x1]) / ((x1 - x0) * (y1 - y0));
+      gboolean changed = reset ||
+          ABS (m - mean[c]) > detector->history_tolerance;
+
+      mean[c] = changed ? m : mean[c];
+      s += changed;
+      row[c + 1] = row[c + 1 - (cols + 1)] + s;
+    }
+  }
+}
+
+/* Sizes the histories of the levels in use to the window grid of the
+ * current image; they start over when it or the area scanned moved. Then
+ * updates the cells. */
+static void
+gst_haar_detector_ensure_history (GstHaarDetector * detector,
+    CvSize min_size, CvSize max_size)
+{
+  const CvRect *a = &detector->area, *h = &detector->history_area;
+  gboolean reset = a->x != h->x || a->y != h->y || a->width != h->width ||
+      a->height != h->height;
+  gint rows[GST_HAAR_MAX_CASCADES], cols[GST_HAAR_MAX_CASCADES];
+  gint max_rows, max_cols, i, c;
+
+  for (i = 0; i < detector->n_levels; i++) {
+    GstHaarLevel *level = &detector->levels[i];
+
+    gst_haar_detector_grid (detector, level, min_size, max_size, rows, cols,
+        &max_rows, &max_cols);
+    if (max_rows == 0)
+      continue;
+    if (!level->history)
+      level->history = g_new0 (GstHaarHistory, detector->n_cascades);
+
+    for (c = 0; c < detector->n_cascades; c++) {
+      GstHaarHistory *history = &level->history[c];
+
+      if (rows[c] == 0)
+        continue;
+      if (history->rows != rows[c] || history->cols != cols[c]) {
+        g_free (history->depth);
+        history->depth = g_new (guint8, rows[c] * cols[c]);
+        history->rows = rows[c];
+        history->cols = cols[c];
+      } else if (!reset) {
+        continue;
+      }
+      memset (history->depth, GST_HAAR_DEPTH_UNKNOWN, rows[c] * cols[c]);
+    }
+  }
+  gst_haar_detector_update_cells (detector, reset);
+  detector->history_area = *a;
+  detector->history_frame++;
+}
+
+/* how many of the cells under the w x h rectangle at x, y are set, from
+ * the integral @sum of cols x rows cells of 1 << shift pixels */
+static inline gint
+gst_haar_cell_count (const gint32 * sum, gint cols, gint rows, gint shift,
+    gint x, gint y, gint w, gint h)
+{
+  gint step = cols + 1;
+  gint c0 = MIN (x >> shift, cols);
+  gint r0 = MIN (y >> shift, rows);
+  gint c1 = MIN (((x + w - 1) >> shift) + 1, cols);
+  gint r1 = MIN (((y + h - 1) >> shift) + 1, rows);
+
+  return sum[r1 * step + c1] - sum[r0 * step + c1] - sum[r1 * step + c0] +
+      sum[r0 * step + c0];
+}
+
+/* Restricts the following detections to the windows overlapping a
+ * non-zero cell of @mask, cols x rows cells of 1 << shift pixels square
+ * covering the frame; NULL scans everywhere again. */
+void
+gst_haar_detector_set_mask (GstHaarDetector * detector, const guint8 * mask,
+    gint cols, gint rows, gint shift)
+{
+  gint32 *sum;
+  gint r, c;
+
+  g_return_if_fail (detector != NULL);
+
+  if (!mask || cols <= 0 || rows <= 0) {
+    detector->mask_cols = detector->mask_rows = 0;
+    return;
+  }
+
+  if ((cols + 1) * (rows + 1) > detector->mask_allocated) {
+    g_free (detector->mask_sum);
+    detector->mask_allocated = (cols + 1) * (rows + 1);
+    detector->mask_sum = g_new (gint32, detector->mask_allocated);
+  }
+  detector->mask_cols = cols;
+  detector->mask_rows = rows;
+  detector->mask_shift = shift;
+
+  sum = detector->mask_sum;
+  memset (sum, 0, (cols + 1) * sizeof (gint32));
+  for (r = 0; r < rows; r++) {
+    gint32 *row = sum + (r + 1) * (cols + 1);
+    gint32 s = 0;
+
+    row[0] = 0;
+    for (c = 0; c < cols; c++) {
+      s += mask[r * cols + c] != 0;
+      row[c + 1] = row[c + 1 - (cols + 1)] + s;
+    }
+  }
+}
+
+/* each row is evaluated in full every history_refresh frames, a different
+ * one each frame */
+static inline gboolean
+gst_haar_detector_refreshed (const GstHaarDetector * detector, gint iy)
+{
+  return (iy + detector->history_frame) % detector->history_refresh == 0;
+}
+
+/* whether all of row @iy is rejected from the @history: no changed cell
+ * under it and all its windows rejected early last time */
+static gboolean
+gst_haar_detector_row_cached (const GstHaarDetector * detector,
+    const GstHaarScale * scale, const GstHaarHistory * history,
+    const GstHaarJob * job, gint n, gint y, gint iy)
+{
+  const guint8 *depth = history->depth + iy * history->cols;
+  gint width = job->offsets[n - 1] - y * detector->integral->stride +
+      scale->win_width;
+  guint8 deepest = 0;
+  gint i;
+
+  if (gst_haar_detector_refreshed (detector, iy) ||
+      gst_haar_cell_count (detector->cell_sum, detector->cell_cols,
+          detector->cell_rows, GST_HAAR_CELL_SHIFT, 0, y, width,
+          scale->win_height) > 0)
+    return FALSE;
+
+  for (i = 0; i < n; i++)
+    deepest = MAX (deepest, depth[i]);
+  return deepest < detector->history_depth;
+}
+
+/* The prefilter: keeps the windows with enough texture for a hand, their
+ * mean edge magnitude on the inner part and their standard deviation (from
+ * the norms of the variance pass, float or fixed point) reaching min_edges
+ * and min_stddev, and overlapping the mask if there is one. The offsets
+ * and norms of the kept windows go to pass_ofs and pass_norm, their index
+ * in the row to keep, returns how many there are.
+ *
+ * With a @history, the windows of row @iy rejected early last time, with
+ * no changed cell under them, are not kept either. They get
+ * GST_HAAR_CACHED as their stage 0 result in fill if they passed it, 0
+ * otherwise like the pruned ones.
+ */
+static gint
+gst_haar_detector_prune (const GstHaarDetector * detector,
+    const GstHaarScale * scale, GstHaarHistory * history, GstHaarJob * job,
+    gint n, gint y, gint iy)
+{
+  const GstHaarIntegral *integral = detector->integral;
+  const gint32 *eo = scale->edge_ofs;
+  const gint32 *norm = job->norm;
+  gint32 *pass_norm = job->pass_norm;
+  gint32 min_edges = (gint32) ceil (detector->min_edges * scale->edge_area);
+  gfloat min_stddev = detector->min_stddev;
+  gint32 min_inorm = (gint32) ceil (ldexp (detector->min_stddev * scale->area,
+          -scale->norm_shift));
+  const guint8 *depth = NULL;
+  gint max_depth = 0;
+  gint i, n_kept = 0, n_cached = 0;
+
+  if (history && !gst_haar_detector_refreshed (detector, iy)) {
+    depth = history->depth + iy * history->cols;
+    max_depth = detector->history_depth;
+  }
+
+  /* kept and pruned windows interleave, so no branches */
+  for (i = 0; i < n; i++) {
+    gint x = job->offsets[i] - y * integral->stride;
+    gboolean kept = detector->fixed_point ? norm[i] >= min_inorm :
+        ((const gfloat *) norm)[i] >= min_stddev;
+
+    if (integral->edges) {
+      const gint32 *e = integral->edges + job->offsets[i];
+
+      kept &= e[eo[0]] - e[eo[1]] - e[eo[2]] + e[eo[3]] >= min_edges;
+    }
+    if (detector->mask_cols)
+      kept &= gst_haar_cell_count (detector->mask_sum, detector->mask_cols,
+          detector->mask_rows, detector->mask_shift, x + detector->area.x,
+          y + detector->area.y, scale->win_width, scale->win_height) > 0;
+    job->fill[i] = 0;
+    if (depth && depth[i] < max_depth) {
+      gboolean cached = gst_haar_cell_count (detector->cell_sum,
+          detector->cell_cols, detector->cell_rows, GST_HAAR_CELL_SHIFT, x, y,
+          scale->win_width, scale->win_height) == 0;
+
+      job->fill[i] = kept && cached && depth[i] > 0 ? GST_HAAR_CACHED : 0;
+      n_cached += kept && cached;
+      kept &= !cached;
+    }
+    job->pass_ofs[n_kept] = job->offsets[i];
+    pass_norm[n_kept] = norm[i];
+    job->keep[n_kept] = i;
+    n_kept += kept;
+  }
+  job->n_pruned += n - n_kept - n_cached;
+  job->n_cached += n_cached;
+  return n_kept;
+}
+
+/* spreads the stage 0 results of the kept windows back over the row, the
+ * pruned ones get their fill */
+static void
+gst_haar_detector_unprune (GstHaarJob * job, gint n, gint n_kept)
+{
+  gint *result = job->result;
+  gint i, k = n_kept - 1;
+
+  for (i = n - 1; i >= 0; i--) {
+    gint at = MAX (k, 0);
+    gboolean kept = k >= 0 && job->keep[at] == i;
+
+    result[i] = kept ? result[at] : job->fill[i];
+    k -= kept;
+  }
+}
+
+/* Records how far the windows of row @iy got at stage 0: the ones passing
+ * it are at 1 until the walk evaluates them, so the ones it skips do the
+ * same next time, those rejected from the history stay as they were. */
+static void
+gst_haar_detector_remember_first (GstHaarHistory * history, gint iy,
+    const gint * result, gint n)
+{
+  guint8 *depth = history->depth + iy * history->cols;
+  gint j;
+
+  for (j = 0; j < n; j++)
+    depth[j] = result[j] == GST_HAAR_CACHED ? depth[j] : result[j] > 0;
+}
+
+/* then the stages passed by the n_pass windows the walk evaluated */
+static void
+gst_haar_detector_remember (const GstHaarCascade * cascade,
+    GstHaarHistory * history, gint iy, const GstHaarJob * job, gint n_pass)
+{
+  guint8 *depth = history->depth + iy * history->cols;
+  gint j;
+
+  for (j = 0; j < n_pass; j++) {
+    gint r = job->result[j];
+
+    depth[job->keep[j]] = MIN (r > 0 ? cascade->n_stages : -r,
+        GST_HAAR_DEPTH_UNKNOWN - 1);
+  }
+}
+
+/* Evaluates one cascade on the n windows of row y at @offsets. Stage 0 is
+ * run on the whole row at once, then, like the legacy scanner, the row is
+ * walked skipping the next x position after a window rejected there and
+ * only the windows passing it go through the later stages. Windows pruned
+ * count as rejected at stage 0, the ones rejected from the @history (row
+ * @iy of it, or NULL) as rejected where they were last time.
+ */
+static void
+gst_haar_detector_scan_row (const GstHaarDetector * detector, gint label,
+    const GstHaarScale * scale, GstHaarHistory * history, GstHaarJob * job,
+    gint n, gint y, gint iy)
+{
+  const GstHaarCascade *cascade = detector->cascades[label];
+  const GstHaarCompiled *compiled = detector->compiled[label];
+  const GstHaarIntegral *integral = detector->integral;
+  gboolean prune = detector->min_edges > 0 || detector->min_stddev > 0 ||
+      detector->mask_cols > 0 || history != NULL;
+  gint *result = job->result;
+  gint n_kept = n, n_pass = 0;
+  gint j;
+
+  job->n_windows += n;
+  if (history && gst_haar_detector_row_cached (detector, scale, history, job,
+          n, y, iy)) {
+    job->n_cached += n;
+    return;
+  }
+
+  /* stage 0 runs on the windows kept from pass_ofs and pass_norm, free
+   * until the walk */
+  if (detector->fixed_point) {
+    gint32 *norm = job->norm, *pass_norm = job->pass_norm;
+
+    gst_haar_scale_variance_fixed (scale, integral, job->offsets, n, norm);
+    if (prune) {
+      n_kept = gst_haar_detector_prune (detector, scale, history, job, n, y,
+          iy);
+      gst_haar_cascade_eval_first_fixed (cascade, scale, integral,
+          job->pass_ofs, pass_norm, n_kept, result);
+      gst_haar_detector_unprune (job, n, n_kept);
+    } else {
+      gst_haar_cascade_eval_first_fixed (cascade, scale, integral,
+          job->offsets, norm, n, result);
+    }
+    for (j = 0; j < n; j += result[j] > 0 ? 1 : 2) {
+      if (result[j] == 1) {
+        job->keep[n_pass] = j;
+        job->pass_ofs[n_pass] = job->offsets[j];
+        pass_norm[n_pass++] = norm[j];
+      }
+    }
+    if (history)
+      gst_haar_detector_remember_first (history, iy, result, n);
+    if (n_pass > 0)
+      gst_haar_cascade_eval_fixed (cascade, scale, integral, job->pass_ofs,
+          pass_norm, n_pass, 1, cascade->n_stages, result);
+  } else {
+    gfloat *norm = job->norm, *pass_norm = job->pass_norm;
+
+    gst_haar_scale_variance (scale, integral, job->offsets, n, norm);
+    if (prune) {
+      n_kept = gst_haar_detector_prune (detector, scale, history, job, n, y,
+          iy);
+      gst_haar_cascade_eval_first (cascade, scale, integral, job->pass_ofs,
+          pass_norm, n_kept, result);
+      gst_haar_detector_unprune (job, n, n_kept);
+    } else {
+      gst_haar_cascade_eval_first (cascade, scale, integral, job->offsets,
+          norm, n, result);
+    }
+    for (j = 0; j < n; j += result[j] > 0 ? 1 : 2) {
+      if (result[j] == 1) {
+        job->keep[n_pass] = j;
+        job->pass_ofs[n_pass] = job->offsets[j];
+        pass_norm[n_pass++] = norm[j];
+      }
+    }
+    if (history)
+      gst_haar_detector_remember_first (history, iy, result, n);
+    if (n_pass > 0 && compiled)
+      compiled->eval (scale, integral, job->pass_ofs, pass_norm, n_pass, 1,
+          cascade->n_stages, result);
+    else if (n_pass > 0)
+      gst_haar_cascade_eval (cascade, scale, integral, job->pass_ofs,
+          pass_norm, n_pass, 1, cascade->n_stages, result);
+  }
+  if (history)
+    gst_haar_detector_remember (cascade, history, iy, job, n_pass);
+
+  for (j = 0; j < n_pass; j++) {
+    if (result[j] > 0) {
+      GstHaarObject o;
+
+      o.rect = cvRect (job->pass_ofs[j] - y * integral->stride, y,
+          scale->win_width, scale->win_height);
+      o.label = label;
+      o.neighbors = 0;
+      g_array_append_val (job->candidates, o);
+    }
+  }
+}
+
+/* Scans the window rows of @job, the window offsets of a row are computed
+ * once for all the cascades. */
+static void
+gst_haar_detector_scan (const GstHaarDetector * detector, GstHaarJob * job,
+    CvSize min_size, CvSize max_size)
+{
+  const GstHaarIntegral *integral = detector->integral;
+  const GstHaarLevel *level = &detector->levels[job->level];
+  gint rows[GST_HAAR_MAX_CASCADES], cols[GST_HAAR_MAX_CASCADES];
+  gint max_rows, max_cols, iy, ix, c;
+
+  gst_haar_detector_grid (detector, level, min_size, max_size, rows, cols,
+      &max_rows, &max_cols);
+
+  if (max_cols > job->row_allocated) {
+    g_free (job->offsets);
+    g_free (job->norm);
+    g_free (job->result);
+    g_free (job->pass_ofs);
+    g_free (job->pass_norm);
+    g_free (job->keep);
+    g_free (job->fill);
+    job->offsets = g_new (gint32, max_cols);
+    job->norm = g_malloc (max_cols * sizeof (gint32));
+    job->result = g_new (gint, max_cols);
+    job->pass_ofs = g_new (gint32, max_cols);
+    job->pass_norm = g_malloc (max_cols * sizeof (gint32));
+    job->keep = g_new (gint, max_cols);
+    job->fill = g_new (gint, max_cols);
+    job->row_allocated = max_cols;
+  }
+
+  for (iy = job->y_start; iy < job->y_end; iy++) {
+    gint y = cvRound (iy * level->step);
+
+    for (ix = 0; ix < max_cols; ix++)
+      job->offsets[ix] = y * integral->stride + cvRound (ix * level->step);
+
+    for (c = 0; c < detector->n_cascades; c++) {
+      if (iy >= rows[c] || cols[c] == 0)
+        continue;
+      gst_haar_detector_scan_row (detector, c, &level->scales[c],
+          detector->history_refresh > 0 ? &level->history[c] : NULL, job,
+          cols[c], y, iy);
+    }
+  }
+}
+
+/* pull jobs until none is left, from the workers and the calling thread */
+static void
+gst_haar_detector_run_jobs (GstHaarDetector * detector)
+{
+  gint i;
+
+  while ((i = g_atomic_int_exchange_and_add (&detector->next_job, 1)) <
+      detector->n_jobs) {
+    GstHaarJob *job = &detector->jobs[i];
+
+    g_array_set_size (job->candidates, 0);
+    job->n_windows = job->n_pruned = job->n_cached = 0;
+    gst_haar_detector_scan (detector, job, detector->min_size,
+        detector->max_size);
+  }
+}
+
+static void
+gst_haar_detector_worker (G_GNUC_UNUSED gpointer data, gpointer user_data)
+{
+  GstHaarDetector *detector = user_data;
+
+  gst_haar_detector_run_jobs (detector);
+
+  g_mutex_lock (detector->lock);
+  if (--detector->busy_workers == 0)
+    g_cond_signal (detector->cond);
+  g_mutex_unlock (detector->lock);
+}
+
+/* The pool threads are created once and stay alive between frames, a frame
+ * only costs one push and one wake-up per worker. */
+gboolean
+gst_haar_detector_set_threads (GstHaarDetector * detector, gint n_threads,
+    GError ** err)
+{
+  g_return_val_if_fail (detector != NULL, FALSE);
+  g_return_val_if_fail (n_threads >= 1, FALSE);
+
+  if (n_threads == detector->n_threads)
+    return TRUE;
+
+  if (detector->pool) {
+    g_thread_pool_free (detector->pool, TRUE, TRUE);
+    detector->pool = NULL;
+  }
+  detector->n_threads = 1;
+
+  if (n_threads > 1) {
+    detector->pool = g_thread_pool_new (gst_haar_detector_worker, detector,
+        n_threads - 1, TRUE, err);
+    if (!detector->pool)
+      return FALSE;
+    detector->n_threads = n_threads;
+  }
+  return TRUE;
+}
+
+void
+gst_haar_detector_detect (GstHaarDetector * detector, const guint8 * gray,
+    gint width, gint height, gint stride, GArray * objects)
+{
+  gst_haar_detector_detect_region (detector, gray, width, height, stride,
+      NULL, cvSize (0, 0), cvSize (0, 0), objects);
+}
+
+/* Scans only @region of the width x height frame (the whole frame when
+ * NULL) with windows between @min_size and @max_size (0 for no limit).
+ * Objects are returned in frame coordinates, grouped per label and in
+ * label order.
+ */
+void
+gst_haar_detector_detect_region (GstHaarDetector * detector,
+    const guint8 * gray, gint width, gint height, gint stride,
+    const CvRect * region, CvSize min_size, CvSize max_size, GArray * objects)
+{
+  CvRect area = cvRect (0, 0, width, height);
+  gint i, c;
+  guint j;
+
+  g_return_if_fail (detector != NULL);
+  g_return_if_fail (objects != NULL);
+
+  g_array_set_size (objects, 0);
+  detector->n_windows = detector->n_pruned = detector->n_cached = 0;
+
+  if (region) {
+    gint x1 = CLAMP (region->x, 0, width);
+    gint y1 = CLAMP (region->y, 0, height);
+    gint x2 = CLAMP (region->x + region->width, 0, width);
+    gint y2 = CLAMP (region->y + region->height, 0, height);
+
+    area = cvRect (x1, y1, x2 - x1, y2 - y1);
+  }
+  if (area.width <= 0 || area.height <= 0)
+    return;
+  detector->area = area;
+
+  gst_haar_detector_ensure_levels (detector, width, height);
+  gst_haar_integral_set_edges (detector->integral, detector->min_edges > 0);
+  gst_haar_integral_compute (detector->integral,
+      gray + area.y * stride + area.x, area.width, area.height, stride);
+  detector->min_size = min_size;
+  detector->max_size = max_size;
+  gst_haar_detector_plan (detector, min_size, max_size);
+  if (detector->history_refresh > 0)
+    gst_haar_detector_ensure_history (detector, min_size, max_size);
+  else
+    detector->history_area = cvRect (0, 0, 0, 0);
+
+  detector->next_job = 0;
+  if (detector->pool) {
+    gint workers = MIN (detector->n_threads - 1, detector->n_jobs);
+
+    detector->busy_workers = workers;
+    for (i = 0; i < workers; i++)
+      g_thread_pool_push (detector->pool, GINT_TO_POINTER (i + 1), NULL);
+    gst_haar_detector_run_jobs (detector);
+
+    g_mutex_lock (detector->lock);
+    while (detector->busy_workers > 0)
+      g_cond_wait (detector->cond, detector->lock);
+    g_mutex_unlock (detector->lock);
+  } else {
+    gst_haar_detector_run_jobs (detector);
+  }
+
+  for (i = 0; i < detector->n_jobs; i++) {
+    detector->n_windows += detector->jobs[i].n_windows;
+    detector->n_pruned += detector->jobs[i].n_pruned;
+    detector->n_cached += detector->jobs[i].n_cached;
+  }
+
+  for (c = 0; c < detector->n_cascades; c++) {
+    GArray *group = detector->group;
+
+    g_array_set_size (group, 0);
+    for (i = 0; i < detector->n_jobs; i++) {
+      GArray *candidates = detector->jobs[i].candidates;
+
+      for (j = 0; j < candidates->len; j++) {
+        GstHaarObject *o = &g_array_index (candidates, GstHaarObject, j);
+        if (o->label == c)
+          g_array_append_val (group, o->rect);
+      }
+    }
+    g_array_set_size (detector->group_neighbors, 0);
+    if (detector->min_neighbors != 0)
+      gst_haar_group_rectangles (group, MAX (detector->min_neighbors, 1),
+          GST_HAAR_GROUP_EPS, detector->group_neighbors);
+
+    for (j = 0; j < group->len; j++) {
+      GstHaarObject o;
+
+      o.rect = g_array_index (group, CvRect, j);
+      o.rect.x += area.x;
+      o.rect.y += area.y;
+      o.label = c;
+      o.neighbors = j < detector->group_neighbors->len ?
+          g_array_index (detector->group_neighbors, gint, j) : 0;
+      g_array_append_val (objects, o);
+    }
+  }
+}
+
+static gboolean
+gst_haar_similar_rects (const CvRect * r1, const CvRect * r2, gdouble eps)
+{
+  gdouble delta = eps * (MIN (r1->width, r2->width) +
+      MIN (r1->height, r2->height)) * 0.5;
+
+  return abs (r1->x - r2->x) <= delta &&
+      abs (r1->y - r2->y) <= delta &&
+      abs (r1->x + r1->width - r2->x - r2->width) <= delta &&
+      abs (r1->y + r1->height - r2->y - r2->height) <= delta;
+}
+
+static gint
+gst_haar_find_root (gint * parent, gint i)
+{
+  gint root = i;
+
+  while (parent[root] != root)
+    root = parent[root];
+  while (parent[i] != root) {
+    gint next = parent[i];
+    parent[i] = root;
+    i = next;
+  }
+  return root;
+}
+
+/* cv::groupRectangles(): cluster similar rectangles, average each cluster,
+ * drop clusters with group_threshold members or less and clusters lying
+ * inside a stronger one. Classes are numbered in order of first appearance
+ * so the output only depends on the order of the input. The size of each
+ * cluster kept is appended to @neighbors, if not NULL.
+ */
+void
+gst_haar_group_rectangles (GArray * rects, gint group_threshold, gdouble eps,
+    GArray * neighbors)
+{
+  CvRect *r = (CvRect *) rects->data;
+  gint n = rects->len;
+  gint *parent, *label, *weight;
+  CvRect *avg;
+  gint n_classes = 0;
+  gint i, j;
+
+  if (group_threshold <= 0 || n == 0)
+    return;
+
+  parent = g_new (gint, n);
+  label = g_new (gint, n);
+  for (i = 0; i < n; i++) {
+    parent[i] = i;
+    label[i] = -1;
+  }
+
+  for (i = 0; i < n; i++)
+    for (j = i + 1; j < n; j++)
+      if (gst_haar_similar_rects (&r[i], &r[j], eps)) {
+        gint a = gst_haar_find_root (parent, i);
+        gint b = gst_haar_find_root (parent, j);
+        if (a != b)
+          parent[MAX (a, b)] = MIN (a, b);
+      }
+
+  avg = g_new0 (CvRect, n);
+  weight = g_new0 (gint, n);
+  for (i = 0; i < n; i++) {
+    gint root = gst_haar_find_root (parent, i);
+    gint cls;
+
+    if (label[root] < 0)
+      label[root] = n_classes++;
+    cls = label[root];
+
+    avg[cls].x += r[i].x;
+    avg[cls].y += r[i].y;
+    avg[cls].width += r[i].width;
+    avg[cls].height += r[i].height;
+    weight[cls]++;
+  }
+
+  for (i = 0; i < n_classes; i++) {
+    gfloat s = 1.f / weight[i];
+
+    avg[i] = cvRect (cvRound (avg[i].x * s), cvRound (avg[i].y * s),
+        cvRound (avg[i].width * s), cvRound (avg[i].height * s));
+  }
+
+  g_array_set_size (rects, 0);
+  for (i = 0; i < n_classes; i++) {
+    CvRect r1 = avg[i];
+    gint n1 = weight[i];
+
+    if (n1 <= group_threshold)
+      continue;
+
+    for (j = 0; j < n_classes; j++) {
+      CvRect r2 = avg[j];
+      gint n2 = weight[j];
+      gint dx, dy;
+
+      if (j == i || n2 <= group_threshold)
+        continue;
+
+      dx = cvRound (r2.width * eps);
+      dy = cvRound (r2.height * eps);
+      if (r1.x >= r2.x - dx && r1.y >= r2.y - dy &&
+          r1.x + r1.width <= r2.x + r2.width + dx &&
+          r1.y + r1.height <= r2.y + r2.height + dy &&
+          (n2 > MAX (3, n1) || n1 < 3))
+        break;
+    }
+
+    if (j == n_classes) {
+      g_array_append_val (rects, r1);
+      if (neighbors)
+        g_array_append_val (neighbors, n1);
+    }
+  }
+
+  g_free (parent);
+  g_free (label);
+  g_free (avg);
+  g_free (weight);
+}
@@ -0,0 +1,204 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaardetector.h: multi-scale object detection with the native cascade
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAAR_DETECTOR_H__
+#define __GST_HAAR_DETECTOR_H__
+
+#include <glib.h>
+#include <cv.h>
+
+#include "gsthaarcascade.h"
+#include "gsthaarintegral.h"
+#include "gsthaarcompiled.h"
+
+G_BEGIN_DECLS
+
+/* cascades evaluated together in one scan */
+#define GST_HAAR_MAX_CASCADES 8
+
+typedef struct _GstHaarDetector GstHaarDetector;
+typedef struct _GstHaarLevel GstHaarLevel;
+typedef struct _GstHaarHistory GstHaarHistory;
+typedef struct _GstHaarJob GstHaarJob;
+typedef struct _GstHaarObject GstHaarObject;
+
+/* a detection, labelled with the index of the cascade that found it;
+ * neighbors is the number of raw windows grouped into it, as in
+ * CvAvgComp */
+struct _GstHaarObject
+{
+  CvRect rect;
+  gint label;
+  gint neighbors;
+};
+
+/* depth of the windows not evaluated since the history was reset */
+#define GST_HAAR_DEPTH_UNKNOWN 255
+
+/* What the last detections learnt about the windows of one scale, row by
+ * row: how many stages each passed, that is the stage it was rejected at,
+ * 1 for the ones passing stage 0 the row walk skipped. */
+struct _GstHaarHistory
+{
+  guint8 *depth;
+  gint cols;
+  gint rows;
+};
+
+/* one factor of the scale pyramid: all cascades share the window grid,
+ * each one has its own tables (ofs NULL when it does not fit the frame)
+ * and history (allocated once used) */
+struct _GstHaarLevel
+{
+  gdouble factor;
+  gdouble step;
+  GstHaarScale *scales;
+  GstHaarHistory *history;
+};
+
+/* a band of window rows [y_start, y_end) of one level */
+struct _GstHaarJob
+{
+  gint level;
+  gint y_start;
+  gint y_end;
+  GArray *candidates;           /* GstHaarObject */
+
+  /* private, one row of windows: offsets, norms (float or fixed point),
+   * stage results and the windows passing stage 0 */
+  gint32 *offsets;
+  gpointer norm;
+  gint *result;
+  gint32 *pass_ofs;
+  gpointer pass_norm;
+  gint *keep;                   /* row index of the windows not pruned */
+  gint *fill;                   /* stage 0 result of the ones pruned */
+  gint row_allocated;
+  gint n_windows;
+  gint n_pruned;
+  gint n_cached;
+};
+
+/* Drop-in replacement for cvHaarDetectObjects(): the same scale pyramid,
+ * window stepping and rectangle grouping, run on the native cascade
+ * evaluator. Instead of Canny pruning, flat windows can be pruned from the
+ * integral of the Sobel magnitude and from their variance, and the scan
+ * can be restricted to the cells of a mask, such as the moving blocks of a
+ * GstHandMotion. On a still scene the windows can also be rejected from
+ * what the previous detections found out, see history_refresh. Several
+ * cascades can be added, they are then evaluated in a single scan sharing
+ * the integral images and the window enumeration, and grouped separately.
+ */
+struct _GstHaarDetector
+{
+  const GstHaarCascade *cascades[GST_HAAR_MAX_CASCADES];
+  gint n_cascades;
+  GstHaarIntegral *integral;
+
+  gdouble scale_factor;
+  gint min_neighbors;
+  gint min_width;
+  gint min_height;
+  gint n_threads;
+  gboolean fixed_point;         /* integer evaluation, see GstHaarScale */
+  /* windows with a lower mean edge magnitude (Sobel / 8) on their inner
+   * part or a lower standard deviation are pruned, 0 disables each test */
+  gdouble min_edges;
+  gdouble min_stddev;
+  /* with a history, windows rejected by one of the first history_depth
+   * stages are not evaluated again while no 8x8 cell under them changed
+   * its mean by more than history_tolerance, but each row is every
+   * history_refresh frames; 0 disables it */
+  gint history_refresh;
+  gint history_depth;
+  gint history_tolerance;
+
+  /* windows of the last detection, how many of them were pruned
+   * (including the ones outside the mask) and how many were rejected
+   * from the history */
+  guint64 n_windows;
+  guint64 n_pruned;
+  guint64 n_cached;
+
+  /* private */
+  const GstHaarCompiled *compiled[GST_HAAR_MAX_CASCADES];     /* or NULL */
+  GstHaarLevel *levels;
+  gint n_levels;
+  gint frame_width;
+  gint frame_height;
+  CvRect area;                  /* of the frame being scanned */
+  CvRect history_area;          /* the histories are valid for */
+  guint history_frame;
+  /* cell means when the windows over them were last evaluated, and the
+   * integral of the cells changed since, (cell_cols + 1) x (cell_rows + 1) */
+  guint8 *cell_mean;
+  gint32 *cell_sum;
+  gint cell_cols;
+  gint cell_rows;
+
+  /* integral of the mask cells, (mask_cols + 1) x (mask_rows + 1) */
+  gint32 *mask_sum;
+  gint mask_cols;
+  gint mask_rows;
+  gint mask_shift;
+  gint mask_allocated;
+
+  GstHaarJob *jobs;
+  gint n_jobs;
+  gint jobs_allocated;
+  CvSize min_size;
+  CvSize max_size;
+  GArray *group;
+  GArray *group_neighbors;
+
+  /* worker pool, n_threads - 1 workers plus the calling thread */
+  GThreadPool *pool;
+  GMutex *lock;
+  GCond *cond;
+  volatile gint next_job;
+  gint busy_workers;
+};
+
+GstHaarDetector *gst_haar_detector_new (const GstHaarCascade * cascade,
+    gdouble scale_factor, gint min_neighbors, gint min_width, gint min_height);
+void gst_haar_detector_free (GstHaarDetector * detector);
+gint gst_haar_detector_add_cascade (GstHaarDetector * detector,
+    const GstHaarCascade * cascade);
+
+gboolean gst_haar_detector_set_threads (GstHaarDetector * detector,
+    gint n_threads, GError ** err);
+
+void gst_haar_detector_set_mask (GstHaarDetector * detector,
+    const guint8 * mask, gint cols, gint rows, gint shift);
+
+void gst_haar_detector_detect (GstHaarDetector * detector,
+    const guint8 * gray, gint width, gint height, gint stride,
+    GArray * objects);
+void gst_haar_detector_detect_region (GstHaarDetector * detector,
+    const guint8 * gray, gint width, gint height, gint stride,
+    const CvRect * region, CvSize min_size, CvSize max_size,
+    GArray * objects);
+
+void gst_haar_group_rectangles (GArray * rects, gint group_threshold,
+    gdouble eps, GArray * neighbors);
+
+G_END_DECLS
+#endif /* __GST_HAAR_DETECTOR_H__ */
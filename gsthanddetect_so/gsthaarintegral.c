@@ -0,0 +1,536 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarintegral.c: integral images for the native haar cascade engine
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "gsthaarintegral.h"
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_HAAR_NEON 1
+#endif
+
+GstHaarIntegral *
+gst_haar_integral_new (gboolean tilted)
+{
+  GstHaarIntegral *integral = g_new0 (GstHaarIntegral, 1);
+
+  integral->with_tilted = tilted;
+  return integral;
+}
+
+void
+gst_haar_integral_free (GstHaarIntegral * integral)
+{
+  if (!integral)
+    return;
+
+  g_free (integral->sum);
+  g_free (integral->sqsum);
+  g_free (integral->tilted);
+  g_free (integral->edges);
+  g_free (integral->buf);
+  g_free (integral);
+}
+
+static void
+gst_haar_integral_ensure (GstHaarIntegral * integral, gint width, gint height)
+{
+  gint stride = MAX (width + 1, integral->reserved_stride);
+  gsize size = (gsize) stride * (height + 1);
+
+  integral->width = width;
+  integral->height = height;
+  integral->stride = stride;
+
+  if (width + 2 > integral->buf_size) {
+    g_free (integral->buf);
+    integral->buf = g_new (gint32, width + 2);
+    integral->buf_size = width + 2;
+  }
+
+  if (size <= integral->allocated)
+    return;
+
+  g_free (integral->sum);
+  g_free (integral->sqsum);
+  g_free (integral->tilted);
+  g_free (integral->edges);
+  integral->sum = g_new (gint32, size);
+  integral->sqsum = g_new (gint64, size);
+  integral->tilted = integral->with_tilted ? g_new (gint32, size) : NULL;
+  integral->edges = integral->with_edges ? g_new (gint32, size) : NULL;
+  integral->allocated = size;
+}
+
+/* Adds (or drops) the integral of the edge magnitude to the planes computed,
+ * for pruning flat windows. */
+void
+gst_haar_integral_set_edges (GstHaarIntegral * integral, gboolean edges)
+{
+  g_return_if_fail (integral != NULL);
+
+  if (integral->with_edges == edges)
+    return;
+
+  integral->with_edges = edges;
+  g_free (integral->edges);
+  integral->edges = NULL;
+  if (edges && integral->allocated > 0)
+    integral->edges = g_new (gint32, integral->allocated);
+}
+
+/* Fixes the row stride to the one of a max_width wide image, so that images
+ * of any smaller size (cropped regions of a frame) keep the same stride and
+ * per-stride tables built for the full frame remain valid for them.
+ */
+void
+gst_haar_integral_reserve (GstHaarIntegral * integral, gint max_width,
+    gint max_height)
+{
+  g_return_if_fail (integral != NULL);
+
+  integral->reserved_stride = max_width + 1;
+  gst_haar_integral_ensure (integral, max_width, max_height);
+}
+
+/* One row of the upright sum and squared sum planes:
+ *   sum[x] = prev_sum[x] + src[0] + ... + src[x]
+ * sum, sq, prev_sum and prev_sq point at column 1 of their rows.
+ */
+static inline void
+gst_haar_integral_row_c (const guint8 * src, gint x, gint width,
+    gint32 s, gint64 sq, const gint32 * prev_sum, gint32 * sum,
+    const gint64 * prev_sq, gint64 * sqsum)
+{
+  for (; x < width; x++) {
+    gint v = src[x];
+
+    s += v;
+    sq += v * v;
+    sum[x] = prev_sum[x] + s;
+    sqsum[x] = prev_sq[x] + sq;
+  }
+}
+
+#if defined (__AVX2__)
+static void
+gst_haar_integral_row (const guint8 * src, gint width,
+    const gint32 * prev_sum, gint32 * sum, const gint64 * prev_sq,
+    gint64 * sqsum)
+{
+  const __m256i last = _mm256_set1_epi32 (7);
+  __m256i carry = _mm256_setzero_si256 ();
+  __m256i sqcarry = _mm256_setzero_si256 ();
+  gint32 s;
+  gint64 sq;
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m256i v, q, t, qlo, qhi;
+
+    v = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (src + x)));
+    q = _mm256_mullo_epi32 (v, v);
+
+    /* inclusive prefix inside each 128 bit lane, then carry lane 0 into
+     * lane 1 */
+    v = _mm256_add_epi32 (v, _mm256_slli_si256 (v, 4));
+    v = _mm256_add_epi32 (v, _mm256_slli_si256 (v, 8));
+    t = _mm256_shuffle_epi32 (v, _MM_SHUFFLE (3, 3, 3, 3));
+    v = _mm256_add_epi32 (v, _mm256_permute2x128_si256 (t, t, 0x08));
+    v = _mm256_add_epi32 (v, carry);
+    carry = _mm256_permutevar8x32_epi32 (v, last);
+
+    q = _mm256_add_epi32 (q, _mm256_slli_si256 (q, 4));
+    q = _mm256_add_epi32 (q, _mm256_slli_si256 (q, 8));
+    t = _mm256_shuffle_epi32 (q, _MM_SHUFFLE (3, 3, 3, 3));
+    q = _mm256_add_epi32 (q, _mm256_permute2x128_si256 (t, t, 0x08));
+
+    _mm256_storeu_si256 ((__m256i *) (sum + x), _mm256_add_epi32 (v,
+            _mm256_loadu_si256 ((const __m256i *) (prev_sum + x))));
+
+    qlo = _mm256_cvtepu32_epi64 (_mm256_castsi256_si128 (q));
+    qhi = _mm256_cvtepu32_epi64 (_mm256_extracti128_si256 (q, 1));
+    qlo = _mm256_add_epi64 (qlo, sqcarry);
+    qhi = _mm256_add_epi64 (qhi, sqcarry);
+    sqcarry = _mm256_permute4x64_epi64 (qhi, _MM_SHUFFLE (3, 3, 3, 3));
+
+    _mm256_storeu_si256 ((__m256i *) (sqsum + x), _mm256_add_epi64 (qlo,
+            _mm256_loadu_si256 ((const __m256i *) (prev_sq + x))));
+    _mm256_storeu_si256 ((__m256i *) (sqsum + x + 4), _mm256_add_epi64 (qhi,
+            _mm256_loadu_si256 ((const __m256i *) (prev_sq + x + 4))));
+  }
+
+  s = _mm256_cvtsi256_si32 (carry);
+  sq = _mm256_extract_epi64 (sqcarry, 0);
+  gst_haar_integral_row_c (src, x, width, s, sq, prev_sum, sum, prev_sq,
+      sqsum);
+}
+#elif defined (__SSE2__)
+static void
+gst_haar_integral_row (const guint8 * src, gint width,
+    const gint32 * prev_sum, gint32 * sum, const gint64 * prev_sq,
+    gint64 * sqsum)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i carry = zero;
+  __m128i sqcarry = zero;
+  gint64 sq_lanes[2];
+  gint32 s;
+  gint x;
+
+  for (x = 0; x + 4 <= width; x += 4) {
+    __m128i v, q, qlo, qhi;
+    gint32 px;
+
+    memcpy (&px, src + x, 4);
+    v = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (px), zero);
+    v = _mm_unpacklo_epi16 (v, zero);
+    /* v holds 16 bit pixels interleaved with zeros, so madd squares them */
+    q = _mm_madd_epi16 (v, v);
+
+    v = _mm_add_epi32 (v, _mm_slli_si128 (v, 4));
+    v = _mm_add_epi32 (v, _mm_slli_si128 (v, 8));
+    v = _mm_add_epi32 (v, carry);
+    carry = _mm_shuffle_epi32 (v, _MM_SHUFFLE (3, 3, 3, 3));
+
+    q = _mm_add_epi32 (q, _mm_slli_si128 (q, 4));
+    q = _mm_add_epi32 (q, _mm_slli_si128 (q, 8));
+
+    _mm_storeu_si128 ((__m128i *) (sum + x), _mm_add_epi32 (v,
+            _mm_loadu_si128 ((const __m128i *) (prev_sum + x))));
+
+    qlo = _mm_add_epi64 (_mm_unpacklo_epi32 (q, zero), sqcarry);
+    qhi = _mm_add_epi64 (_mm_unpackhi_epi32 (q, zero), sqcarry);
+    sqcarry = _mm_unpackhi_epi64 (qhi, qhi);
+
+    _mm_storeu_si128 ((__m128i *) (sqsum + x), _mm_add_epi64 (qlo,
+            _mm_loadu_si128 ((const __m128i *) (prev_sq + x))));
+    _mm_storeu_si128 ((__m128i *) (sqsum + x + 2), _mm_add_epi64 (qhi,
+            _mm_loadu_si128 ((const __m128i *) (prev_sq + x + 2))));
+  }
+
+  s = _mm_cvtsi128_si32 (carry);
+  _mm_storeu_si128 ((__m128i *) sq_lanes, sqcarry);
+  gst_haar_integral_row_c (src, x, width, s, sq_lanes[0], prev_sum, sum,
+      prev_sq, sqsum);
+}
+#elif defined (HAVE_HAAR_NEON)
+static void
+gst_haar_integral_row (const guint8 * src, gint width,
+    const gint32 * prev_sum, gint32 * sum, const gint64 * prev_sq,
+    gint64 * sqsum)
+{
+  const uint32x4_t zero = vdupq_n_u32 (0);
+  uint32x4_t carry = zero;
+  uint64x2_t sqcarry = vdupq_n_u64 (0);
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint16x8_t w = vmovl_u8 (vld1_u8 (src + x));
+    gint half;
+
+    for (half = 0; half < 2; half++) {
+      uint16x4_t p = half ? vget_high_u16 (w) : vget_low_u16 (w);
+      uint32x4_t v = vmovl_u16 (p);
+      uint32x4_t q = vmull_u16 (p, p);
+      uint64x2_t qlo, qhi;
+      gint o = x + half * 4;
+
+      v = vaddq_u32 (v, vextq_u32 (zero, v, 3));
+      v = vaddq_u32 (v, vextq_u32 (zero, v, 2));
+      v = vaddq_u32 (v, carry);
+      carry = vdupq_n_u32 (vgetq_lane_u32 (v, 3));
+
+      q = vaddq_u32 (q, vextq_u32 (zero, q, 3));
+      q = vaddq_u32 (q, vextq_u32 (zero, q, 2));
+
+      vst1q_s32 (sum + o, vaddq_s32 (vreinterpretq_s32_u32 (v),
+              vld1q_s32 (prev_sum + o)));
+
+      qlo = vaddq_u64 (vmovl_u32 (vget_low_u32 (q)), sqcarry);
+      qhi = vaddq_u64 (vmovl_u32 (vget_high_u32 (q)), sqcarry);
+      sqcarry = vdupq_n_u64 (vgetq_lane_u64 (qhi, 1));
+
+      vst1q_s64 (sqsum + o, vaddq_s64 (vreinterpretq_s64_u64 (qlo),
+              vld1q_s64 (prev_sq + o)));
+      vst1q_s64 (sqsum + o + 2, vaddq_s64 (vreinterpretq_s64_u64 (qhi),
+              vld1q_s64 (prev_sq + o + 2)));
+    }
+  }
+
+  gst_haar_integral_row_c (src, x, width, vgetq_lane_u32 (carry, 0),
+      vgetq_lane_u64 (sqcarry, 0), prev_sum, sum, prev_sq, sqsum);
+}
+#else
+static void
+gst_haar_integral_row (const guint8 * src, gint width,
+    const gint32 * prev_sum, gint32 * sum, const gint64 * prev_sq,
+    gint64 * sqsum)
+{
+  gst_haar_integral_row_c (src, 0, width, 0, 0, prev_sum, sum, prev_sq,
+      sqsum);
+}
+#endif
+
+/* The 45 degree rotated sum, a straight port of the recurrence cvIntegral()
+ * uses so that tilted features evaluate to the very same values. It walks
+ * along diagonals and does not vectorise, which is fine as only cascades
+ * with tilted features pay for it.
+ */
+static void
+gst_haar_integral_tilted (GstHaarIntegral * integral, const guint8 * src,
+    gint src_stride)
+{
+  gint width = integral->width;
+  gint height = integral->height;
+  gint stride = integral->stride;
+  gint32 *tilted = integral->tilted;
+  gint32 *buf = integral->buf;
+  gint x, y;
+
+  memset (tilted, 0, stride * sizeof (gint32));
+  tilted += stride + 1;
+
+  tilted[-1] = 0;
+  for (x = 0; x < width; x++)
+    buf[x] = tilted[x] = src[x];
+  if (width == 1)
+    buf[1] = 0;
+
+  for (y = 1; y < height; y++) {
+    gint32 t0;
+
+    src += src_stride;
+    tilted += stride;
+
+    t0 = src[0];
+    tilted[-1] = tilted[-stride];
+    tilted[0] = tilted[-stride] + t0 + buf[1];
+
+    for (x = 1; x < width - 1; x++) {
+      gint32 t1 = buf[x];
+
+      buf[x - 1] = t1 + t0;
+      t0 = src[x];
+      tilted[x] = t1 + buf[x + 1] + t0 + tilted[x - stride - 1];
+    }
+
+    if (width > 1) {
+      gint32 t1 = buf[x];
+
+      buf[x - 1] = t1 + t0;
+      t0 = src[x];
+      tilted[x] = t0 + t1 + tilted[x - stride - 1];
+      buf[x] = t0;
+    }
+  }
+}
+
+/* The 3x3 Sobel magnitude |gx| + |gy| of row @b, with rows @a above and
+ * @c below, divided by 8 to fit a byte. Columns are replicated at the
+ * borders.
+ */
+static inline gint
+gst_haar_sobel_c (const guint8 * a, const guint8 * b, const guint8 * c,
+    gint xl, gint x, gint xr)
+{
+  gint gx = a[xr] - a[xl] + 2 * (b[xr] - b[xl]) + c[xr] - c[xl];
+  gint gy = c[xl] + 2 * c[x] + c[xr] - a[xl] - 2 * a[x] - a[xr];
+
+  return (ABS (gx) + ABS (gy)) >> 3;
+}
+
+static inline void
+gst_haar_sobel_row_c (const guint8 * a, const guint8 * b, const guint8 * c,
+    gint x, gint end, gint width, guint8 * mag)
+{
+  for (; x < end; x++)
+    mag[x] = gst_haar_sobel_c (a, b, c, MAX (x - 1, 0), x,
+        MIN (x + 1, width - 1));
+}
+
+#if defined (__AVX2__)
+#define HAAR_SOBEL_LOAD(p) _mm256_cvtepu8_epi16 (_mm_loadu_si128 \
+    ((const __m128i *) (p)))
+
+static void
+gst_haar_sobel_row (const guint8 * a, const guint8 * b, const guint8 * c,
+    gint width, guint8 * mag)
+{
+  gint x;
+
+  gst_haar_sobel_row_c (a, b, c, 0, MIN (width, 1), width, mag);
+  for (x = 1; x + 16 < width; x += 16) {
+    __m256i al = HAAR_SOBEL_LOAD (a + x - 1), ar = HAAR_SOBEL_LOAD (a + x + 1);
+    __m256i bl = HAAR_SOBEL_LOAD (b + x - 1), br = HAAR_SOBEL_LOAD (b + x + 1);
+    __m256i cl = HAAR_SOBEL_LOAD (c + x - 1), cr = HAAR_SOBEL_LOAD (c + x + 1);
+    __m256i am = HAAR_SOBEL_LOAD (a + x), cm = HAAR_SOBEL_LOAD (c + x);
+    __m256i gx, gy, m;
+
+    gx = _mm256_add_epi16 (_mm256_sub_epi16 (ar, al),
+        _mm256_sub_epi16 (cr, cl));
+    gx = _mm256_add_epi16 (gx, _mm256_slli_epi16 (_mm256_sub_epi16 (br, bl),
+            1));
+    gy = _mm256_sub_epi16 (_mm256_add_epi16 (cl, cr),
+        _mm256_add_epi16 (al, ar));
+    gy = _mm256_add_epi16 (gy, _mm256_slli_epi16 (_mm256_sub_epi16 (cm, am),
+            1));
+    m = _mm256_srli_epi16 (_mm256_add_epi16 (_mm256_abs_epi16 (gx),
+            _mm256_abs_epi16 (gy)), 3);
+    _mm_storeu_si128 ((__m128i *) (mag + x),
+        _mm_packus_epi16 (_mm256_castsi256_si128 (m),
+            _mm256_extracti128_si256 (m, 1)));
+  }
+  gst_haar_sobel_row_c (a, b, c, x, width, width, mag);
+}
+#elif defined (__SSE2__)
+#define HAAR_SOBEL_LOAD(p) _mm_unpacklo_epi8 (_mm_loadl_epi64 \
+    ((const __m128i *) (p)), zero)
+#define HAAR_SOBEL_ABS(v) _mm_max_epi16 (v, _mm_sub_epi16 (zero, v))
+
+static void
+gst_haar_sobel_row (const guint8 * a, const guint8 * b, const guint8 * c,
+    gint width, guint8 * mag)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint x;
+
+  gst_haar_sobel_row_c (a, b, c, 0, MIN (width, 1), width, mag);
+  for (x = 1; x + 8 < width; x += 8) {
+    __m128i al = HAAR_SOBEL_LOAD (a + x - 1), ar = HAAR_SOBEL_LOAD (a + x + 1);
+    __m128i bl = HAAR_SOBEL_LOAD (b + x - 1), br = HAAR_SOBEL_LOAD (b + x + 1);
+    __m128i cl = HAAR_SOBEL_LOAD (c + x - 1), cr = HAAR_SOBEL_LOAD (c + x + 1);
+    __m128i am = HAAR_SOBEL_LOAD (a + x), cm = HAAR_SOBEL_LOAD (c + x);
+    __m128i gx, gy, m;
+
+    gx = _mm_add_epi16 (_mm_sub_epi16 (ar, al), _mm_sub_epi16 (cr, cl));
+    gx = _mm_add_epi16 (gx, _mm_slli_epi16 (_mm_sub_epi16 (br, bl), 1));
+    gy = _mm_sub_epi16 (_mm_add_epi16 (cl, cr), _mm_add_epi16 (al, ar));
+    gy = _mm_add_epi16 (gy, _mm_slli_epi16 (_mm_sub_epi16 (cm, am), 1));
+    m = _mm_srli_epi16 (_mm_add_epi16 (HAAR_SOBEL_ABS (gx),
+            HAAR_SOBEL_ABS (gy)), 3);
+    _mm_storel_epi64 ((__m128i *) (mag + x), _mm_packus_epi16 (m, m));
+  }
+  gst_haar_sobel_row_c (a, b, c, x, width, width, mag);
+}
+#elif defined (HAVE_HAAR_NEON)
+#define HAAR_SOBEL_LOAD(p) vreinterpretq_s16_u16 (vmovl_u8 (vld1_u8 (p)))
+
+static void
+gst_haar_sobel_row (const guint8 * a, const guint8 * b, const guint8 * c,
+    gint width, guint8 * mag)
+{
+  gint x;
+
+  gst_haar_sobel_row_c (a, b, c, 0, MIN (width, 1), width, mag);
+  for (x = 1; x + 8 < width; x += 8) {
+    int16x8_t al = HAAR_SOBEL_LOAD (a + x - 1), ar = HAAR_SOBEL_LOAD (a + x + 1);
+    int16x8_t bl = HAAR_SOBEL_LOAD (b + x - 1), br = HAAR_SOBEL_LOAD (b + x + 1);
+    int16x8_t cl = HAAR_SOBEL_LOAD (c + x - 1), cr = HAAR_SOBEL_LOAD (c + x + 1);
+    int16x8_t am = HAAR_SOBEL_LOAD (a + x), cm = HAAR_SOBEL_LOAD (c + x);
+    int16x8_t gx, gy;
+    uint16x8_t m;
+
+    gx = vaddq_s16 (vsubq_s16 (ar, al), vsubq_s16 (cr, cl));
+    gx = vaddq_s16 (gx, vshlq_n_s16 (vsubq_s16 (br, bl), 1));
+    gy = vsubq_s16 (vaddq_s16 (cl, cr), vaddq_s16 (al, ar));
+    gy = vaddq_s16 (gy, vshlq_n_s16 (vsubq_s16 (cm, am), 1));
+    m = vreinterpretq_u16_s16 (vaddq_s16 (vabsq_s16 (gx), vabsq_s16 (gy)));
+    vst1_u8 (mag + x, vshrn_n_u16 (m, 3));
+  }
+  gst_haar_sobel_row_c (a, b, c, x, width, width, mag);
+}
+#else
+static void
+gst_haar_sobel_row (const guint8 * a, const guint8 * b, const guint8 * c,
+    gint width, guint8 * mag)
+{
+  gst_haar_sobel_row_c (a, b, c, 0, width, width, mag);
+}
+#endif
+
+/* Integral of the Sobel magnitude, rows replicated at the borders. At most
+ * 255 per pixel, so it holds in 32 bits up to 8 megapixel images. */
+static void
+gst_haar_integral_edges (GstHaarIntegral * integral, const guint8 * src,
+    gint src_stride)
+{
+  gint width = integral->width;
+  gint height = integral->height;
+  gint stride = integral->stride;
+  guint8 *mag = (guint8 *) integral->buf;
+  gint x, y;
+
+  memset (integral->edges, 0, stride * sizeof (gint32));
+
+  for (y = 0; y < height; y++) {
+    const guint8 *b = src + y * src_stride;
+    const guint8 *a = y > 0 ? b - src_stride : b;
+    const guint8 *c = y < height - 1 ? b + src_stride : b;
+    gint32 *edges = integral->edges + (y + 1) * stride;
+    gint32 s = 0;
+
+    gst_haar_sobel_row (a, b, c, width, mag);
+
+    edges[0] = 0;
+    for (x = 0; x < width; x++) {
+      s += mag[x];
+      edges[x + 1] = edges[x + 1 - stride] + s;
+    }
+  }
+}
+
+void
+gst_haar_integral_compute (GstHaarIntegral * integral, const guint8 * src,
+    gint width, gint height, gint src_stride)
+{
+  const guint8 *row = src;
+  gint stride, y;
+
+  g_return_if_fail (integral != NULL);
+  g_return_if_fail (src != NULL && width > 0 && height > 0);
+
+  gst_haar_integral_ensure (integral, width, height);
+  stride = integral->stride;
+
+  memset (integral->sum, 0, stride * sizeof (gint32));
+  memset (integral->sqsum, 0, stride * sizeof (gint64));
+
+  for (y = 1; y <= height; y++, row += src_stride) {
+    gint32 *sum = integral->sum + y * stride;
+    gint64 *sqsum = integral->sqsum + y * stride;
+
+    sum[0] = 0;
+    sqsum[0] = 0;
+    gst_haar_integral_row (row, width, sum - stride + 1, sum + 1,
+        sqsum - stride + 1, sqsum + 1);
+  }
+
+  if (integral->tilted)
+    gst_haar_integral_tilted (integral, src, src_stride);
+  if (integral->edges)
+    gst_haar_integral_edges (integral, src, src_stride);
+}
@@ -0,0 +1,68 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarintegral.h: integral images for the native haar cascade engine
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAAR_INTEGRAL_H__
+#define __GST_HAAR_INTEGRAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstHaarIntegral GstHaarIntegral;
+
+/* Integral images of an 8 bit gray image, laid out exactly like the ones
+ * cvIntegral() builds: (width + 1) x (height + 1) entries with a zero first
+ * row and column, all the planes sharing the same row stride so that a
+ * single window offset addresses any of them.
+ */
+struct _GstHaarIntegral
+{
+  gint width;
+  gint height;
+  gint stride;                  /* in elements, >= width + 1 */
+
+  gint32 *sum;
+  gint64 *sqsum;
+  gint32 *tilted;               /* NULL unless created with tilted = TRUE */
+  gint32 *edges;                /* Sobel magnitude / 8, NULL unless enabled */
+
+  /* private */
+  gboolean with_tilted;
+  gboolean with_edges;
+  gint reserved_stride;
+  gsize allocated;
+  gint32 *buf;
+  gint buf_size;
+};
+
+GstHaarIntegral *gst_haar_integral_new (gboolean tilted);
+void gst_haar_integral_free (GstHaarIntegral * integral);
+
+void gst_haar_integral_set_edges (GstHaarIntegral * integral,
+    gboolean edges);
+void gst_haar_integral_reserve (GstHaarIntegral * integral,
+    gint max_width, gint max_height);
+
+void gst_haar_integral_compute (GstHaarIntegral * integral,
+    const guint8 * src, gint width, gint height, gint src_stride);
+
+G_END_DECLS
+#endif /* __GST_HAAR_INTEGRAL_H__ */
@@ -0,0 +1,362 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarresample.c: gray conversion and area downscaling of input frames
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "gsthaarresample.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#if defined (__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_HAAR_NEON 1
+#endif
+
+/* the fixed point weights of cvCvtColor (CV_RGB2GRAY), 14 bit fractions */
+#define R2Y 4899
+#define G2Y 9617
+#define B2Y 1868
+#define GRAY_SHIFT 14
+
+GstHaarResampler *
+gst_haar_resampler_new (void)
+{
+  return g_new0 (GstHaarResampler, 1);
+}
+
+void
+gst_haar_resampler_free (GstHaarResampler * resampler)
+{
+  if (!resampler)
+    return;
+
+  g_free (resampler->sums);
+  g_free (resampler->line);
+  g_free (resampler);
+}
+
+static void
+gst_haar_resampler_ensure (GstHaarResampler * resampler, gint width)
+{
+  if (width <= resampler->allocated)
+    return;
+
+  g_free (resampler->sums);
+  g_free (resampler->line);
+  resampler->sums = g_new (guint16, width);
+  resampler->line = g_new (guint8, width);
+  resampler->allocated = width;
+}
+
+/* RGB to gray conversion of one row */
+static inline void
+gst_haar_gray_row_c (const guint8 * src, gint x, gint width, guint8 * dst)
+{
+  for (; x < width; x++) {
+    const guint8 *p = src + 3 * x;
+
+    dst[x] = (p[0] * R2Y + p[1] * G2Y + p[2] * B2Y +
+        (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT;
+  }
+}
+
+#if defined (__SSE2__)
+/* 8 pixels of 16 bit R, G and B to 16 bit gray: (R, G) and (B, 1) pairs
+ * are multiplied with (R2Y, G2Y) and (B2Y, rounding) and summed */
+static inline __m128i
+gst_haar_gray8 (__m128i r, __m128i g, __m128i b)
+{
+  const __m128i wrg = _mm_set1_epi32 ((G2Y << 16) | R2Y);
+  const __m128i wb = _mm_set1_epi32 (((1 << (GRAY_SHIFT - 1)) << 16) | B2Y);
+  const __m128i one = _mm_set1_epi16 (1);
+  __m128i lo, hi;
+
+  lo = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (r, g), wrg),
+      _mm_madd_epi16 (_mm_unpacklo_epi16 (b, one), wb));
+  hi = _mm_add_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (r, g), wrg),
+      _mm_madd_epi16 (_mm_unpackhi_epi16 (b, one), wb));
+  return _mm_packs_epi32 (_mm_srli_epi32 (lo, GRAY_SHIFT),
+      _mm_srli_epi32 (hi, GRAY_SHIFT));
+}
+
+#if defined (__SSSE3__)
+/* picks the R, G and B bytes of 16 pixels out of the three 16 byte
+ * vectors they are spread over */
+static const gint8 gst_haar_rgb_shuffle[9][16] = {
+  {0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+  {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13},
+  {1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+  {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14},
+  {2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+  {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15},
+};
+
+static inline __m128i
+gst_haar_gather (__m128i a, __m128i b, __m128i c, gint channel)
+{
+  const __m128i *m = (const __m128i *) gst_haar_rgb_shuffle[3 * channel];
+
+  return _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (a,
+              _mm_loadu_si128 (m)), _mm_shuffle_epi8 (b,
+              _mm_loadu_si128 (m + 1))), _mm_shuffle_epi8 (c,
+          _mm_loadu_si128 (m + 2)));
+}
+
+static void
+gst_haar_gray_row (const guint8 * src, gint width, guint8 * dst)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    const __m128i *p = (const __m128i *) (src + 3 * x);
+    __m128i a = _mm_loadu_si128 (p);
+    __m128i b = _mm_loadu_si128 (p + 1);
+    __m128i c = _mm_loadu_si128 (p + 2);
+    __m128i r = gst_haar_gather (a, b, c, 0);
+    __m128i g = gst_haar_gather (a, b, c, 1);
+    __m128i bl = gst_haar_gather (a, b, c, 2);
+    __m128i lo = gst_haar_gray8 (_mm_unpacklo_epi8 (r, zero),
+        _mm_unpacklo_epi8 (g, zero), _mm_unpacklo_epi8 (bl, zero));
+    __m128i hi = gst_haar_gray8 (_mm_unpackhi_epi8 (r, zero),
+        _mm_unpackhi_epi8 (g, zero), _mm_unpackhi_epi8 (bl, zero));
+
+    _mm_storeu_si128 ((__m128i *) (dst + x), _mm_packus_epi16 (lo, hi));
+  }
+
+  gst_haar_gray_row_c (src, x, width, dst);
+}
+#else
+/* Splits 32 RGB pixels, in six consecutive 16 byte vectors, into
+ * R, G and B halves: five rounds of interleaving vector k with vector
+ * k + 3 leave v[0], v[1] with R, v[2], v[3] with G and v[4], v[5] with B */
+static inline void
+gst_haar_deinterleave (__m128i * v)
+{
+  __m128i t[6];
+  gint round, k;
+
+  for (round = 0; round < 5; round++) {
+    for (k = 0; k < 3; k++) {
+      t[2 * k] = _mm_unpacklo_epi8 (v[k], v[k + 3]);
+      t[2 * k + 1] = _mm_unpackhi_epi8 (v[k], v[k + 3]);
+    }
+    for (k = 0; k < 6; k++)
+      v[k] = t[k];
+  }
+}
+
+/* without SSSE3 byte shuffles the channels are split by interleaving,
+ * 32 pixels at a time */
+static void
+gst_haar_gray_row (const guint8 * src, gint width, guint8 * dst)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint x, k;
+
+  for (x = 0; x + 32 <= width; x += 32) {
+    const __m128i *p = (const __m128i *) (src + 3 * x);
+    __m128i v[6];
+
+    for (k = 0; k < 6; k++)
+      v[k] = _mm_loadu_si128 (p + k);
+    gst_haar_deinterleave (v);
+
+    for (k = 0; k < 2; k++) {
+      __m128i lo = gst_haar_gray8 (_mm_unpacklo_epi8 (v[k], zero),
+          _mm_unpacklo_epi8 (v[k + 2], zero),
+          _mm_unpacklo_epi8 (v[k + 4], zero));
+      __m128i hi = gst_haar_gray8 (_mm_unpackhi_epi8 (v[k], zero),
+          _mm_unpackhi_epi8 (v[k + 2], zero),
+          _mm_unpackhi_epi8 (v[k + 4], zero));
+
+      _mm_storeu_si128 ((__m128i *) (dst + x + 16 * k),
+          _mm_packus_epi16 (lo, hi));
+    }
+  }
+
+  gst_haar_gray_row_c (src, x, width, dst);
+}
+#endif
+#elif defined (HAVE_HAAR_NEON)
+static void
+gst_haar_gray_row (const guint8 * src, gint width, guint8 * dst)
+{
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint8x8x3_t v = vld3_u8 (src + 3 * x);
+    uint16x8_t r = vmovl_u8 (v.val[0]);
+    uint16x8_t g = vmovl_u8 (v.val[1]);
+    uint16x8_t b = vmovl_u8 (v.val[2]);
+    uint32x4_t lo = vdupq_n_u32 (1 << (GRAY_SHIFT - 1));
+    uint32x4_t hi = lo;
+
+    lo = vmlal_n_u16 (lo, vget_low_u16 (r), R2Y);
+    lo = vmlal_n_u16 (lo, vget_low_u16 (g), G2Y);
+    lo = vmlal_n_u16 (lo, vget_low_u16 (b), B2Y);
+    hi = vmlal_n_u16 (hi, vget_high_u16 (r), R2Y);
+    hi = vmlal_n_u16 (hi, vget_high_u16 (g), G2Y);
+    hi = vmlal_n_u16 (hi, vget_high_u16 (b), B2Y);
+    vst1_u8 (dst + x, vmovn_u16 (vcombine_u16 (vshrn_n_u32 (lo, GRAY_SHIFT),
+                vshrn_n_u32 (hi, GRAY_SHIFT))));
+  }
+
+  gst_haar_gray_row_c (src, x, width, dst);
+}
+#else
+static void
+gst_haar_gray_row (const guint8 * src, gint width, guint8 * dst)
+{
+  gst_haar_gray_row_c (src, 0, width, dst);
+}
+#endif
+
+/* adds one row of luma, every @step bytes, to the column sums */
+static inline void
+gst_haar_accumulate_row_c (const guint8 * src, gint x, gint width,
+    gint step, guint16 * sums)
+{
+  for (; x < width; x++)
+    sums[x] += src[x * step];
+}
+
+#if defined (__SSE2__)
+static void
+gst_haar_accumulate_row (const guint8 * src, gint width, gint step,
+    guint16 * sums)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i luma = _mm_set1_epi16 (0x00ff);
+  gint x = 0;
+
+  if (step == 1) {
+    for (; x + 16 <= width; x += 16) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + x));
+      __m128i *s = (__m128i *) (sums + x);
+
+      _mm_storeu_si128 (s, _mm_add_epi16 (_mm_loadu_si128 (s),
+              _mm_unpacklo_epi8 (v, zero)));
+      _mm_storeu_si128 (s + 1, _mm_add_epi16 (_mm_loadu_si128 (s + 1),
+              _mm_unpackhi_epi8 (v, zero)));
+    }
+  } else {
+    /* YUY2, the even bytes are the luma of 8 pixels */
+    for (; x + 8 <= width; x += 8) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + 2 * x));
+      __m128i *s = (__m128i *) (sums + x);
+
+      _mm_storeu_si128 (s, _mm_add_epi16 (_mm_loadu_si128 (s),
+              _mm_and_si128 (v, luma)));
+    }
+  }
+
+  gst_haar_accumulate_row_c (src, x, width, step, sums);
+}
+#elif defined (HAVE_HAAR_NEON)
+static void
+gst_haar_accumulate_row (const guint8 * src, gint width, gint step,
+    guint16 * sums)
+{
+  gint x = 0;
+
+  if (step == 1) {
+    for (; x + 8 <= width; x += 8)
+      vst1q_u16 (sums + x, vaddw_u8 (vld1q_u16 (sums + x), vld1_u8 (src + x)));
+  } else {
+    for (; x + 8 <= width; x += 8)
+      vst1q_u16 (sums + x, vaddw_u8 (vld1q_u16 (sums + x),
+              vld2_u8 (src + 2 * x).val[0]));
+  }
+
+  gst_haar_accumulate_row_c (src, x, width, step, sums);
+}
+#else
+static void
+gst_haar_accumulate_row (const guint8 * src, gint width, gint step,
+    guint16 * sums)
+{
+  gst_haar_accumulate_row_c (src, 0, width, step, sums);
+}
+#endif
+
+/* averages @factor x @factor blocks of the column sums, rounded */
+static void
+gst_haar_resampler_emit (const guint16 * sums, gint width, gint factor,
+    guint8 * dst)
+{
+  guint n = factor * factor;
+  gint x, k;
+
+  for (x = 0; x < width; x++) {
+    const guint16 *s = sums + x * factor;
+    guint v = 0;
+
+    for (k = 0; k < factor; k++)
+      v += s[k];
+    dst[x] = (v + n / 2) / n;
+  }
+}
+
+void
+gst_haar_resampler_process (GstHaarResampler * resampler,
+    const guint8 * src, gint width, gint height, gint src_stride,
+    GstHaarPixel pixel, gint factor, guint8 * dst, gint dst_stride)
+{
+  gint out_width, out_height, used;
+  gint y, k;
+
+  g_return_if_fail (resampler != NULL);
+  g_return_if_fail (factor >= 1 && factor <= GST_HAAR_MAX_DOWNSCALE);
+
+  out_width = width / factor;
+  out_height = height / factor;
+  used = out_width * factor;
+  gst_haar_resampler_ensure (resampler, used);
+
+  for (y = 0; y < out_height; y++) {
+    memset (resampler->sums, 0, used * sizeof (guint16));
+    for (k = 0; k < factor; k++) {
+      const guint8 *row = src + (gsize) (y * factor + k) * src_stride;
+
+      switch (pixel) {
+        case GST_HAAR_PIXEL_RGB:
+          gst_haar_gray_row (row, used, resampler->line);
+          gst_haar_accumulate_row (resampler->line, used, 1, resampler->sums);
+          break;
+        case GST_HAAR_PIXEL_YUY2:
+          gst_haar_accumulate_row (row, used, 2, resampler->sums);
+          break;
+        default:
+          gst_haar_accumulate_row (row, used, 1, resampler->sums);
+          break;
+      }
+    }
+    gst_haar_resampler_emit (resampler->sums, out_width, factor,
+        dst + (gsize) y * dst_stride);
+  }
+}
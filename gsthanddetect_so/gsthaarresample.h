@@ -0,0 +1,64 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarresample.h: gray conversion and area downscaling of input frames
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAAR_RESAMPLE_H__
+#define __GST_HAAR_RESAMPLE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the largest supported downscale factor, keeps the column sums in 16 bits */
+#define GST_HAAR_MAX_DOWNSCALE 16
+
+typedef struct _GstHaarResampler GstHaarResampler;
+
+typedef enum
+{
+  GST_HAAR_PIXEL_GRAY,          /* 8 bit luma */
+  GST_HAAR_PIXEL_YUY2,          /* luma in the even bytes */
+  GST_HAAR_PIXEL_RGB            /* packed 24 bit R, G, B */
+} GstHaarPixel;
+
+/* Turns a frame into a gray image @factor times smaller in both directions
+ * in a single pass: every source row is converted to gray (the same
+ * weights and rounding as cvCvtColor (CV_RGB2GRAY) for RGB) and added to
+ * per column sums, every @factor rows the sums of @factor x @factor blocks
+ * are averaged into a destination row. Trailing partial blocks are
+ * dropped, as in an area cvResize () to width / factor x height / factor.
+ */
+struct _GstHaarResampler
+{
+  /* private */
+  guint16 *sums;
+  guint8 *line;
+  gint allocated;
+};
+
+GstHaarResampler *gst_haar_resampler_new (void);
+void gst_haar_resampler_free (GstHaarResampler * resampler);
+
+void gst_haar_resampler_process (GstHaarResampler * resampler,
+    const guint8 * src, gint width, gint height, gint src_stride,
+    GstHaarPixel pixel, gint factor, guint8 * dst, gint dst_stride);
+
+G_END_DECLS
+#endif /* __GST_HAAR_RESAMPLE_H__ */
@@ -0,0 +1,329 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthaarsimd.h: vector primitives of the native cascade evaluators
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Private to the evaluators: gsthaarcascade.c and the ones gst-haar-convert
+ * generates. HAAR_LANES windows are evaluated at a time, their offsets in
+ * the integral images given by a HaarIdx.
+ */
+
+#ifndef __GST_HAAR_SIMD_H__
+#define __GST_HAAR_SIMD_H__
+
+#include <glib.h>
+
+/* The results must match the legacy evaluator's window for window, which
+ * rounds every product: keep the compiler from fusing them into the
+ * following adds when the target has FMA. */
+#if defined (__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined (__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+
+#define HAAR_LANES 8
+typedef __m256 HaarVec;
+typedef __m256i HaarIdx;
+
+#define haar_vec_load(p) _mm256_loadu_ps (p)
+#define haar_vec_store(p, v) _mm256_storeu_ps (p, v)
+#define haar_vec_set1(v) _mm256_set1_ps (v)
+#define haar_vec_zero() _mm256_setzero_ps ()
+#define haar_vec_add(a, b) _mm256_add_ps (a, b)
+#define haar_vec_mul(a, b) _mm256_mul_ps (a, b)
+#define haar_vec_select_lt(a, b, x, y) \
+    _mm256_blendv_ps (y, x, _mm256_cmp_ps (a, b, _CMP_LT_OQ))
+#define haar_vec_mask_ge(a, b) \
+    _mm256_movemask_ps (_mm256_cmp_ps (a, b, _CMP_GE_OQ))
+#define haar_idx_load(p) _mm256_loadu_si256 ((const __m256i *) (p))
+
+static inline HaarVec
+haar_rect_sum (const gint32 * img, HaarIdx idx, const gint32 * o)
+{
+  __m256i p0 = _mm256_i32gather_epi32 ((const int *) (img + o[0]), idx, 4);
+  __m256i p1 = _mm256_i32gather_epi32 ((const int *) (img + o[1]), idx, 4);
+  __m256i p2 = _mm256_i32gather_epi32 ((const int *) (img + o[2]), idx, 4);
+  __m256i p3 = _mm256_i32gather_epi32 ((const int *) (img + o[3]), idx, 4);
+
+  return _mm256_cvtepi32_ps (_mm256_add_epi32 (_mm256_sub_epi32 (p0, p1),
+          _mm256_sub_epi32 (p3, p2)));
+}
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+
+#define HAAR_LANES 4
+typedef __m128 HaarVec;
+typedef const gint32 *HaarIdx;
+
+#define haar_vec_load(p) _mm_loadu_ps (p)
+#define haar_vec_store(p, v) _mm_storeu_ps (p, v)
+#define haar_vec_set1(v) _mm_set1_ps (v)
+#define haar_vec_zero() _mm_setzero_ps ()
+#define haar_vec_add(a, b) _mm_add_ps (a, b)
+#define haar_vec_mul(a, b) _mm_mul_ps (a, b)
+#define haar_vec_select_lt(a, b, x, y) \
+    haar_vec_blend (_mm_cmplt_ps (a, b), x, y)
+#define haar_vec_mask_ge(a, b) _mm_movemask_ps (_mm_cmpge_ps (a, b))
+#define haar_idx_load(p) (p)
+
+static inline HaarVec
+haar_vec_blend (__m128 mask, __m128 x, __m128 y)
+{
+  return _mm_or_ps (_mm_and_ps (mask, x), _mm_andnot_ps (mask, y));
+}
+
+static inline HaarVec
+haar_rect_sum (const gint32 * img, HaarIdx idx, const gint32 * o)
+{
+  const gint32 *p0 = img + idx[0], *p1 = img + idx[1];
+  const gint32 *p2 = img + idx[2], *p3 = img + idx[3];
+
+  return _mm_cvtepi32_ps (_mm_set_epi32 (
+          p3[o[0]] - p3[o[1]] - p3[o[2]] + p3[o[3]],
+          p2[o[0]] - p2[o[1]] - p2[o[2]] + p2[o[3]],
+          p1[o[0]] - p1[o[1]] - p1[o[2]] + p1[o[3]],
+          p0[o[0]] - p0[o[1]] - p0[o[2]] + p0[o[3]]));
+}
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+
+#define HAAR_LANES 4
+typedef float32x4_t HaarVec;
+typedef const gint32 *HaarIdx;
+
+#define haar_vec_load(p) vld1q_f32 (p)
+#define haar_vec_store(p, v) vst1q_f32 (p, v)
+#define haar_vec_set1(v) vdupq_n_f32 (v)
+#define haar_vec_zero() vdupq_n_f32 (0.0f)
+#define haar_vec_add(a, b) vaddq_f32 (a, b)
+#define haar_vec_mul(a, b) vmulq_f32 (a, b)
+#define haar_vec_select_lt(a, b, x, y) vbslq_f32 (vcltq_f32 (a, b), x, y)
+#define haar_vec_mask_ge(a, b) haar_vec_movemask (vcgeq_f32 (a, b))
+#define haar_idx_load(p) (p)
+
+static inline gint
+haar_vec_movemask (uint32x4_t m)
+{
+  static const gint32 bits[4] = { 1, 2, 4, 8 };
+  uint32x4_t b = vandq_u32 (m, vreinterpretq_u32_s32 (vld1q_s32 (bits)));
+  uint32x2_t s = vadd_u32 (vget_low_u32 (b), vget_high_u32 (b));
+
+  return vget_lane_u32 (vpadd_u32 (s, s), 0);
+}
+
+static inline HaarVec
+haar_rect_sum (const gint32 * img, HaarIdx idx, const gint32 * o)
+{
+  gint32 v[4];
+  gint l;
+
+  for (l = 0; l < 4; l++) {
+    const gint32 *p = img + idx[l];
+    v[l] = p[o[0]] - p[o[1]] - p[o[2]] + p[o[3]];
+  }
+  return vcvtq_f32_s32 (vld1q_s32 (v));
+}
+#else
+#define HAAR_LANES 1
+typedef gfloat HaarVec;
+typedef const gint32 *HaarIdx;
+
+#define haar_vec_load(p) (*(p))
+#define haar_vec_store(p, v) (*(p) = (v))
+#define haar_vec_set1(v) (v)
+#define haar_vec_zero() 0.0f
+#define haar_vec_add(a, b) ((a) + (b))
+#define haar_vec_mul(a, b) ((a) * (b))
+#define haar_vec_select_lt(a, b, x, y) ((a) < (b) ? (x) : (y))
+#define haar_vec_mask_ge(a, b) ((a) >= (b))
+#define haar_idx_load(p) (p)
+
+static inline HaarVec
+haar_rect_sum (const gint32 * img, HaarIdx idx, const gint32 * o)
+{
+  const gint32 *p = img + idx[0];
+
+  return (gfloat) (p[o[0]] - p[o[1]] - p[o[2]] + p[o[3]]);
+}
+#endif
+
+#define HAAR_LANE_MASK ((1 << HAAR_LANES) - 1)
+
+/* the same on 32 bit integer lanes for the fixed point evaluator; the
+ * rectangle sums are rounded and shifted right by @shift */
+#if defined (__AVX2__)
+typedef __m256i HaarIVec;
+
+#define haar_ivec_load(p) _mm256_loadu_si256 ((const __m256i *) (p))
+#define haar_ivec_store(p, v) _mm256_storeu_si256 ((__m256i *) (p), v)
+#define haar_ivec_set1(v) _mm256_set1_epi32 (v)
+#define haar_ivec_zero() _mm256_setzero_si256 ()
+#define haar_ivec_add(a, b) _mm256_add_epi32 (a, b)
+#define haar_ivec_mul(a, b) _mm256_mullo_epi32 (a, b)
+#define haar_ivec_sra(a, n) _mm256_sra_epi32 (a, _mm_cvtsi32_si128 (n))
+#define haar_ivec_select_lt(a, b, x, y) \
+    _mm256_blendv_epi8 (y, x, _mm256_cmpgt_epi32 (b, a))
+#define haar_ivec_mask_ge(a, b) \
+    (~_mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpgt_epi32 (b, a))))
+
+static inline HaarIVec
+haar_rect_isum (const gint32 * img, HaarIdx idx, const gint32 * o, gint shift)
+{
+  __m256i p0 = _mm256_i32gather_epi32 ((const int *) (img + o[0]), idx, 4);
+  __m256i p1 = _mm256_i32gather_epi32 ((const int *) (img + o[1]), idx, 4);
+  __m256i p2 = _mm256_i32gather_epi32 ((const int *) (img + o[2]), idx, 4);
+  __m256i p3 = _mm256_i32gather_epi32 ((const int *) (img + o[3]), idx, 4);
+  __m256i v = _mm256_add_epi32 (_mm256_sub_epi32 (p0, p1),
+      _mm256_sub_epi32 (p3, p2));
+
+  return haar_ivec_sra (_mm256_add_epi32 (v,
+          _mm256_set1_epi32 ((1 << shift) >> 1)), shift);
+}
+#elif defined (__SSE2__)
+typedef __m128i HaarIVec;
+
+#define haar_ivec_load(p) _mm_loadu_si128 ((const __m128i *) (p))
+#define haar_ivec_store(p, v) _mm_storeu_si128 ((__m128i *) (p), v)
+#define haar_ivec_set1(v) _mm_set1_epi32 (v)
+#define haar_ivec_zero() _mm_setzero_si128 ()
+#define haar_ivec_add(a, b) _mm_add_epi32 (a, b)
+#define haar_ivec_mul(a, b) haar_ivec_mullo (a, b)
+#define haar_ivec_sra(a, n) _mm_sra_epi32 (a, _mm_cvtsi32_si128 (n))
+#define haar_ivec_select_lt(a, b, x, y) \
+    haar_ivec_blend (_mm_cmplt_epi32 (a, b), x, y)
+#define haar_ivec_mask_ge(a, b) \
+    (~_mm_movemask_ps (_mm_castsi128_ps (_mm_cmplt_epi32 (a, b))))
+
+/* SSE2 has no 32 bit multiply, the low halves of two 64 bit ones */
+static inline HaarIVec
+haar_ivec_mullo (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32 (a, b);
+  __m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (a, 32), _mm_srli_epi64 (b, 32));
+
+  return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2,
+              0)), _mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+
+static inline HaarIVec
+haar_ivec_blend (__m128i mask, __m128i x, __m128i y)
+{
+  return _mm_or_si128 (_mm_and_si128 (mask, x), _mm_andnot_si128 (mask, y));
+}
+
+static inline HaarIVec
+haar_rect_isum (const gint32 * img, HaarIdx idx, const gint32 * o, gint shift)
+{
+  const gint32 *p0 = img + idx[0], *p1 = img + idx[1];
+  const gint32 *p2 = img + idx[2], *p3 = img + idx[3];
+  __m128i v = _mm_set_epi32 (p3[o[0]] - p3[o[1]] - p3[o[2]] + p3[o[3]],
+      p2[o[0]] - p2[o[1]] - p2[o[2]] + p2[o[3]],
+      p1[o[0]] - p1[o[1]] - p1[o[2]] + p1[o[3]],
+      p0[o[0]] - p0[o[1]] - p0[o[2]] + p0[o[3]]);
+
+  return haar_ivec_sra (_mm_add_epi32 (v, _mm_set1_epi32 ((1 << shift) >> 1)),
+      shift);
+}
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+typedef int32x4_t HaarIVec;
+
+#define haar_ivec_load(p) vld1q_s32 (p)
+#define haar_ivec_store(p, v) vst1q_s32 (p, v)
+#define haar_ivec_set1(v) vdupq_n_s32 (v)
+#define haar_ivec_zero() vdupq_n_s32 (0)
+#define haar_ivec_add(a, b) vaddq_s32 (a, b)
+#define haar_ivec_mul(a, b) vmulq_s32 (a, b)
+#define haar_ivec_sra(a, n) vshlq_s32 (a, vdupq_n_s32 (-(n)))
+#define haar_ivec_select_lt(a, b, x, y) vbslq_s32 (vcltq_s32 (a, b), x, y)
+#define haar_ivec_mask_ge(a, b) haar_vec_movemask (vcgeq_s32 (a, b))
+
+static inline HaarIVec
+haar_rect_isum (const gint32 * img, HaarIdx idx, const gint32 * o, gint shift)
+{
+  gint32 v[4];
+  gint l;
+
+  for (l = 0; l < 4; l++) {
+    const gint32 *p = img + idx[l];
+    v[l] = p[o[0]] - p[o[1]] - p[o[2]] + p[o[3]] + ((1 << shift) >> 1);
+  }
+  return haar_ivec_sra (vld1q_s32 (v), shift);
+}
+#else
+typedef gint32 HaarIVec;
+
+#define haar_ivec_load(p) (*(p))
+#define haar_ivec_store(p, v) (*(p) = (v))
+#define haar_ivec_set1(v) (v)
+#define haar_ivec_zero() 0
+#define haar_ivec_add(a, b) ((a) + (b))
+#define haar_ivec_mul(a, b) ((a) * (b))
+#define haar_ivec_sra(a, n) ((a) >> (n))
+#define haar_ivec_select_lt(a, b, x, y) ((a) < (b) ? (x) : (y))
+#define haar_ivec_mask_ge(a, b) ((a) >= (b))
+
+static inline HaarIVec
+haar_rect_isum (const gint32 * img, HaarIdx idx, const gint32 * o, gint shift)
+{
+  const gint32 *p = img + idx[0];
+
+  return (p[o[0]] - p[o[1]] - p[o[2]] + p[o[3]] + ((1 << shift) >> 1)) >>
+      shift;
+}
+#endif
+
+/* adds the leaf value of a stump to @acc, the node taking @n_rects
+ * rectangles at @o with weights @w */
+static inline HaarVec
+haar_stump (HaarVec acc, const gint32 * img, HaarIdx idx, HaarVec vnorm,
+    const gint32 * o, const gfloat * w, gint n_rects, gfloat threshold,
+    gfloat a0, gfloat a1)
+{
+  HaarVec sum, t;
+
+  sum = haar_vec_mul (haar_rect_sum (img, idx, o), haar_vec_set1 (w[0]));
+  sum = haar_vec_add (sum, haar_vec_mul (haar_rect_sum (img, idx, o + 4),
+          haar_vec_set1 (w[1])));
+  if (n_rects > 2)
+    sum = haar_vec_add (sum, haar_vec_mul (haar_rect_sum (img, idx, o + 8),
+            haar_vec_set1 (w[2])));
+
+  t = haar_vec_mul (haar_vec_set1 (threshold), vnorm);
+  return haar_vec_add (acc, haar_vec_select_lt (sum, t, haar_vec_set1 (a0),
+          haar_vec_set1 (a1)));
+}
+
+/* the weighted sum of a node for the single window at @img */
+static inline gfloat
+haar_node_sum (const gint32 * img, const gint32 * o, const gfloat * w,
+    gint n_rects)
+{
+  gfloat sum = 0;
+  gint r;
+
+  for (r = 0; r < n_rects; r++, o += 4)
+    sum += (img[o[0]] - img[o[1]] - img[o[2]] + img[o[3]]) * w[r];
+  return sum;
+}
+
+#endif /* __GST_HAAR_SIMD_H__ */
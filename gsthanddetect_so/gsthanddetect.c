@@ -62,19 +62,67 @@
 #include <gst/interfaces/navigation.h>
 /* element header */
 #include "gsthanddetect.h"
+#include "gsthanddetectmux.h"
 /* gst & opencv */
 #include <gst/gst.h>
 #include <gst/video/video.h>
 #include "gstopencvutils.h"
+#include <string.h>
 /* debugging */
 #include <gst/gstinfo.h>
+/* profile directory watch */
+#if defined (__linux__)
+#define HAVE_INOTIFY 1
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
 
 GST_DEBUG_CATEGORY_STATIC (gst_handdetect_debug);
 #define GST_CAT_DEFAULT gst_handdetect_debug
 
-/* define HAAR files */
-#define HAAR_FILE "/usr/local/share/opencv/haarcascades/fist.xml"
-#define HAAR_FILE_PALM "/usr/local/share/opencv/haarcascades/palm.xml"
+#define DEFAULT_ENGINE GST_HANDDETECT_ENGINE_LEGACY
+#define DEFAULT_N_THREADS 1
+#define MAX_N_THREADS 64
+#define DEFAULT_FIXED_POINT FALSE
+#define DEFAULT_PRUNE_EDGES 0.
+#define DEFAULT_PRUNE_STDDEV 0.
+#define DEFAULT_HISTORY_REFRESH 0
+#define DEFAULT_HISTORY_DEPTH 6
+#define DEFAULT_MOTION_GATE FALSE
+#define DEFAULT_MOTION_THRESHOLD 5
+#define DEFAULT_TRACKING FALSE
+#define DEFAULT_KEYFRAME_INTERVAL 10
+#define DEFAULT_ROI_SEARCH FALSE
+#define DEFAULT_WATCH_PROFILES FALSE
+#define DEFAULT_DETECT_WIDTH 320
+#define DEFAULT_DETECT_HEIGHT 240
+#define DEFAULT_ASYNC FALSE
+#define DEFAULT_FRAMES_IN_FLIGHT 0
+#define MAX_FRAMES_IN_FLIGHT 64
+#define DEFAULT_POST_MESSAGES TRUE
+#define DEFAULT_MESSAGE_INTERVAL 0
+#define DEFAULT_MIN_HITS GST_HAND_TRACKS_MIN_HITS
+#define DEFAULT_MAX_MISSES GST_HAND_TRACKS_MAX_MISSES
+#define DEFAULT_MAX_HANDS GST_HAND_TRACKS_MAX_TRACKS
+#define DEFAULT_GESTURES FALSE
+#define DEFAULT_OVERLAY FALSE
+
+/* the overlay markers: MARKER_SIZE square, lines MARKER_LINE thick */
+#define MARKER_SIZE 64
+#define MARKER_LINE 2
+
+/* labels of the objects found in frame-parallel mode and tracked */
+#define FRAME_LABEL_FIST 0
+#define FRAME_LABEL_PALM 1
+
+/* local search around the predicted hand: the window spans the hand plus
+ * TRACK_MARGIN hand sizes and three standard deviations of the prediction
+ * on each side, scales within TRACK_SCALE_RANGE of the predicted size
+ * widened by three deviations */
+#define TRACK_MARGIN 0.5
+#define TRACK_SCALE_RANGE 1.25
 
 /* Filter signals and args */
 enum
@@ -87,30 +135,104 @@ enum
 {
   PROP_0,
   PROP_DISPLAY,
+  PROP_OVERLAY,
   PROP_PROFILE,
   PROP_PROFILE_PALM,
   PROP_ROI_X,
   PROP_ROI_Y,
   PROP_ROI_WIDTH,
-  PROP_ROI_HEIGHT
+  PROP_ROI_HEIGHT,
+  PROP_ENGINE,
+  PROP_N_THREADS,
+  PROP_FIXED_POINT,
+  PROP_PRUNE_EDGES,
+  PROP_PRUNE_STDDEV,
+  PROP_HISTORY_REFRESH,
+  PROP_HISTORY_DEPTH,
+  PROP_STATS,
+  PROP_MOTION_GATE,
+  PROP_MOTION_THRESHOLD,
+  PROP_TRACKING,
+  PROP_KEYFRAME_INTERVAL,
+  PROP_ROI_SEARCH,
+  PROP_WATCH_PROFILES,
+  PROP_DETECT_WIDTH,
+  PROP_DETECT_HEIGHT,
+  PROP_ASYNC,
+  PROP_FRAMES_IN_FLIGHT,
+  PROP_POST_MESSAGES,
+  PROP_MESSAGE_INTERVAL,
+  PROP_MIN_HITS,
+  PROP_MAX_MISSES,
+  PROP_MAX_HANDS,
+  PROP_GESTURES
 };
 
-/* the capabilities of the inputs and outputs */
+#define GST_TYPE_HANDDETECT_ENGINE (gst_handdetect_engine_get_type ())
+static GType
+gst_handdetect_engine_get_type (void)
+{
+  static GType engine_type = 0;
+  static const GEnumValue engines[] = {
+    {GST_HANDDETECT_ENGINE_LEGACY, "OpenCV cvHaarDetectObjects", "legacy"},
+    {GST_HANDDETECT_ENGINE_NATIVE, "Built-in SIMD cascade evaluator",
+        "native"},
+    {0, NULL, NULL},
+  };
+
+  if (!engine_type)
+    engine_type = g_enum_register_static ("GstHanddetectEngine", engines);
+  return engine_type;
+}
+
+/* the capabilities of the inputs and outputs
+ * YUV and GRAY8 frames are detected on their luma plane without any
+ * colour conversion, the markers are drawn in the same format */
+#define HANDDETECT_CAPS \
+    GST_VIDEO_CAPS_RGB "; " \
+    GST_VIDEO_CAPS_YUV ("{ I420, NV12, YUY2 }") "; " \
+    GST_VIDEO_CAPS_GRAY8
+
 static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_RGB)
+    GST_STATIC_CAPS (HANDDETECT_CAPS)
     );
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_RGB)
+    GST_STATIC_CAPS (HANDDETECT_CAPS)
     );
 
+/* how the planes of the non RGB formats are drawn into: the component
+ * the plane starts with, the components of its channels (0 Y, 1 U, 2 V)
+ * and its subsampling */
+typedef struct
+{
+  GstVideoFormat format;
+  gint component;
+  gint channels;
+  gint sx, sy;
+  gint comp[4];
+} GstHanddetectPlaneInfo;
+
+static const GstHanddetectPlaneInfo plane_infos[] = {
+  {GST_VIDEO_FORMAT_GRAY8, 0, 1, 0, 0, {0}},
+  {GST_VIDEO_FORMAT_I420, 0, 1, 0, 0, {0}},
+  {GST_VIDEO_FORMAT_I420, 1, 1, 1, 1, {1}},
+  {GST_VIDEO_FORMAT_I420, 2, 1, 1, 1, {2}},
+  {GST_VIDEO_FORMAT_NV12, 0, 1, 0, 0, {0}},
+  {GST_VIDEO_FORMAT_NV12, 1, 2, 1, 1, {1, 2}},
+  /* Y0 U Y1 V macropixels, drawn at half the horizontal resolution */
+  {GST_VIDEO_FORMAT_YUY2, 0, 4, 1, 0, {0, 1, 0, 2}},
+};
+
 static void gst_handdetect_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_handdetect_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
+static gboolean gst_handdetect_set_video_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
 static gboolean gst_handdetect_set_caps (GstOpencvVideoFilter * transform,
     gint in_width, gint in_height, gint in_depth, gint in_channels,
     gint out_width, gint out_height, gint out_depth, gint out_channels);
@@ -118,6 +240,59 @@ static GstFlowReturn gst_handdetect_transform_ip (GstOpencvVideoFilter *
     transform, GstBuffer * buffer, IplImage * img);
 
 static void gst_handdetect_load_profile (GstHanddetect * filter);
+static void gst_handdetect_load_profiles (gpointer data, gpointer user_data);
+static void gst_handdetect_wait_profiles (GstHanddetect * filter);
+static void gst_handdetect_update_profiles (GstHanddetect * filter);
+static void gst_handdetect_free_retired (GstHanddetect * filter);
+static void gst_handdetect_profiles_free (GstHanddetectProfiles * profiles);
+static void gst_handdetect_set_watch (GstHanddetect * filter,
+    gboolean watch);
+static CvSeq *gst_handdetect_detect (GstHanddetect * filter, IplImage * gray,
+    const CvRect * region, CvSize min_size, CvSize max_size, CvSeq ** palms);
+static void gst_handdetect_process (GstHanddetect * filter, IplImage * gray,
+    GstClockTime timestamp);
+static void gst_handdetect_queue_frame (GstHanddetect * filter,
+    GstClockTime timestamp);
+static void gst_handdetect_stop_worker (GstHanddetect * filter);
+static void gst_handdetect_report (GstHanddetect * filter, CvSeq * hands,
+    CvSeq * palms, GstClockTime timestamp);
+static void gst_handdetect_reset_tracks (GstHanddetect * filter);
+static void gst_handdetect_apply_tracks_reset (GstHanddetect * filter);
+static gboolean gst_handdetect_motion_gate (GstHanddetect * filter,
+    IplImage * gray, CvRect * moved);
+static void gst_handdetect_post_gestures (GstHanddetect * filter,
+    GstClockTime timestamp);
+static GstFlowReturn gst_handdetect_queue_parallel (GstHanddetect * filter,
+    GstBuffer * buffer);
+static GstFlowReturn gst_handdetect_push_frames (GstHanddetect * filter,
+    guint keep);
+static void gst_handdetect_drop_frames (GstHanddetect * filter);
+static void gst_handdetect_free_frames (GstHanddetect * filter);
+static void gst_handdetect_detect_frame (gpointer data, gpointer user_data);
+static gboolean gst_handdetect_sink_event (GstBaseTransform * trans,
+    GstEvent * event);
+static gboolean gst_handdetect_stop (GstBaseTransform * trans);
+static gboolean gst_handdetect_in_roi (GstHanddetect * filter,
+    const CvRect * r);
+static void gst_handdetect_post_hand (GstHanddetect * filter,
+    const gchar * gesture, const CvRect * r, guint track_id,
+    GstClockTime timestamp);
+static void gst_handdetect_setup_planes (GstHanddetect * filter, gint width,
+    gint height);
+static void gst_handdetect_gather_luma (IplImage * gray, const guint8 * src,
+    gint stride);
+static GstFlowReturn gst_handdetect_push_result (GstHanddetect * filter,
+    GstBuffer * buffer, gint shared, const GstHanddetectResult * result);
+static void gst_handdetect_draw_hand (GstHanddetect * filter,
+    GstBuffer * buffer, const CvRect * r, gboolean circle, CvScalar color);
+static void gst_handdetect_draw_result (GstHanddetect * filter,
+    GstBuffer * buffer, const GstHanddetectResult * result);
+static GstBuffer *gst_handdetect_marker_new (gboolean circle, guint32 argb);
+static GstVideoOverlayComposition *gst_handdetect_overlay_result (GstHanddetect
+    * filter, GstVideoOverlayComposition * base,
+    const GstHanddetectResult * result);
+static gboolean gst_handdetect_tracks_window (GstHanddetect * filter,
+    CvRect * window, CvSize * min_size, CvSize * max_size);
 
 static void gst_handdetect_init_interfaces (GType type);
 static void
@@ -241,10 +416,37 @@ gst_handdetect_finalise (GObject * obj)
 {
   GstHanddetect *filter = GST_HANDDETECT (obj);
 
+  gst_handdetect_stop_worker (filter);
+  gst_handdetect_free_retired (filter);
+  gst_handdetect_free_frames (filter);
+  if (filter->frame_pool)
+    g_thread_pool_free (filter->frame_pool, FALSE, TRUE);
+  g_queue_free (filter->frames);
+  g_queue_free (filter->free_frames);
+  g_cond_free (filter->frame_done);
   if (filter->cvImage)
     cvReleaseImage (&filter->cvImage);
   if (filter->cvGray)
     cvReleaseImage (&filter->cvGray);
+  gst_handdetect_setup_planes (filter, 0, 0);
+  gst_handdetect_set_watch (filter, FALSE);
+  /* let queued loads finish, then drop whatever they published */
+  g_thread_pool_free (filter->loader, FALSE, TRUE);
+  gst_handdetect_profiles_free (filter->pending_profiles);
+  gst_handdetect_profiles_free (filter->profiles);
+  g_mutex_free (filter->lock);
+  g_cond_free (filter->loaded);
+  g_mutex_free (filter->async_lock);
+  g_cond_free (filter->async_cond);
+  g_array_free (filter->haarHands, TRUE);
+  gst_hand_tracks_free (filter->tracks);
+  gst_hand_motion_free (filter->motion);
+  g_array_free (filter->hand_objects, TRUE);
+  g_array_free (filter->hand_gestures, TRUE);
+  gst_haar_resampler_free (filter->resampler);
+  gst_handdetect_buffer_pool_free (filter->buffer_pool);
+  gst_buffer_unref (filter->marker_pixels[GST_HANDDETECT_GESTURE_FIST]);
+  gst_buffer_unref (filter->marker_pixels[GST_HANDDETECT_GESTURE_PALM]);
   g_free (filter->profile);
   g_free (filter->profile_palm);
 
@@ -272,11 +474,17 @@ static void
 gst_handdetect_class_init (GstHanddetectClass * klass)
 {
   GObjectClass *gobject_class;
+  GstBaseTransformClass *basetrans_class;
   GstOpencvVideoFilterClass *gstopencvbasefilter_class;
 
   gobject_class = (GObjectClass *) klass;
+  basetrans_class = (GstBaseTransformClass *) klass;
   gstopencvbasefilter_class = (GstOpencvVideoFilterClass *) klass;
 
+  basetrans_class->set_caps = GST_DEBUG_FUNCPTR (gst_handdetect_set_video_caps);
+  basetrans_class->event = GST_DEBUG_FUNCPTR (gst_handdetect_sink_event);
+  basetrans_class->stop = GST_DEBUG_FUNCPTR (gst_handdetect_stop);
+
   gstopencvbasefilter_class->cv_trans_ip_func = gst_handdetect_transform_ip;
   gstopencvbasefilter_class->cv_set_caps = gst_handdetect_set_caps;
 
@@ -291,18 +499,25 @@ gst_handdetect_class_init (GstHanddetectClass * klass)
           "Whether the detected hands are highlighted in output frame",
           TRUE, G_PARAM_READWRITE)
       );
+  g_object_class_install_property (gobject_class,
+      PROP_OVERLAY,
+      g_param_spec_boolean ("overlay",
+          "Overlay",
+          "Highlight the hands with an overlay composition attached to the buffers, rendered by the sink or a downstream overlay element, instead of drawing into the frame",
+          DEFAULT_OVERLAY, G_PARAM_READWRITE)
+      );
   g_object_class_install_property (gobject_class,
       PROP_PROFILE,
       g_param_spec_string ("profile",
           "Profile",
-          "Location of HAAR cascade file (fist gesture)",
+          "Location of HAAR cascade file (fist gesture), OpenCV XML or binary from gst-haar-convert",
           HAAR_FILE, G_PARAM_READWRITE)
       );
   g_object_class_install_property (gobject_class,
       PROP_PROFILE_PALM,
       g_param_spec_string ("profile_palm",
           "Profile_palm",
-          "Location of HAAR cascade file (palm gesture)",
+          "Location of HAAR cascade file (palm gesture), OpenCV XML or binary from gst-haar-convert",
           HAAR_FILE_PALM, G_PARAM_READWRITE)
       );
   g_object_class_install_property (gobject_class,
@@ -333,6 +548,176 @@ gst_handdetect_class_init (GstHanddetectClass * klass)
           "HEIGHT of left-top pointer in region of interest \nGestures in the defined region of interest will emit messages",
           0, UINT_MAX, 0, G_PARAM_READWRITE)
       );
+  g_object_class_install_property (gobject_class,
+      PROP_ENGINE,
+      g_param_spec_enum ("engine",
+          "Engine",
+          "Cascade evaluator used for detection, legacy runs cvHaarDetectObjects, native the built-in SIMD evaluator (always used for binary profiles)",
+          GST_TYPE_HANDDETECT_ENGINE, DEFAULT_ENGINE, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_N_THREADS,
+      g_param_spec_uint ("n-threads",
+          "Number of threads",
+          "Number of threads the native engine splits the scale pyramid across",
+          1, MAX_N_THREADS, DEFAULT_N_THREADS, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_FIXED_POINT,
+      g_param_spec_boolean ("fixed-point",
+          "Fixed point",
+          "Run the native engine on integers only, for CPUs with a slow or no FPU",
+          DEFAULT_FIXED_POINT, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_PRUNE_EDGES,
+      g_param_spec_double ("prune-edges",
+          "Prune edges",
+          "Native engine: skip the windows whose mean Sobel edge magnitude (divided by 8) is below this, before any cascade stage (0 = off)",
+          0., 255., DEFAULT_PRUNE_EDGES, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_PRUNE_STDDEV,
+      g_param_spec_double ("prune-stddev",
+          "Prune standard deviation",
+          "Native engine: skip the windows whose gray level standard deviation is below this, before any cascade stage (0 = off)",
+          0., 128., DEFAULT_PRUNE_STDDEV, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_HISTORY_REFRESH,
+      g_param_spec_uint ("history-refresh",
+          "History refresh",
+          "Native engine: skip the windows rejected early on the previous frames while the image under them stays the same, re-checking each one at least every this many frames (0 = off)",
+          0, G_MAXUINT, DEFAULT_HISTORY_REFRESH, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_HISTORY_DEPTH,
+      g_param_spec_uint ("history-depth",
+          "History depth",
+          "With history-refresh, only skip the windows rejected by one of this many first cascade stages",
+          1, 255, DEFAULT_HISTORY_DEPTH, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_STATS,
+      g_param_spec_boxed ("stats",
+          "Statistics",
+          "Windows scanned by the native engine so far, how many were pruned and their ratio, and how many were skipped from the history",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_MOTION_GATE,
+      g_param_spec_boolean ("motion-gate",
+          "Motion gate",
+          "Only scan the parts of the frame that moved since the previous one, plus the tracked hands (the legacy engine scans the box around them), and keep the last result while nothing moves (not with frames-in-flight)",
+          DEFAULT_MOTION_GATE, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_MOTION_THRESHOLD,
+      g_param_spec_uint ("motion-threshold",
+          "Motion threshold",
+          "With motion-gate, a 16x16 block of the gray frame moved when the mean absolute difference of its pixels is above this",
+          0, 255, DEFAULT_MOTION_THRESHOLD, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_TRACKING,
+      g_param_spec_boolean ("tracking",
+          "Tracking",
+          "Follow every hand with its own Kalman tracker, and between keyframes only search around the hands the tracks predict",
+          DEFAULT_TRACKING, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_INTERVAL,
+      g_param_spec_uint ("keyframe-interval",
+          "Keyframe interval",
+          "With tracking, scan the full frame every this many frames (and whenever a tracked hand is lost)",
+          1, G_MAXUINT, DEFAULT_KEYFRAME_INTERVAL, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_ROI_SEARCH,
+      g_param_spec_boolean ("roi-search",
+          "ROI search",
+          "Only scan the region of interest plus a margin of one detection window, instead of the whole frame",
+          DEFAULT_ROI_SEARCH, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_WATCH_PROFILES,
+      g_param_spec_boolean ("watch-profiles",
+          "Watch profiles",
+          "Reload profile and profile_palm when their files change (inotify)",
+          DEFAULT_WATCH_PROFILES, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_DETECT_WIDTH,
+      g_param_spec_uint ("detect-width",
+          "Detect width",
+          GST_HANDDETECT_DETECT_WIDTH_BLURB,
+          0, G_MAXUINT, DEFAULT_DETECT_WIDTH, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_DETECT_HEIGHT,
+      g_param_spec_uint ("detect-height",
+          "Detect height",
+          GST_HANDDETECT_DETECT_HEIGHT_BLURB,
+          0, G_MAXUINT, DEFAULT_DETECT_HEIGHT, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_ASYNC,
+      g_param_spec_boolean ("async",
+          "Async",
+          "Pass buffers on at once and detect in a worker thread on the newest frame, messages carry the timestamp of the frame the hand was found in",
+          DEFAULT_ASYNC, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_FRAMES_IN_FLIGHT,
+      g_param_spec_uint ("frames-in-flight",
+          "Frames in flight",
+          "Detect on up to this many frames at once in worker threads, buffers and messages still go out in order (0 = off); for offline processing, overrides async and disables tracking; only the native engine detects on several frames at once, legacy frames take turns on the cascades",
+          0, MAX_FRAMES_IN_FLIGHT, DEFAULT_FRAMES_IN_FLIGHT,
+          G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_POST_MESSAGES,
+      g_param_spec_boolean ("post-messages",
+          "Post messages",
+          "Post detected_hand_info messages on the bus; the hands are attached to the outgoing buffers either way",
+          DEFAULT_POST_MESSAGES, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_MESSAGE_INTERVAL,
+      g_param_spec_uint ("message-interval",
+          "Message interval",
+          "Post the hands of at most one frame every this many milliseconds of stream time (0 = every frame)",
+          0, G_MAXUINT, DEFAULT_MESSAGE_INTERVAL, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_MIN_HITS,
+      g_param_spec_uint ("min-hits",
+          "Min hits",
+          "Report a new hand once it was detected on this many frames in a row",
+          1, G_MAXUINT, DEFAULT_MIN_HITS, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_MAX_MISSES,
+      g_param_spec_uint ("max-misses",
+          "Max misses",
+          "Forget a hand, and its track id, after this many frames without detecting it",
+          0, G_MAXUINT, DEFAULT_MAX_MISSES, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_MAX_HANDS,
+      g_param_spec_uint ("max-hands",
+          "Max hands",
+          "Track at most this many hands at once",
+          1, GST_HANDDETECT_MAX_DETECTIONS, DEFAULT_MAX_HANDS,
+          G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_GESTURES,
+      g_param_spec_boolean ("gestures",
+          "Gestures",
+          "Post only the gestures of the tracked hands (swipe-left, swipe-right, swipe-up, swipe-down, hold, palm-open, palm-close) instead of every position",
+          DEFAULT_GESTURES, G_PARAM_READWRITE)
+      );
 }
 
 /* initialise the new element
@@ -355,11 +740,61 @@ gst_handdetect_init (GstHanddetect * filter, GstHanddetectClass * gclass)
   filter->roi_width = 0;
   filter->roi_height = 0;
   filter->display = TRUE;
+  filter->engine = DEFAULT_ENGINE;
+  filter->n_threads = DEFAULT_N_THREADS;
+  filter->fixed_point = DEFAULT_FIXED_POINT;
+  filter->prune_edges = DEFAULT_PRUNE_EDGES;
+  filter->prune_stddev = DEFAULT_PRUNE_STDDEV;
+  filter->history_refresh = DEFAULT_HISTORY_REFRESH;
+  filter->history_depth = DEFAULT_HISTORY_DEPTH;
+  filter->motion_gate = DEFAULT_MOTION_GATE;
+  filter->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  filter->motion = gst_hand_motion_new (DEFAULT_MOTION_THRESHOLD);
+  filter->tracking = DEFAULT_TRACKING;
+  filter->keyframe_interval = DEFAULT_KEYFRAME_INTERVAL;
+  filter->tracks = gst_hand_tracks_new ();
+  filter->hand_objects = g_array_new (FALSE, FALSE, sizeof (GstHaarObject));
+  filter->hand_gestures = g_array_new (FALSE, FALSE, sizeof (GstHandGesture));
+  filter->gestures = DEFAULT_GESTURES;
+  filter->roi_search = DEFAULT_ROI_SEARCH;
+  filter->haarHands = g_array_new (FALSE, FALSE, sizeof (GstHaarObject));
+  filter->watch_profiles = DEFAULT_WATCH_PROFILES;
+  filter->watch_fd = -1;
+  filter->detect_width = DEFAULT_DETECT_WIDTH;
+  filter->detect_height = DEFAULT_DETECT_HEIGHT;
+  filter->downscale = 1;
+  filter->resampler = gst_haar_resampler_new ();
+  filter->async = DEFAULT_ASYNC;
+  filter->async_lock = g_mutex_new ();
+  filter->async_cond = g_cond_new ();
+  filter->frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+  filter->frames = g_queue_new ();
+  filter->free_frames = g_queue_new ();
+  filter->frame_done = g_cond_new ();
+  filter->post_messages = DEFAULT_POST_MESSAGES;
+  filter->message_interval = DEFAULT_MESSAGE_INTERVAL;
+  filter->last_post = GST_CLOCK_TIME_NONE;
+  filter->buffer_pool = gst_handdetect_buffer_pool_new ();
+  filter->overlay = DEFAULT_OVERLAY;
+  filter->marker_pixels[GST_HANDDETECT_GESTURE_FIST] =
+      gst_handdetect_marker_new (TRUE, 0xff0000c8);
+  filter->marker_pixels[GST_HANDDETECT_GESTURE_PALM] =
+      gst_handdetect_marker_new (FALSE, 0xff00c800);
 
+  /* profiles are loaded on a single background thread, in request order */
+  filter->lock = g_mutex_new ();
+  filter->loaded = g_cond_new ();
+  filter->loader =
+      g_thread_pool_new (gst_handdetect_load_profiles, filter, 1,
+      FALSE, NULL);
   gst_handdetect_load_profile (filter);
 
   gst_opencv_video_filter_set_in_place (GST_OPENCV_VIDEO_FILTER_CAST (filter),
       TRUE);
+  /* buffers are pushed by the element, only made writable when a marker
+   * is drawn on them, so shared ones (after a tee) aren't copied for
+   * nothing */
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM_CAST (filter), TRUE);
 }
 
 static void
@@ -370,18 +805,27 @@ gst_handdetect_set_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
     case PROP_PROFILE_PALM:
+      g_mutex_lock (filter->lock);
       g_free (filter->profile_palm);
       filter->profile_palm = g_value_dup_string (value);
+      g_mutex_unlock (filter->lock);
+      gst_handdetect_set_watch (filter, filter->watch_profiles);
       gst_handdetect_load_profile (filter);
       break;
     case PROP_PROFILE:
+      g_mutex_lock (filter->lock);
       g_free (filter->profile);
       filter->profile = g_value_dup_string (value);
+      g_mutex_unlock (filter->lock);
+      gst_handdetect_set_watch (filter, filter->watch_profiles);
       gst_handdetect_load_profile (filter);
       break;
     case PROP_DISPLAY:
       filter->display = g_value_get_boolean (value);
       break;
+    case PROP_OVERLAY:
+      filter->overlay = g_value_get_boolean (value);
+      break;
     case PROP_ROI_X:
       filter->roi_x = g_value_get_uint (value);
       break;
@@ -394,6 +838,94 @@ gst_handdetect_set_property (GObject * object, guint prop_id,
     case PROP_ROI_HEIGHT:
       filter->roi_height = g_value_get_uint (value);
       break;
+    case PROP_ENGINE:{
+      GstHanddetectEngine engine = g_value_get_enum (value);
+
+      /* the sets are loaded for an engine */
+      if (engine != filter->engine) {
+        filter->engine = engine;
+        gst_handdetect_load_profile (filter);
+      }
+      break;
+    }
+    case PROP_N_THREADS:
+      /* picked up by the streaming thread */
+      filter->n_threads = g_value_get_uint (value);
+      break;
+    case PROP_FIXED_POINT:
+      /* picked up by the streaming thread */
+      filter->fixed_point = g_value_get_boolean (value);
+      break;
+    case PROP_PRUNE_EDGES:
+      /* picked up by the streaming thread */
+      filter->prune_edges = g_value_get_double (value);
+      break;
+    case PROP_PRUNE_STDDEV:
+      /* picked up by the streaming thread */
+      filter->prune_stddev = g_value_get_double (value);
+      break;
+    case PROP_HISTORY_REFRESH:
+      /* picked up by the streaming thread */
+      filter->history_refresh = g_value_get_uint (value);
+      break;
+    case PROP_HISTORY_DEPTH:
+      /* picked up by the streaming thread */
+      filter->history_depth = g_value_get_uint (value);
+      break;
+    case PROP_MOTION_GATE:
+      /* picked up by the streaming thread */
+      filter->motion_gate = g_value_get_boolean (value);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      /* picked up by the streaming thread */
+      filter->motion_threshold = g_value_get_uint (value);
+      break;
+    case PROP_TRACKING:
+      /* the tracks are reset by the thread updating them */
+      GST_OBJECT_LOCK (filter);
+      filter->tracking = g_value_get_boolean (value);
+      filter->tracks_reset = TRUE;
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_KEYFRAME_INTERVAL:
+      filter->keyframe_interval = g_value_get_uint (value);
+      break;
+    case PROP_ROI_SEARCH:
+      filter->roi_search = g_value_get_boolean (value);
+      break;
+    case PROP_WATCH_PROFILES:
+      gst_handdetect_set_watch (filter, g_value_get_boolean (value));
+      break;
+    case PROP_DETECT_WIDTH:
+      filter->detect_width = g_value_get_uint (value);
+      break;
+    case PROP_DETECT_HEIGHT:
+      filter->detect_height = g_value_get_uint (value);
+      break;
+    case PROP_ASYNC:
+      filter->async = g_value_get_boolean (value);
+      break;
+    case PROP_FRAMES_IN_FLIGHT:
+      filter->frames_in_flight = g_value_get_uint (value);
+      break;
+    case PROP_POST_MESSAGES:
+      filter->post_messages = g_value_get_boolean (value);
+      break;
+    case PROP_MESSAGE_INTERVAL:
+      filter->message_interval = g_value_get_uint (value);
+      break;
+    case PROP_MIN_HITS:
+      filter->tracks->min_hits = g_value_get_uint (value);
+      break;
+    case PROP_MAX_MISSES:
+      filter->tracks->max_misses = g_value_get_uint (value);
+      break;
+    case PROP_MAX_HANDS:
+      filter->tracks->max_tracks = g_value_get_uint (value);
+      break;
+    case PROP_GESTURES:
+      filter->gestures = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -408,14 +940,21 @@ gst_handdetect_get_property (GObject * object, guint prop_id, GValue * value,
 
   switch (prop_id) {
     case PROP_PROFILE_PALM:
+      g_mutex_lock (filter->lock);
       g_value_set_string (value, filter->profile_palm);
+      g_mutex_unlock (filter->lock);
       break;
     case PROP_PROFILE:
+      g_mutex_lock (filter->lock);
       g_value_set_string (value, filter->profile);
+      g_mutex_unlock (filter->lock);
       break;
     case PROP_DISPLAY:
       g_value_set_boolean (value, filter->display);
       break;
+    case PROP_OVERLAY:
+      g_value_set_boolean (value, filter->overlay);
+      break;
     case PROP_ROI_X:
       g_value_set_uint (value, filter->roi_x);
       break;
@@ -428,6 +967,85 @@ gst_handdetect_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_ROI_HEIGHT:
       g_value_set_uint (value, filter->roi_height);
       break;
+    case PROP_ENGINE:
+      g_value_set_enum (value, filter->engine);
+      break;
+    case PROP_N_THREADS:
+      g_value_set_uint (value, filter->n_threads);
+      break;
+    case PROP_FIXED_POINT:
+      g_value_set_boolean (value, filter->fixed_point);
+      break;
+    case PROP_PRUNE_EDGES:
+      g_value_set_double (value, filter->prune_edges);
+      break;
+    case PROP_PRUNE_STDDEV:
+      g_value_set_double (value, filter->prune_stddev);
+      break;
+    case PROP_HISTORY_REFRESH:
+      g_value_set_uint (value, filter->history_refresh);
+      break;
+    case PROP_HISTORY_DEPTH:
+      g_value_set_uint (value, filter->history_depth);
+      break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (filter);
+      g_value_take_boxed (value, gst_structure_new ("handdetect-stats",
+              "windows", G_TYPE_UINT64, filter->stats_windows,
+              "pruned", G_TYPE_UINT64, filter->stats_pruned,
+              "prune-ratio", G_TYPE_DOUBLE, filter->stats_windows ?
+              (gdouble) filter->stats_pruned / filter->stats_windows : 0.,
+              "cached", G_TYPE_UINT64, filter->stats_cached, NULL));
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_MOTION_GATE:
+      g_value_set_boolean (value, filter->motion_gate);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint (value, filter->motion_threshold);
+      break;
+    case PROP_TRACKING:
+      g_value_set_boolean (value, filter->tracking);
+      break;
+    case PROP_KEYFRAME_INTERVAL:
+      g_value_set_uint (value, filter->keyframe_interval);
+      break;
+    case PROP_ROI_SEARCH:
+      g_value_set_boolean (value, filter->roi_search);
+      break;
+    case PROP_WATCH_PROFILES:
+      g_value_set_boolean (value, filter->watch_profiles);
+      break;
+    case PROP_DETECT_WIDTH:
+      g_value_set_uint (value, filter->detect_width);
+      break;
+    case PROP_DETECT_HEIGHT:
+      g_value_set_uint (value, filter->detect_height);
+      break;
+    case PROP_ASYNC:
+      g_value_set_boolean (value, filter->async);
+      break;
+    case PROP_FRAMES_IN_FLIGHT:
+      g_value_set_uint (value, filter->frames_in_flight);
+      break;
+    case PROP_POST_MESSAGES:
+      g_value_set_boolean (value, filter->post_messages);
+      break;
+    case PROP_MESSAGE_INTERVAL:
+      g_value_set_uint (value, filter->message_interval);
+      break;
+    case PROP_MIN_HITS:
+      g_value_set_uint (value, filter->tracks->min_hits);
+      break;
+    case PROP_MAX_MISSES:
+      g_value_set_uint (value, filter->tracks->max_misses);
+      break;
+    case PROP_MAX_HANDS:
+      g_value_set_uint (value, filter->tracks->max_tracks);
+      break;
+    case PROP_GESTURES:
+      g_value_set_boolean (value, filter->gestures);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -435,6 +1053,38 @@ gst_handdetect_get_property (GObject * object, guint prop_id, GValue * value,
 }
 
 /* GstElement vmethod implementations */
+/* the base class only understands formats that map to a single IplImage,
+ * so the YUV formats are set up here and RGB / GRAY8 are passed on */
+static gboolean
+gst_handdetect_set_video_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstHanddetect *filter = GST_HANDDETECT (trans);
+  GstOpencvVideoFilter *transform = GST_OPENCV_VIDEO_FILTER (trans);
+  GstVideoFormat format;
+  gint width, height;
+
+  if (!gst_video_format_parse_caps (incaps, &format, &width, &height)) {
+    GST_WARNING_OBJECT (filter, "Failed to parse input caps");
+    return FALSE;
+  }
+  filter->format = format;
+  if (format == GST_VIDEO_FORMAT_RGB || format == GST_VIDEO_FORMAT_GRAY8)
+    return GST_BASE_TRANSFORM_CLASS (parent_class)->set_caps (trans, incaps,
+        outcaps);
+
+  if (!gst_handdetect_set_caps (transform, width, height, IPL_DEPTH_8U, 1,
+          width, height, IPL_DEPTH_8U, 1))
+    return FALSE;
+  /* only used by the base class to hand over the buffer data */
+  if (transform->cvImage)
+    cvReleaseImage (&transform->cvImage);
+  transform->cvImage =
+      cvCreateImageHeader (cvSize (width, height), IPL_DEPTH_8U, 1);
+  gst_base_transform_set_in_place (trans, transform->in_place);
+  return TRUE;
+}
+
 /* this function handles the link with other elements */
 static gboolean
 gst_handdetect_set_caps (GstOpencvVideoFilter * transform,
@@ -444,14 +1094,38 @@ gst_handdetect_set_caps (GstOpencvVideoFilter * transform,
   GstHanddetect *filter;
   filter = GST_HANDDETECT (transform);
 
+  gst_handdetect_stop_worker (filter);
+  /* frames in flight have the old size, send them first */
+  gst_handdetect_push_frames (filter, 0);
+  gst_handdetect_free_frames (filter);
   if (filter->cvGray)
     cvReleaseImage (&filter->cvGray);
-  filter->cvGray =
-      cvCreateImage (cvSize (in_width, in_height), IPL_DEPTH_8U, 1);
   if (filter->cvImage)
     cvReleaseImage (&filter->cvImage);
-  filter->cvImage =
-      cvCreateImage (cvSize (in_width, in_height), IPL_DEPTH_8U, 3);
+  filter->frame_width = in_width;
+  filter->frame_height = in_height;
+  gst_handdetect_setup_planes (filter, in_width, in_height);
+  if (filter->format == GST_VIDEO_FORMAT_RGB)
+    filter->cvImage =
+        cvCreateImage (cvSize (in_width, in_height), IPL_DEPTH_8U, 3);
+
+  /* frames larger than the working resolution are downscaled by the
+   * smallest integer factor that makes them fit */
+  filter->downscale = gst_handdetect_downscale_factor (in_width, in_height,
+      filter->detect_width, filter->detect_height);
+  GST_INFO_OBJECT (filter, "detecting on %dx%d", in_width / filter->downscale,
+      in_height / filter->downscale);
+
+  if (filter->downscale > 1 || filter->format == GST_VIDEO_FORMAT_RGB
+      || filter->format == GST_VIDEO_FORMAT_YUY2) {
+    /* converted, gathered or downscaled once per frame */
+    filter->cvGray = cvCreateImage (cvSize (in_width / filter->downscale,
+            in_height / filter->downscale), IPL_DEPTH_8U, 1);
+  } else {
+    /* the luma plane of the buffer is detected on in place */
+    filter->cvGray =
+        cvCreateImageHeader (cvSize (in_width, in_height), IPL_DEPTH_8U, 1);
+  }
 
   if (!filter->cvStorage)
     filter->cvStorage = cvCreateMemStorage (0);
@@ -461,6 +1135,11 @@ gst_handdetect_set_caps (GstOpencvVideoFilter * transform,
     filter->cvStorage_palm = cvCreateMemStorage (0);
   else
     cvClearMemStorage (filter->cvStorage_palm);
+  gst_handdetect_reset_tracks (filter);
+
+  /* start streaming with the profiles configured so far; later changes
+   * are swapped in without waiting */
+  gst_handdetect_wait_profiles (filter);
   return TRUE;
 }
 
@@ -472,163 +1151,1589 @@ gst_handdetect_transform_ip (GstOpencvVideoFilter * transform,
     GstBuffer * buffer, IplImage * img)
 {
   GstHanddetect *filter = GST_HANDDETECT (transform);
-  CvSeq *hands;
-  CvRect *r;
-  GstStructure *s;
-  GstMessage *m;
-  int i;
+  GstHanddetectResult result;
+  GstFlowReturn ret;
+  gint shared = 1;
 
-  filter->cvImage->imageData = (char *) GST_BUFFER_DATA (buffer);
-  /* 320 x 240 is with the best detect accuracy, if not, give info */
-  if (filter->cvImage->width > 320 || filter->cvImage->height > 240)
+  /* 320 x 240 is with the best detect accuracy, if not, give info
+   * (only left at a larger detect-width / detect-height) */
+  if (filter->cvGray->width > 320 || filter->cvGray->height > 240)
     GST_INFO_OBJECT (filter,
         "WARNING: resize to 320 x 240 to have best detect accuracy.\n");
-  /* cvt to gray colour space for hand detect */
-  cvCvtColor (filter->cvImage, filter->cvGray, CV_RGB2GRAY);
+  /* get the gray image for hand detect */
+  if (filter->format == GST_VIDEO_FORMAT_RGB)
+    filter->cvImage->imageData = (char *) GST_BUFFER_DATA (buffer);
+  if (filter->downscale > 1) {
+    if (filter->format == GST_VIDEO_FORMAT_RGB)
+      gst_haar_resampler_process (filter->resampler, GST_BUFFER_DATA (buffer),
+          filter->cvImage->width, filter->cvImage->height,
+          filter->cvImage->widthStep, GST_HAAR_PIXEL_RGB, filter->downscale,
+          (guint8 *) filter->cvGray->imageData, filter->cvGray->widthStep);
+    else
+      gst_haar_resampler_process (filter->resampler,
+          GST_BUFFER_DATA (buffer) + filter->plane_offset[0],
+          filter->frame_width, filter->frame_height, filter->plane_stride[0],
+          filter->format == GST_VIDEO_FORMAT_YUY2 ? GST_HAAR_PIXEL_YUY2 :
+          GST_HAAR_PIXEL_GRAY, filter->downscale,
+          (guint8 *) filter->cvGray->imageData, filter->cvGray->widthStep);
+  } else {
+    switch (filter->format) {
+      case GST_VIDEO_FORMAT_RGB:
+        cvCvtColor (filter->cvImage, filter->cvGray, CV_RGB2GRAY);
+        break;
+      case GST_VIDEO_FORMAT_YUY2:
+        gst_handdetect_gather_luma (filter->cvGray, GST_BUFFER_DATA (buffer),
+            filter->plane_stride[0]);
+        break;
+      default:
+        cvSetData (filter->cvGray, GST_BUFFER_DATA (buffer) +
+            filter->plane_offset[0], filter->plane_stride[0]);
+        break;
+    }
+  }
+
+  if (filter->frames_in_flight > 0) {
+    /* the buffer is held back and pushed once its turn comes */
+    gst_handdetect_stop_worker (filter);
+    return gst_handdetect_queue_parallel (filter, buffer);
+  }
+  /* frames left from frame-parallel mode go first */
+  if ((ret = gst_handdetect_push_frames (filter, 0)) != GST_FLOW_OK)
+    return ret;
+  gst_handdetect_free_retired (filter);
+
+  if (filter->async) {
+    /* leave the detection to the worker, the buffer goes on right away */
+    gst_handdetect_queue_frame (filter, GST_BUFFER_TIMESTAMP (buffer));
+  } else {
+    gst_handdetect_stop_worker (filter);
+    gst_handdetect_process (filter, filter->cvGray,
+        GST_BUFFER_TIMESTAMP (buffer));
+  }
+
+  g_mutex_lock (filter->async_lock);
+  result = filter->result;
+  g_mutex_unlock (filter->async_lock);
+
+  /* nothing to attach or draw, BaseTransform passes the buffer on */
+  if (result.n_hands == 0)
+    return GST_FLOW_OK;
+
+  /* Check filter->display,
+   * If TRUE, mark the latest hands found in the out frame, a copy of it
+   * when it is shared; BaseTransform holds the only other reference,
+   * dropped as soon as we return */
+  if (filter->display && !filter->overlay && !gst_buffer_is_writable (buffer)) {
+    buffer = gst_buffer_copy (buffer);
+    shared = 0;
+  } else {
+    buffer = gst_buffer_ref (buffer);
+  }
+  if (filter->display && !filter->overlay)
+    gst_handdetect_draw_result (filter, buffer, &result);
+
+  /* Push out the incoming buffer, with the hands attached */
+  ret = gst_handdetect_push_result (filter, buffer, shared, &result);
+  return ret == GST_FLOW_OK ? GST_BASE_TRANSFORM_FLOW_DROPPED : ret;
+}
+
+/* the window around the hands the tracks predict: each grown by
+ * TRACK_MARGIN and three deviations on every side, united, and the range
+ * of scales covering all of them; FALSE when there is no track or one of
+ * them was missed on the last frame */
+static gboolean
+gst_handdetect_tracks_window (GstHanddetect * filter, CvRect * window,
+    CvSize * min_size, CvSize * max_size)
+{
+  GArray *tracks = filter->tracks->tracks;
+  gint x1 = G_MAXINT, y1 = G_MAXINT, x2 = G_MININT, y2 = G_MININT;
+  guint i;
+
+  if (tracks->len == 0)
+    return FALSE;
+
+  *min_size = cvSize (G_MAXINT, G_MAXINT);
+  *max_size = cvSize (0, 0);
+  for (i = 0; i < tracks->len; i++) {
+    GstHandTracker *tracker = &g_array_index (tracks, GstHandTracker, i);
+    CvRect t;
+    gdouble pos_sigma, size_sigma, height_sigma;
+    gint mx, my;
+
+    if (tracker->misses > 0)
+      return FALSE;
+
+    gst_hand_tracker_predict (tracker, &t, &pos_sigma, &size_sigma);
+    height_sigma = size_sigma * tracker->aspect;
+    mx = cvRound (t.width * TRACK_MARGIN + 3 * pos_sigma);
+    my = cvRound (t.height * TRACK_MARGIN + 3 * pos_sigma);
+
+    x1 = MIN (x1, t.x - mx);
+    y1 = MIN (y1, t.y - my);
+    x2 = MAX (x2, t.x + t.width + mx);
+    y2 = MAX (y2, t.y + t.height + my);
+    min_size->width = MIN (min_size->width,
+        MAX (cvRound ((t.width - 3 * size_sigma) / TRACK_SCALE_RANGE),
+            HAAR_MIN_SIZE));
+    min_size->height = MIN (min_size->height,
+        MAX (cvRound ((t.height - 3 * height_sigma) / TRACK_SCALE_RANGE),
+            HAAR_MIN_SIZE));
+    max_size->width = MAX (max_size->width,
+        cvRound ((t.width + 3 * size_sigma) * TRACK_SCALE_RANGE));
+    max_size->height = MAX (max_size->height,
+        cvRound ((t.height + 3 * height_sigma) * TRACK_SCALE_RANGE));
+  }
+  *window = cvRect (x1, y1, x2 - x1, y2 - y1);
+  return TRUE;
+}
+
+/* With the motion gate, compares @gray to the previous frame and limits
+ * the native engine to the blocks that moved and the ones under the
+ * tracked hands; the legacy engine gets the box around them in @moved,
+ * in frame coordinates (0x0 for no limit). Returns FALSE when nothing
+ * moved, the last result then stays. Without it the whole frame is
+ * scanned. */
+static gboolean
+gst_handdetect_motion_gate (GstHanddetect * filter, IplImage * gray,
+    CvRect * moved)
+{
+  GstHanddetectProfiles *p = filter->profiles;
+  GArray *tracks = filter->tracks->tracks;
+  GstHandMotion *motion = filter->motion;
+  gint f = filter->downscale;
+  guint i;
+
+  *moved = cvRect (0, 0, 0, 0);
+  if (!filter->motion_gate) {
+    /* the first frame with the gate on moves everywhere */
+    gst_hand_motion_reset (motion);
+    if (p && p->haarDetector)
+      gst_haar_detector_set_mask (p->haarDetector, NULL, 0, 0, 0);
+    return TRUE;
+  }
+
+  motion->threshold = filter->motion_threshold;
+  if (gst_hand_motion_update (motion, (const guint8 *) gray->imageData,
+          gray->width, gray->height, gray->widthStep) == 0)
+    return FALSE;
+
+  /* a hand holding still is still searched for */
+  for (i = 0; i < tracks->len; i++) {
+    CvRect r = g_array_index (tracks, GstHandTracker, i).rect;
+
+    r = cvRect (r.x / f, r.y / f, r.width / f + 1, r.height / f + 1);
+    gst_hand_motion_mark (motion, &r);
+  }
+
+  if (p && p->haarDetector) {
+    gst_haar_detector_set_mask (p->haarDetector, motion->mask, motion->cols,
+        motion->rows, GST_HAND_MOTION_SHIFT);
+  } else if (p && p->window.width > 0
+      && gst_hand_motion_bounds (motion, moved)) {
+    /* OpenCV takes no mask: grown by one window, so the hands overlapping
+     * the blocks at the smallest scale still fit */
+    *moved = cvRect ((moved->x - p->window.width) * f,
+        (moved->y - p->window.height) * f,
+        (moved->width + 2 * p->window.width) * f,
+        (moved->height + 2 * p->window.height) * f);
+  }
+  return TRUE;
+}
+
+/* clips @r to @clip, leaving it empty when they don't overlap */
+static void
+gst_handdetect_clip_region (CvRect * r, const CvRect * clip)
+{
+  gint x2 = MIN (r->x + r->width, clip->x + clip->width);
+  gint y2 = MIN (r->y + r->height, clip->y + clip->height);
+
+  r->x = MAX (r->x, clip->x);
+  r->y = MAX (r->y, clip->y);
+  r->width = MAX (x2 - r->x, 0);
+  r->height = MAX (y2 - r->y, 0);
+}
+
+/* detects the hands on @gray and posts them, stamped with the @timestamp
+ * of the frame, on the streaming thread or in async mode on the worker */
+static void
+gst_handdetect_process (GstHanddetect * filter, IplImage * gray,
+    GstClockTime timestamp)
+{
+  CvSeq *hands, *palms;
+  CvRect search, roi, moved, *region = NULL;
+  CvSize min_size = cvSize (HAAR_MIN_SIZE, HAAR_MIN_SIZE);
+  CvSize max_size = cvSize (0, 0);
+
   cvClearMemStorage (filter->cvStorage);
+  cvClearMemStorage (filter->cvStorage_palm);
 
-  /* ------detect palm gesture and send events------ */
-  /* TO DO */
+  /* switch to newly loaded profiles, if any */
+  gst_handdetect_update_profiles (filter);
+  gst_handdetect_apply_tracks_reset (filter);
 
-  /* ------detect fist gesture and send events------ */
-  if (filter->cvCascade) {
-    /* detect hands */
-    hands =
-        cvHaarDetectObjects (filter->cvGray, filter->cvCascade,
-        filter->cvStorage, 1.1, 2, CV_HAAR_DO_CANNY_PRUNING, cvSize (24, 24)
-#if (CV_MAJOR_VERSION >= 2) && (CV_MINOR_VERSION >= 2)
-        , cvSize (0, 0)
-#endif
-        );
+  if (!gst_handdetect_motion_gate (filter, gray, &moved))
+    return;
 
-    /* If FIST gesture detected, set the buffer writable */
-    if (filter->display && hands && hands->total > 0) {
-      buffer = gst_buffer_make_writable (buffer);
-      GST_DEBUG_OBJECT (filter, "%d FIST gestures detected\n",
-          (int) hands->total);
-    }
+  /* ------detect fist and palm gestures------ */
+  /* with tracking, frames between keyframes only search the neighbourhood
+   * of the hands the tracks predict, grown by their uncertainty, at the
+   * scales of any of them; a frame after a miss is a keyframe */
+  if (filter->tracking && gst_handdetect_tracks_window (filter, &search,
+          &min_size, &max_size)
+      && filter->frames_since_keyframe < filter->keyframe_interval) {
+    region = &search;
+  } else {
+    filter->frames_since_keyframe = 0;
+  }
+  filter->frames_since_keyframe++;
 
-    /* Go through all detected FIST gestures to get the best one
-     * prev_r => previous hand
-     * best_r => best hand in this frame
-     */
-    if (hands && hands->total > 0) {
-      /* suppose a min_distance for init comparison */
-      int min_distance = filter->cvImage->width + filter->cvImage->height;
-      /* Init filter->prev_r */
-      CvRect temp_r = cvRect (0, 0, 0, 0);
-      if (filter->prev_r == NULL)
-        filter->prev_r = &temp_r;
-
-      /* Get the best FIST gesture */
-      for (i = 0; i < (hands ? hands->total : 0); i++) {
-        r = (CvRect *) cvGetSeqElem (hands, i);
-        int distance = (int) sqrt (pow ((r->x - filter->prev_r->x),
-                2) + pow ((r->y - filter->prev_r->y), 2));
-        if (distance <= min_distance) {
-          min_distance = distance;
-          filter->best_r = r;
-        }
-      }
+  /* with roi-search, never look outside the region of interest grown by
+   * one detection window, so hands centred near its border still fit */
+  if (filter->roi_search && filter->profiles
+      && filter->profiles->window.width > 0 && (filter->roi_x != 0
+          || filter->roi_y != 0 || filter->roi_width != 0
+          || filter->roi_height != 0)) {
+    CvSize win = cvSize (filter->profiles->window.width * filter->downscale,
+        filter->profiles->window.height * filter->downscale);
+
+    roi = cvRect ((gint) filter->roi_x - win.width,
+        (gint) filter->roi_y - win.height, filter->roi_width + 2 * win.width,
+        filter->roi_height + 2 * win.height);
+    if (region)
+      gst_handdetect_clip_region (&roi, region);
+    region = &roi;
+  }
+
+  /* the legacy engine only scans around what moved */
+  if (moved.width > 0) {
+    if (region)
+      gst_handdetect_clip_region (&moved, region);
+    region = &moved;
+  }
+
+  hands =
+      gst_handdetect_detect (filter, gray, region, min_size, max_size, &palms);
+  gst_handdetect_report (filter, hands, palms, timestamp);
+}
+
+/* matches the hands found to the tracked ones, posts the tracks detected
+ * on this frame and publishes them to be drawn and attached */
+static void
+gst_handdetect_report (GstHanddetect * filter, CvSeq * hands, CvSeq * palms,
+    GstClockTime timestamp)
+{
+  GstHanddetectResult result;
+  gboolean post = FALSE;
+  guint i;
+  int j;
+
+  result.n_hands = 0;
+  result.timestamp = timestamp;
+
+  /* ------track fist and palm gestures------ */
+  /* one track per hand, following it through both gestures */
+  g_array_set_size (filter->hand_objects, 0);
+  for (j = 0; j < (hands ? hands->total : 0); j++) {
+    CvAvgComp *comp = (CvAvgComp *) cvGetSeqElem (hands, j);
+    GstHaarObject o = { comp->rect, FRAME_LABEL_FIST, comp->neighbors };
+
+    g_array_append_val (filter->hand_objects, o);
+  }
+  for (j = 0; j < (palms ? palms->total : 0); j++) {
+    CvAvgComp *comp = (CvAvgComp *) cvGetSeqElem (palms, j);
+    GstHaarObject o = { comp->rect, FRAME_LABEL_PALM, comp->neighbors };
 
-      /* Save best_r as prev_r for next frame comparison */
-      filter->prev_r = (CvRect *) filter->best_r;
-
-      /* send msg to app/bus if the detected gesture falls in the region of interest */
-      /* get center point of gesture */
-      CvPoint c = cvPoint (filter->best_r->x + filter->best_r->width / 2,
-          filter->best_r->y + filter->best_r->height / 2);
-      /* send message:
-       * if the center point is in the region of interest, OR,
-       * if the region of interest remains default as (0,0,0,0)*/
-      if ((c.x >= filter->roi_x && c.x <= (filter->roi_x + filter->roi_width)
-              && c.y >= filter->roi_y
-              && c.y <= (filter->roi_y + filter->roi_height))
-          || (filter->roi_x == 0
-              && filter->roi_y == 0
-              && filter->roi_width == 0 && filter->roi_height == 0)) {
-        /* Define structure for message post */
-        s = gst_structure_new ("detected_hand_info",
-            "gesture", G_TYPE_STRING, "fist",
-            "x", G_TYPE_UINT,
-            (uint) (filter->best_r->x + filter->best_r->width * 0.5), "y",
-            G_TYPE_UINT,
-            (uint) (filter->best_r->y + filter->best_r->height * 0.5), "width",
-            G_TYPE_UINT, (uint) filter->best_r->width, "height", G_TYPE_UINT,
-            (uint) filter->best_r->height, NULL);
-        /* Init message element */
-        m = gst_message_new_element (GST_OBJECT (filter), s);
-        /* Send message */
-        gst_element_post_message (GST_ELEMENT (filter), m);
+    g_array_append_val (filter->hand_objects, o);
+  }
+  GST_DEBUG_OBJECT (filter, "%d FIST and %d PALM gestures detected\n",
+      hands ? hands->total : 0, palms ? palms->total : 0);
+
+  gst_hand_tracks_update (filter->tracks,
+      (GstHaarObject *) filter->hand_objects->data, filter->hand_objects->len);
+
+  for (i = 0; i < filter->tracks->tracks->len; i++) {
+    GstHandTracker *t = &g_array_index (filter->tracks->tracks,
+        GstHandTracker, i);
+    GstHanddetectDetection *d;
+
+    if (!gst_hand_tracks_reported (filter->tracks, t)
+        || result.n_hands == GST_HANDDETECT_MAX_DETECTIONS)
+      continue;
+
+    d = &result.hands[result.n_hands++];
+    d->x = t->rect.x;
+    d->y = t->rect.y;
+    d->width = t->rect.width;
+    d->height = t->rect.height;
+    d->gesture = t->label == FRAME_LABEL_FIST ?
+        GST_HANDDETECT_GESTURE_FIST : GST_HANDDETECT_GESTURE_PALM;
+    d->score = t->neighbors;
+    d->track_id = t->id;
+
+    /* send msg to app/bus if the detected gesture falls in the region of interest */
+    if (gst_handdetect_in_roi (filter, &t->rect))
+      post = TRUE;
 
 #if 0
-        /* send event
-         * here we use mouse-move event instead of fist-move or palm-move event
-         * !!! this will CHANGE in the future !!!
-         * !!! by adding gst_navigation_send_hand_detect_event() in navigation.c !!!
-         */
-        gst_navigation_send_mouse_event (GST_NAVIGATION (filter),
-            "mouse-move",
-            0,
-            (double) (filter->best_r->x + filter->best_r->width * 0.5),
-            (double) (filter->best_r->y + filter->best_r->height * 0.5));
-
-        /* or use another way to send upstream navigation event for debug
-         *
-         * GstEvent *event =
-         * gst_event_new_navigation (gst_structure_new
-         * ("application/x-gst-navigation", "event", G_TYPE_STRING,
-         * "mouse-move",
-         * "button", G_TYPE_INT, 0,
-         * "pointer_x", G_TYPE_DOUBLE,
-         * (double) (filter->best_r->x + filter->best_r->width * 0.5),
-         * "pointer_y", G_TYPE_DOUBLE,
-         * (double) (filter->best_r->y + filter->best_r->height * 0.5),
-         * NULL));
-         * gst_pad_send_event (GST_BASE_TRANSFORM_CAST (filter)->srcpad, event);
-         */
+    /* send event
+     * here we use mouse-move event instead of fist-move or palm-move event
+     * !!! this will CHANGE in the future !!!
+     * !!! by adding gst_navigation_send_hand_detect_event() in navigation.c !!!
+     */
+    gst_navigation_send_mouse_event (GST_NAVIGATION (filter),
+        "mouse-move",
+        0,
+        (double) (t->rect.x + t->rect.width * 0.5),
+        (double) (t->rect.y + t->rect.height * 0.5));
+
+    /* or use another way to send upstream navigation event for debug
+     *
+     * GstEvent *event =
+     * gst_event_new_navigation (gst_structure_new
+     * ("application/x-gst-navigation", "event", G_TYPE_STRING,
+     * "mouse-move",
+     * "button", G_TYPE_INT, 0,
+     * "pointer_x", G_TYPE_DOUBLE,
+     * (double) (t->rect.x + t->rect.width * 0.5),
+     * "pointer_y", G_TYPE_DOUBLE,
+     * (double) (t->rect.y + t->rect.height * 0.5),
+     * NULL));
+     * gst_pad_send_event (GST_BASE_TRANSFORM_CAST (filter)->srcpad, event);
+     */
 #endif
-      }
+  }
 
-      /* Check filter->display,
-       * If TRUE, displaying red circle marker in the out frame */
-      if (filter->display) {
-        CvPoint center;
-        int radius;
-        center.x = cvRound ((filter->best_r->x + filter->best_r->width * 0.5));
-        center.y = cvRound ((filter->best_r->y + filter->best_r->height * 0.5));
-        radius =
-            cvRound ((filter->best_r->width + filter->best_r->height) * 0.25);
-        cvCircle (filter->cvImage, center, radius, CV_RGB (0, 0, 200), 1, 8, 0);
-      }
+  /* post all hands of a frame or none, at most one frame's worth per
+   * message-interval of stream time */
+  if (filter->gestures) {
+    if (filter->post_messages)
+      gst_handdetect_post_gestures (filter, timestamp);
+  } else if (post && filter->post_messages
+      && gst_handdetect_message_due (&filter->last_post, timestamp,
+          filter->message_interval)) {
+    for (i = 0; i < result.n_hands; i++) {
+      GstHanddetectDetection *d = &result.hands[i];
+      CvRect rect = cvRect (d->x, d->y, d->width, d->height);
+
+      if (gst_handdetect_in_roi (filter, &rect))
+        gst_handdetect_post_hand (filter,
+            d->gesture == GST_HANDDETECT_GESTURE_FIST ? "fist" : "palm",
+            &rect, d->track_id, timestamp);
     }
   }
-  /* Push out the incoming buffer */
-  return GST_FLOW_OK;           //gst_pad_push (pad, outbuf);
+
+  g_mutex_lock (filter->async_lock);
+  filter->result = result;
+  g_mutex_unlock (filter->async_lock);
 }
 
+/* forgets the hands tracked and their gestures */
 static void
-gst_handdetect_load_profile (GstHanddetect * filter)
+gst_handdetect_reset_tracks (GstHanddetect * filter)
 {
-  GST_DEBUG_OBJECT (filter, "Loading profiles...\n");
-  filter->cvCascade =
-      (CvHaarClassifierCascade *) cvLoad (filter->profile, 0, 0, 0);
-  filter->cvCascade_palm =
-      (CvHaarClassifierCascade *) cvLoad (filter->profile_palm, 0, 0, 0);
-  if (!filter->cvCascade)
-    GST_WARNING_OBJECT (filter,
-        "WARNING: Could not load HAAR classifier cascade: %s.\n",
-        filter->profile);
-  else
-    GST_DEBUG_OBJECT (filter, "Loaded profile %s\n", filter->profile);
-  if (!filter->cvCascade_palm)
-    GST_WARNING_OBJECT (filter,
-        "WARNING: Could not load HAAR classifier cascade: %s.\n",
-        filter->profile_palm);
-  else
-    GST_DEBUG_OBJECT (filter, "Loaded profile %s\n", filter->profile_palm);
+  gst_hand_tracks_reset (filter->tracks);
+  g_array_set_size (filter->hand_gestures, 0);
+}
+
+/* resets the tracks if tracking was switched since the last frame */
+static void
+gst_handdetect_apply_tracks_reset (GstHanddetect * filter)
+{
+  gboolean reset;
+
+  GST_OBJECT_LOCK (filter);
+  reset = filter->tracks_reset;
+  filter->tracks_reset = FALSE;
+  GST_OBJECT_UNLOCK (filter);
+
+  if (reset)
+    gst_handdetect_reset_tracks (filter);
+}
+
+/* feeds the tracks detected on this frame to their gesture recognizers
+ * and posts the gestures completed in the region of interest; the
+ * recognizers of the tracks that ended go */
+static void
+gst_handdetect_post_gestures (GstHanddetect * filter, GstClockTime timestamp)
+{
+  GArray *tracks = filter->tracks->tracks;
+  guint i, j;
+
+  for (i = filter->hand_gestures->len; i-- > 0;) {
+    GstHandGesture *g = &g_array_index (filter->hand_gestures,
+        GstHandGesture, i);
+
+    for (j = 0; j < tracks->len; j++)
+      if (g_array_index (tracks, GstHandTracker, j).id == g->track_id)
+        break;
+    if (j == tracks->len)
+      g_array_remove_index_fast (filter->hand_gestures, i);
+  }
+
+  for (j = 0; j < tracks->len; j++) {
+    GstHandTracker *t = &g_array_index (tracks, GstHandTracker, j);
+    GstHandGesture *g = NULL;
+    GstHandGestureEvent event;
+
+    if (!gst_hand_tracks_reported (filter->tracks, t))
+      continue;
+
+    for (i = 0; i < filter->hand_gestures->len && !g; i++)
+      if (g_array_index (filter->hand_gestures, GstHandGesture,
+              i).track_id == t->id)
+        g = &g_array_index (filter->hand_gestures, GstHandGesture, i);
+    if (!g) {
+      g_array_set_size (filter->hand_gestures, filter->hand_gestures->len + 1);
+      g = &g_array_index (filter->hand_gestures, GstHandGesture,
+          filter->hand_gestures->len - 1);
+      gst_hand_gesture_init (g, t->id);
+    }
+
+    /* the filtered trajectory, the detections jitter */
+    event = gst_hand_gesture_update (g, t->cx.x, t->cy.x, t->size.x,
+        t->label == FRAME_LABEL_FIST ?
+        GST_HANDDETECT_GESTURE_FIST : GST_HANDDETECT_GESTURE_PALM, timestamp);
+    if (event != GST_HAND_GESTURE_NONE
+        && gst_handdetect_in_roi (filter, &t->rect))
+      gst_handdetect_post_hand (filter, gst_hand_gesture_event_name (event),
+          &t->rect, t->id, timestamp);
+  }
+}
+
+/* the async detection worker, detects on the newest queued frame */
+static gpointer
+gst_handdetect_worker (gpointer data)
+{
+  GstHanddetect *filter = GST_HANDDETECT (data);
+
+  g_mutex_lock (filter->async_lock);
+  while (TRUE) {
+    IplImage *gray;
+    GstClockTime timestamp;
+
+    while (!filter->async_pending && !filter->async_stop)
+      g_cond_wait (filter->async_cond, filter->async_lock);
+    if (filter->async_stop)
+      break;
+
+    gray = filter->async_next;
+    filter->async_next = filter->async_gray;
+    filter->async_gray = gray;
+    timestamp = filter->async_timestamp;
+    filter->async_pending = FALSE;
+    g_mutex_unlock (filter->async_lock);
+
+    gst_handdetect_process (filter, gray, timestamp);
+
+    g_mutex_lock (filter->async_lock);
+  }
+  g_mutex_unlock (filter->async_lock);
+  return NULL;
 }
 
+/* hands a copy of the gray frame over to the worker, starting it on the
+ * first one; a frame still waiting for it is replaced */
+static void
+gst_handdetect_queue_frame (GstHanddetect * filter, GstClockTime timestamp)
+{
+  if (!filter->worker) {
+    GError *err = NULL;
+    CvSize size = cvSize (filter->cvGray->width, filter->cvGray->height);
+
+    filter->async_gray = cvCreateImage (size, IPL_DEPTH_8U, 1);
+    filter->async_next = cvCreateImage (size, IPL_DEPTH_8U, 1);
+    filter->async_pending = FALSE;
+    filter->async_stop = FALSE;
+    filter->worker =
+        g_thread_create (gst_handdetect_worker, filter, TRUE, &err);
+    if (!filter->worker) {
+      GST_WARNING_OBJECT (filter, "Could not start the detection worker: %s",
+          err->message);
+      g_error_free (err);
+      cvReleaseImage (&filter->async_gray);
+      cvReleaseImage (&filter->async_next);
+      gst_handdetect_process (filter, filter->cvGray, timestamp);
+      return;
+    }
+  }
+
+  g_mutex_lock (filter->async_lock);
+  if (filter->async_pending)
+    GST_LOG_OBJECT (filter, "replacing the frame waiting for detection");
+  cvCopy (filter->cvGray, filter->async_next, NULL);
+  filter->async_timestamp = timestamp;
+  filter->async_pending = TRUE;
+  g_cond_signal (filter->async_cond);
+  g_mutex_unlock (filter->async_lock);
+}
+
+/* lets the worker finish the frame it is on and joins it */
+static void
+gst_handdetect_stop_worker (GstHanddetect * filter)
+{
+  if (!filter->worker)
+    return;
+
+  g_mutex_lock (filter->async_lock);
+  filter->async_stop = TRUE;
+  g_cond_signal (filter->async_cond);
+  g_mutex_unlock (filter->async_lock);
+  g_thread_join (filter->worker);
+  filter->worker = NULL;
+
+  cvReleaseImage (&filter->async_gray);
+  cvReleaseImage (&filter->async_next);
+}
+
+/* a native detector scanning the cascades of @p, the fist cascade first */
+static GstHaarDetector *
+gst_handdetect_new_detector (GstHanddetectProfiles * p)
+{
+  GstHaarDetector *detector = NULL;
+
+  if (p->haarCascade) {
+    detector = gst_haar_detector_new (p->haarCascade,
+        HAAR_SCALE_FACTOR, HAAR_MIN_NEIGHBORS, HAAR_MIN_SIZE, HAAR_MIN_SIZE);
+    if (p->haarCascade_palm)
+      gst_haar_detector_add_cascade (detector, p->haarCascade_palm);
+  } else if (p->haarCascade_palm) {
+    detector = gst_haar_detector_new (p->haarCascade_palm,
+        HAAR_SCALE_FACTOR, HAAR_MIN_NEIGHBORS, HAAR_MIN_SIZE, HAAR_MIN_SIZE);
+  }
+  return detector;
+}
+
+static void
+gst_handdetect_frame_free (GstHanddetectFrame * frame)
+{
+  if (frame->buffer)
+    gst_buffer_unref (frame->buffer);
+  cvReleaseImage (&frame->gray);
+  gst_haar_detector_free (frame->detector);
+  cvReleaseMemStorage (&frame->storage);
+  g_array_free (frame->objects, TRUE);
+  g_free (frame);
+}
+
+static void
+gst_handdetect_detect_frame_legacy (GstHanddetectFrame * frame,
+    CvHaarClassifierCascade * cascade, gint label)
+{
+  CvSeq *seq;
+  int i;
+
+  if (!cascade)
+    return;
+
+  seq = cvHaarDetectObjects (frame->gray, cascade, frame->storage,
+      HAAR_SCALE_FACTOR, HAAR_MIN_NEIGHBORS, CV_HAAR_DO_CANNY_PRUNING,
+      cvSize (HAAR_MIN_SIZE, HAAR_MIN_SIZE)
+#if (CV_MAJOR_VERSION >= 2) && (CV_MINOR_VERSION >= 2)
+      , cvSize (0, 0)
+#endif
+      );
+
+  for (i = 0; i < (seq ? seq->total : 0); i++) {
+    GstHaarObject o;
+
+    CvAvgComp *comp = (CvAvgComp *) cvGetSeqElem (seq, i);
+
+    o.rect = comp->rect;
+    o.label = label;
+    o.neighbors = comp->neighbors;
+    g_array_append_val (frame->objects, o);
+  }
+}
+
+/* counts the windows of the last detection of @detector in the stats */
+static void
+gst_handdetect_add_stats (GstHanddetect * filter,
+    const GstHaarDetector * detector)
+{
+  GST_OBJECT_LOCK (filter);
+  filter->stats_windows += detector->n_windows;
+  filter->stats_pruned += detector->n_pruned;
+  filter->stats_cached += detector->n_cached;
+  GST_OBJECT_UNLOCK (filter);
+}
+
+/* frame_pool function: full-frame detection of one frame in flight */
+static void
+gst_handdetect_detect_frame (gpointer data, gpointer user_data)
+{
+  GstHanddetect *filter = GST_HANDDETECT (user_data);
+  GstHanddetectFrame *frame = data;
+  GstHanddetectProfiles *p = filter->frame_profiles;
+  gint f = filter->downscale;
+  guint i;
+
+  g_array_set_size (frame->objects, 0);
+  if (p && p->engine == GST_HANDDETECT_ENGINE_NATIVE && frame->detector) {
+    frame->detector->fixed_point = filter->fixed_point;
+    frame->detector->min_edges = filter->prune_edges;
+    frame->detector->min_stddev = filter->prune_stddev;
+    frame->detector->history_refresh = MIN (filter->history_refresh, G_MAXINT);
+    frame->detector->history_depth = filter->history_depth;
+    gst_haar_detector_detect (frame->detector,
+        (const guint8 *) frame->gray->imageData, frame->gray->width,
+        frame->gray->height, frame->gray->widthStep, frame->objects);
+    gst_handdetect_add_stats (filter, frame->detector);
+    for (i = 0; i < frame->objects->len; i++) {
+      GstHaarObject *o = &g_array_index (frame->objects, GstHaarObject, i);
+
+      o->label = o->label == p->haarLabel ? FRAME_LABEL_FIST : FRAME_LABEL_PALM;
+    }
+  } else if (p) {
+    /* the cascades keep per scan state, so frames take turns on them */
+    cvClearMemStorage (frame->storage);
+    g_mutex_lock (p->cvLock);
+    gst_handdetect_detect_frame_legacy (frame, p->cvCascade,
+        FRAME_LABEL_FIST);
+    gst_handdetect_detect_frame_legacy (frame, p->cvCascade_palm,
+        FRAME_LABEL_PALM);
+    g_mutex_unlock (p->cvLock);
+  }
+
+  for (i = 0; i < frame->objects->len; i++) {
+    CvRect *r = &g_array_index (frame->objects, GstHaarObject, i).rect;
+
+    r->x *= f;
+    r->y *= f;
+    r->width *= f;
+    r->height *= f;
+  }
+
+  g_mutex_lock (filter->async_lock);
+  frame->done = TRUE;
+  g_cond_broadcast (filter->frame_done);
+  g_mutex_unlock (filter->async_lock);
+}
+
+/* holds @buffer back and queues its detection, then pushes the frames
+ * that are done, in order, waiting for the oldest one while the maximum
+ * number of frames is in flight */
+static GstFlowReturn
+gst_handdetect_queue_parallel (GstHanddetect * filter, GstBuffer * buffer)
+{
+  GstHanddetectFrame *frame;
+  GstFlowReturn ret;
+  GError *err = NULL;
+
+  /* profiles are only swapped with no frame in flight */
+  if (g_atomic_pointer_get (&filter->pending_profiles)) {
+    if ((ret = gst_handdetect_push_frames (filter, 0)) != GST_FLOW_OK)
+      return ret;
+    gst_handdetect_update_profiles (filter);
+  }
+  gst_handdetect_free_retired (filter);
+  if (filter->frame_profiles != filter->profiles) {
+    if ((ret = gst_handdetect_push_frames (filter, 0)) != GST_FLOW_OK)
+      return ret;
+    gst_handdetect_free_frames (filter);
+    filter->frame_profiles = filter->profiles;
+  }
+
+  if (!filter->frame_pool) {
+    filter->frame_pool = g_thread_pool_new (gst_handdetect_detect_frame,
+        filter, filter->frames_in_flight, FALSE, &err);
+    if (!filter->frame_pool) {
+      GST_ELEMENT_ERROR (filter, RESOURCE, FAILED, (NULL),
+          ("Could not start the detection threads: %s", err->message));
+      g_error_free (err);
+      return GST_FLOW_ERROR;
+    }
+  } else if (g_thread_pool_get_max_threads (filter->frame_pool) !=
+      filter->frames_in_flight) {
+    g_thread_pool_set_max_threads (filter->frame_pool,
+        filter->frames_in_flight, NULL);
+  }
+
+  ret = gst_handdetect_push_frames (filter, filter->frames_in_flight - 1);
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  frame = g_queue_pop_head (filter->free_frames);
+  if (!frame) {
+    frame = g_new0 (GstHanddetectFrame, 1);
+    frame->gray = cvCreateImage (cvSize (filter->cvGray->width,
+            filter->cvGray->height), IPL_DEPTH_8U, 1);
+    if (filter->frame_profiles)
+      frame->detector = gst_handdetect_new_detector (filter->frame_profiles);
+    frame->storage = cvCreateMemStorage (0);
+    frame->objects = g_array_new (FALSE, FALSE, sizeof (GstHaarObject));
+  }
+  cvCopy (filter->cvGray, frame->gray, NULL);
+  frame->buffer = gst_buffer_ref (buffer);
+  frame->done = FALSE;
+  g_queue_push_tail (filter->frames, frame);
+  g_thread_pool_push (filter->frame_pool, frame, NULL);
+
+  ret = gst_handdetect_push_frames (filter, G_MAXUINT);
+  return ret == GST_FLOW_OK ? GST_BASE_TRANSFORM_FLOW_DROPPED : ret;
+}
+
+/* pushes the frames in flight that are done, oldest first, and waits for
+ * the oldest ones until no more than @keep remain */
+static GstFlowReturn
+gst_handdetect_push_frames (GstHanddetect * filter, guint keep)
+{
+  GstHanddetectFrame *frame;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while ((frame = g_queue_peek_head (filter->frames))) {
+    GstBuffer *buffer;
+    CvSeq *hands, *palms;
+    guint i;
+
+    g_mutex_lock (filter->async_lock);
+    if (!frame->done && g_queue_get_length (filter->frames) > keep)
+      while (!frame->done)
+        g_cond_wait (filter->frame_done, filter->async_lock);
+    g_mutex_unlock (filter->async_lock);
+    if (!frame->done)
+      break;
+    g_queue_pop_head (filter->frames);
+
+    /* report in stream order, through the storages of the element */
+    cvClearMemStorage (filter->cvStorage);
+    cvClearMemStorage (filter->cvStorage_palm);
+    hands = cvCreateSeq (0, sizeof (CvSeq), sizeof (CvAvgComp),
+        filter->cvStorage);
+    palms = cvCreateSeq (0, sizeof (CvSeq), sizeof (CvAvgComp),
+        filter->cvStorage_palm);
+    for (i = 0; i < frame->objects->len; i++) {
+      GstHaarObject *o = &g_array_index (frame->objects, GstHaarObject, i);
+      CvAvgComp comp = { o->rect, o->neighbors };
+
+      cvSeqPush (o->label == FRAME_LABEL_FIST ? hands : palms, &comp);
+    }
+    buffer = frame->buffer;
+    frame->buffer = NULL;
+    gst_handdetect_apply_tracks_reset (filter);
+    gst_handdetect_report (filter, hands, palms,
+        GST_BUFFER_TIMESTAMP (buffer));
+    g_queue_push_tail (filter->free_frames, frame);
+
+    if (filter->display && !filter->overlay && filter->result.n_hands > 0) {
+      buffer = gst_buffer_make_writable (buffer);
+      gst_handdetect_draw_result (filter, buffer, &filter->result);
+    }
+
+    if (ret == GST_FLOW_OK)
+      ret = gst_handdetect_push_result (filter, buffer, 0, &filter->result);
+    else
+      gst_buffer_unref (buffer);
+  }
+  return ret;
+}
+
+/* forgets the frames in flight, once their detection is over */
+static void
+gst_handdetect_drop_frames (GstHanddetect * filter)
+{
+  GstHanddetectFrame *frame;
+
+  while ((frame = g_queue_pop_head (filter->frames))) {
+    g_mutex_lock (filter->async_lock);
+    while (!frame->done)
+      g_cond_wait (filter->frame_done, filter->async_lock);
+    g_mutex_unlock (filter->async_lock);
+
+    gst_buffer_unref (frame->buffer);
+    frame->buffer = NULL;
+    g_queue_push_tail (filter->free_frames, frame);
+  }
+}
+
+/* drops the frames in flight and frees all frames */
+static void
+gst_handdetect_free_frames (GstHanddetect * filter)
+{
+  GstHanddetectFrame *frame;
+
+  gst_handdetect_drop_frames (filter);
+  while ((frame = g_queue_pop_head (filter->free_frames)))
+    gst_handdetect_frame_free (frame);
+}
+
+/* frames in flight go out before EOS, and are dropped on flushes */
+static gboolean
+gst_handdetect_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstHanddetect *filter = GST_HANDDETECT (trans);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:{
+      GstFlowReturn ret = gst_handdetect_push_frames (filter, 0);
+
+      if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_UNEXPECTED)
+        GST_ELEMENT_ERROR (filter, STREAM, FAILED,
+            ("Internal data flow error."),
+            ("pushing the frames in flight at EOS failed: %s (%d)",
+                gst_flow_get_name (ret), ret));
+      break;
+    }
+    case GST_EVENT_FLUSH_STOP:
+      gst_handdetect_drop_frames (filter);
+      break;
+    default:
+      break;
+  }
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->event (trans, event);
+}
+
+static gboolean
+gst_handdetect_stop (GstBaseTransform * trans)
+{
+  GstHanddetect *filter = GST_HANDDETECT (trans);
+
+  gst_handdetect_stop_worker (filter);
+  gst_handdetect_drop_frames (filter);
+  if (GST_BASE_TRANSFORM_CLASS (parent_class)->stop)
+    return GST_BASE_TRANSFORM_CLASS (parent_class)->stop (trans);
+  return TRUE;
+}
+
+/* (re)creates the headers of the planes the markers are drawn into,
+ * width 0 just releases them */
+static void
+gst_handdetect_setup_planes (GstHanddetect * filter, gint width, gint height)
+{
+  gint i;
+
+  for (i = 0; i < filter->n_planes; i++)
+    cvReleaseImageHeader (&filter->cvPlane[i]);
+  filter->n_planes = 0;
+  if (width == 0)
+    return;
+
+  for (i = 0; i < G_N_ELEMENTS (plane_infos); i++) {
+    const GstHanddetectPlaneInfo *info = &plane_infos[i];
+    gint n = filter->n_planes;
+
+    if (info->format != filter->format)
+      continue;
+    filter->cvPlane[n] = cvCreateImageHeader (cvSize ((width +
+                (1 << info->sx) - 1) >> info->sx,
+            (height + (1 << info->sy) - 1) >> info->sy), IPL_DEPTH_8U,
+        info->channels);
+    filter->plane_offset[n] =
+        gst_video_format_get_component_offset (filter->format,
+        info->component, width, height);
+    filter->plane_stride[n] =
+        gst_video_format_get_row_stride (filter->format, info->component,
+        width);
+    memcpy (filter->plane_comp[n], info->comp, sizeof (info->comp));
+    filter->plane_sx[n] = info->sx;
+    filter->plane_sy[n] = info->sy;
+    filter->n_planes++;
+  }
+}
+
+/* copies the Y samples of a packed YUY2 frame to the gray image */
+static void
+gst_handdetect_gather_luma (IplImage * gray, const guint8 * src, gint stride)
+{
+  gint x, y;
+
+  for (y = 0; y < gray->height; y++) {
+    const guint8 *s = src + y * stride;
+    guint8 *d = (guint8 *) gray->imageData + y * gray->widthStep;
+
+    for (x = 0; x < gray->width; x++)
+      d[x] = s[2 * x];
+  }
+}
+
+/* pushes @buffer, wrapped with the hands of @result attached, and in
+ * overlay mode their markers added to the overlay composition of @buffer;
+ * @shared counts the references to @buffer held upstream of us besides
+ * the one handed over. Without hands @buffer goes out as it is. */
+static GstFlowReturn
+gst_handdetect_push_result (GstHanddetect * filter, GstBuffer * buffer,
+    gint shared, const GstHanddetectResult * result)
+{
+  GstHanddetectBuffer *out;
+  GstVideoOverlayComposition *comp;
+
+  if (result->n_hands == 0)
+    return gst_pad_push (GST_BASE_TRANSFORM_CAST (filter)->srcpad, buffer);
+
+  out = gst_handdetect_buffer_pool_wrap (filter->buffer_pool, buffer, shared);
+
+  out->detect_timestamp = result->timestamp;
+  out->n_detections = result->n_hands;
+  memcpy (out->detections, result->hands,
+      result->n_hands * sizeof (GstHanddetectDetection));
+
+  /* a recycled buffer may still carry the composition of its last frame */
+  comp = gst_video_buffer_get_overlay_composition (buffer);
+  if (filter->display && filter->overlay) {
+    comp = gst_handdetect_overlay_result (filter, comp, result);
+    gst_video_buffer_set_overlay_composition (GST_BUFFER_CAST (out), comp);
+    gst_video_overlay_composition_unref (comp);
+  } else if (gst_video_buffer_get_overlay_composition (GST_BUFFER_CAST (out))
+      != comp) {
+    gst_video_buffer_set_overlay_composition (GST_BUFFER_CAST (out), comp);
+  }
+
+  return gst_pad_push (GST_BASE_TRANSFORM_CAST (filter)->srcpad,
+      GST_BUFFER_CAST (out));
+}
+
+/* a marker for the overlay: a circle inscribed in the square or its
+ * outline, in @argb on a transparent background */
+static GstBuffer *
+gst_handdetect_marker_new (gboolean circle, guint32 argb)
+{
+  GstBuffer *pixels = gst_buffer_new_and_alloc (MARKER_SIZE * MARKER_SIZE * 4);
+  guint32 *p = (guint32 *) GST_BUFFER_DATA (pixels);
+  gdouble c = (MARKER_SIZE - 1) * 0.5;
+  gint x, y;
+
+  for (y = 0; y < MARKER_SIZE; y++) {
+    for (x = 0; x < MARKER_SIZE; x++) {
+      gboolean on;
+
+      if (circle) {
+        gdouble d = hypot (x - c, y - c);
+
+        on = d <= c && d > c - MARKER_LINE;
+      } else {
+        on = MIN (MIN (x, y), MIN (MARKER_SIZE - 1 - x,
+                MARKER_SIZE - 1 - y)) < MARKER_LINE;
+      }
+      /* native endian ARGB, as the overlay rectangles take it */
+      p[y * MARKER_SIZE + x] = on ? argb : 0;
+    }
+  }
+  return pixels;
+}
+
+/* a composition with the markers of the hands of @result on top of
+ * @base, if any */
+static GstVideoOverlayComposition *
+gst_handdetect_overlay_result (GstHanddetect * filter,
+    GstVideoOverlayComposition * base, const GstHanddetectResult * result)
+{
+  GstVideoOverlayComposition *comp = NULL;
+  guint i;
+
+  if (base)
+    comp = gst_video_overlay_composition_copy (base);
+
+  for (i = 0; i < result->n_hands; i++) {
+    const GstHanddetectDetection *d = &result->hands[i];
+    GstVideoOverlayRectangle *rect;
+
+    rect =
+        gst_video_overlay_rectangle_new_argb (filter->marker_pixels[d->gesture],
+        MARKER_SIZE, MARKER_SIZE, MARKER_SIZE * 4, d->x, d->y, d->width,
+        d->height, GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE);
+    if (comp) {
+      gst_video_overlay_composition_add_rectangle (comp, rect);
+    } else {
+      comp = gst_video_overlay_composition_new (rect);
+    }
+    gst_video_overlay_rectangle_unref (rect);
+  }
+  return comp;
+}
+
+/* marks the hands of @result in the frame: fists with a blue circle,
+ * palms with a green rectangle */
+static void
+gst_handdetect_draw_result (GstHanddetect * filter, GstBuffer * buffer,
+    const GstHanddetectResult * result)
+{
+  CvRect r;
+  guint i;
+
+  for (i = 0; i < result->n_hands; i++) {
+    const GstHanddetectDetection *d = &result->hands[i];
+
+    r = cvRect (d->x, d->y, d->width, d->height);
+    if (d->gesture == GST_HANDDETECT_GESTURE_FIST)
+      gst_handdetect_draw_hand (filter, buffer, &r, TRUE, CV_RGB (0, 0, 200));
+    else
+      gst_handdetect_draw_hand (filter, buffer, &r, FALSE,
+          CV_RGB (0, 200, 0));
+  }
+}
+
+/* marks a hand in the frame, with a circle or its rectangle, converting
+ * the CV_RGB () colour to the frame format */
+static void
+gst_handdetect_draw_hand (GstHanddetect * filter, GstBuffer * buffer,
+    const CvRect * r, gboolean circle, CvScalar color)
+{
+  CvPoint center = cvPoint (cvRound (r->x + r->width * 0.5),
+      cvRound (r->y + r->height * 0.5));
+  gint radius = cvRound ((r->width + r->height) * 0.25);
+  gdouble red = color.val[2], green = color.val[1], blue = color.val[0];
+  gdouble yuv[3];
+  gint i, c;
+
+  if (filter->format == GST_VIDEO_FORMAT_RGB) {
+    filter->cvImage->imageData = (char *) GST_BUFFER_DATA (buffer);
+    if (circle)
+      cvCircle (filter->cvImage, center, radius, color, 1, 8, 0);
+    else
+      cvRectangle (filter->cvImage, cvPoint (r->x, r->y),
+          cvPoint (r->x + r->width, r->y + r->height), color, 1, 8, 0);
+    return;
+  }
+
+  /* BT.601, studio range */
+  yuv[0] = 16 + 0.257 * red + 0.504 * green + 0.098 * blue;
+  yuv[1] = 128 - 0.148 * red - 0.291 * green + 0.439 * blue;
+  yuv[2] = 128 + 0.439 * red - 0.368 * green - 0.071 * blue;
+
+  for (i = 0; i < filter->n_planes; i++) {
+    IplImage *plane = filter->cvPlane[i];
+    gint sx = filter->plane_sx[i], sy = filter->plane_sy[i];
+    CvScalar value = cvScalarAll (0);
+
+    cvSetData (plane, GST_BUFFER_DATA (buffer) + filter->plane_offset[i],
+        filter->plane_stride[i]);
+    for (c = 0; c < plane->nChannels; c++)
+      value.val[c] = yuv[filter->plane_comp[i][c]];
+    if (circle)
+      cvEllipse (plane, cvPoint (center.x >> sx, center.y >> sy),
+          cvSize (radius >> sx, radius >> sy), 0, 0, 360, value, 1, 8, 0);
+    else
+      cvRectangle (plane, cvPoint (r->x >> sx, r->y >> sy),
+          cvPoint ((r->x + r->width) >> sx, (r->y + r->height) >> sy), value,
+          1, 8, 0);
+  }
+}
+
+/* cvHaarDetectObjects () on the ROI of the gray frame, with the hands
+ * moved back to frame coordinates */
+static CvSeq *
+gst_handdetect_detect_legacy (GstHanddetect * filter, IplImage * gray,
+    CvHaarClassifierCascade * cascade, CvMemStorage * storage,
+    CvSize min_size, CvSize max_size)
+{
+  CvRect roi = cvGetImageROI (gray);
+  CvSeq *hands;
+  int i;
+
+  if (!cascade)
+    return NULL;
+
+  hands =
+      cvHaarDetectObjects (gray, cascade, storage,
+      HAAR_SCALE_FACTOR, HAAR_MIN_NEIGHBORS, CV_HAAR_DO_CANNY_PRUNING, min_size
+#if (CV_MAJOR_VERSION >= 2) && (CV_MINOR_VERSION >= 2)
+      , max_size
+#endif
+      );
+
+  for (i = 0; i < (hands ? hands->total : 0); i++) {
+    CvRect *r = (CvRect *) cvGetSeqElem (hands, i);
+    r->x += roi.x;
+    r->y += roi.y;
+  }
+  return hands;
+}
+
+/* Runs the fist and palm cascades over @region of the gray frame (all of it
+ * when NULL) with windows between @min_size and @max_size (0 for no limit).
+ * Fists are returned, palms stored in @palms, in frame coordinates and in
+ * filter->cvStorage and filter->cvStorage_palm.
+ */
+static CvSeq *
+gst_handdetect_detect_gray (GstHanddetect * filter, IplImage * gray,
+    const CvRect * region, CvSize min_size, CvSize max_size, CvSeq ** palms)
+{
+  GstHanddetectProfiles *p = filter->profiles;
+  CvSeq *hands;
+  int i;
+
+  *palms = NULL;
+  if (!p)
+    return NULL;
+
+  if (p->engine == GST_HANDDETECT_ENGINE_NATIVE && p->haarDetector) {
+    /* detect both gestures in a single pass of the native evaluator, then
+     * hand the result over in the same CvSeq form cvHaarDetectObjects
+     * returns */
+    gst_haar_detector_detect_region (p->haarDetector,
+        (const guint8 *) gray->imageData, gray->width,
+        gray->height, gray->widthStep, region, min_size,
+        max_size, filter->haarHands);
+    gst_handdetect_add_stats (filter, p->haarDetector);
+    hands = cvCreateSeq (0, sizeof (CvSeq), sizeof (CvAvgComp),
+        filter->cvStorage);
+    *palms = cvCreateSeq (0, sizeof (CvSeq), sizeof (CvAvgComp),
+        filter->cvStorage_palm);
+    for (i = 0; i < filter->haarHands->len; i++) {
+      GstHaarObject *o = &g_array_index (filter->haarHands, GstHaarObject, i);
+      CvAvgComp comp = { o->rect, o->neighbors };
+
+      if (o->label == p->haarLabel)
+        cvSeqPush (hands, &comp);
+      else if (o->label == p->haarLabel_palm)
+        cvSeqPush (*palms, &comp);
+    }
+    return hands;
+  }
+
+  if (region) {
+    CvRect roi = cvRect (MAX (region->x, 0), MAX (region->y, 0), 0, 0);
+
+    roi.width = MIN (region->x + region->width, gray->width) - roi.x;
+    roi.height =
+        MIN (region->y + region->height, gray->height) - roi.y;
+    if (roi.width <= 0 || roi.height <= 0)
+      return cvCreateSeq (0, sizeof (CvSeq), sizeof (CvAvgComp),
+          filter->cvStorage);
+    cvSetImageROI (gray, roi);
+  }
+
+  /* detect hands, one cascade after the other */
+  hands = gst_handdetect_detect_legacy (filter, gray, p->cvCascade,
+      filter->cvStorage, min_size, max_size);
+  *palms = gst_handdetect_detect_legacy (filter, gray, p->cvCascade_palm,
+      filter->cvStorage_palm, min_size, max_size);
+
+  cvResetImageROI (gray);
+  return hands;
+}
+
+static void
+gst_handdetect_upscale (CvSeq * seq, gint factor)
+{
+  int i;
+
+  for (i = 0; seq && i < seq->total; i++) {
+    CvRect *r = (CvRect *) cvGetSeqElem (seq, i);
+
+    r->x *= factor;
+    r->y *= factor;
+    r->width *= factor;
+    r->height *= factor;
+  }
+}
+
+/* detects on @gray, which is filter->downscale times smaller than the
+ * frame: @region, the sizes and the hands found are in frame
+ * coordinates */
+static CvSeq *
+gst_handdetect_detect (GstHanddetect * filter, IplImage * gray,
+    const CvRect * region, CvSize min_size, CvSize max_size, CvSeq ** palms)
+{
+  gint f = filter->downscale;
+  CvRect scaled;
+  CvSeq *hands;
+
+  if (f == 1)
+    return gst_handdetect_detect_gray (filter, gray, region, min_size, max_size,
+        palms);
+
+  if (region) {
+    scaled.x = cvFloor ((double) region->x / f);
+    scaled.y = cvFloor ((double) region->y / f);
+    scaled.width = cvCeil ((double) (region->x + region->width) / f)
+        - scaled.x;
+    scaled.height = cvCeil ((double) (region->y + region->height) / f)
+        - scaled.y;
+    region = &scaled;
+  }
+  min_size = cvSize (min_size.width / f, min_size.height / f);
+  max_size = cvSize ((max_size.width + f - 1) / f,
+      (max_size.height + f - 1) / f);
+
+  hands = gst_handdetect_detect_gray (filter, gray, region, min_size, max_size,
+      palms);
+  gst_handdetect_upscale (hands, f);
+  gst_handdetect_upscale (*palms, f);
+  return hands;
+}
+
+/* whether the center of @r is in the region of interest, or the region of
+ * interest remains default as (0,0,0,0) */
+static gboolean
+gst_handdetect_in_roi (GstHanddetect * filter, const CvRect * r)
+{
+  CvPoint c = cvPoint (r->x + r->width / 2, r->y + r->height / 2);
+
+  return (c.x >= filter->roi_x && c.x <= (filter->roi_x + filter->roi_width)
+      && c.y >= filter->roi_y
+      && c.y <= (filter->roi_y + filter->roi_height))
+      || (filter->roi_x == 0
+      && filter->roi_y == 0 && filter->roi_width == 0
+      && filter->roi_height == 0);
+}
+
+/* post a detected_hand_info message for @r, the hand of @track_id, to
+ * app/bus */
+static void
+gst_handdetect_post_hand (GstHanddetect * filter, const gchar * gesture,
+    const CvRect * r, guint track_id, GstClockTime timestamp)
+{
+  GstStructure *s;
+  GstMessage *m;
+
+  /* Define structure for message post */
+  s = gst_structure_new ("detected_hand_info",
+      "gesture", G_TYPE_STRING, gesture,
+      "x", G_TYPE_UINT, (uint) (r->x + r->width * 0.5),
+      "y", G_TYPE_UINT, (uint) (r->y + r->height * 0.5),
+      "width", G_TYPE_UINT, (uint) r->width,
+      "height", G_TYPE_UINT, (uint) r->height,
+      "track-id", G_TYPE_UINT, track_id,
+      "timestamp", G_TYPE_UINT64, timestamp, NULL);
+  /* Init message element */
+  m = gst_message_new_element (GST_OBJECT (filter), s);
+  /* Send message */
+  gst_element_post_message (GST_ELEMENT (filter), m);
+}
+
+/* Loads @profile for @engine: for the native one, an OpenCV XML cascade
+ * or a binary one from gst-haar-convert, through the process-wide cascade
+ * cache, so instances using the same file share one copy. For the legacy
+ * one with cvLoad (): cvHaarDetectObjects () writes into its cascade, so
+ * it can't be shared.
+ */
+static void
+gst_handdetect_load_cascade (GstHanddetect * filter, const gchar * profile,
+    GstHanddetectEngine engine, CvHaarClassifierCascade ** cv,
+    GstHaarCascade ** haar)
+{
+  GError *err = NULL;
+
+  *cv = NULL;
+  *haar = NULL;
+  if (engine == GST_HANDDETECT_ENGINE_LEGACY) {
+    *cv = (CvHaarClassifierCascade *) cvLoad (profile, 0, 0, 0);
+    if (!*cv) {
+      GST_WARNING_OBJECT (filter,
+          "WARNING: Could not load HAAR classifier cascade: %s.\n", profile);
+      return;
+    }
+  } else {
+    *haar = gst_haar_cascade_open (profile, &err);
+    if (!*haar) {
+      GST_WARNING_OBJECT (filter,
+          "WARNING: Could not load HAAR classifier cascade: %s.\n",
+          err ? err->message : profile);
+      g_clear_error (&err);
+      return;
+    }
+  }
+  GST_DEBUG_OBJECT (filter, "Loaded profile %s\n", profile);
+}
+
+static void
+gst_handdetect_profiles_free (GstHanddetectProfiles * profiles)
+{
+  if (!profiles)
+    return;
+
+  gst_haar_detector_free (profiles->haarDetector);
+  gst_haar_cascade_unref (profiles->haarCascade);
+  gst_haar_cascade_unref (profiles->haarCascade_palm);
+  if (profiles->cvCascade)
+    cvReleaseHaarClassifierCascade (&profiles->cvCascade);
+  if (profiles->cvCascade_palm)
+    cvReleaseHaarClassifierCascade (&profiles->cvCascade_palm);
+  g_mutex_free (profiles->cvLock);
+  g_free (profiles);
+}
+
+/* loader thread: builds a set from the current profile names and publishes
+ * it, replacing a set published earlier that was not picked up yet */
+static void
+gst_handdetect_load_profiles (gpointer data, gpointer user_data)
+{
+  GstHanddetect *filter = GST_HANDDETECT (user_data);
+  GstHanddetectProfiles *p, *old;
+  GstHanddetectEngine engine;
+  gchar *profile, *profile_palm;
+
+  GST_DEBUG_OBJECT (filter, "Loading profiles...\n");
+
+  g_mutex_lock (filter->lock);
+  profile = g_strdup (filter->profile);
+  profile_palm = g_strdup (filter->profile_palm);
+  engine = filter->engine;
+  g_mutex_unlock (filter->lock);
+
+  /* OpenCV only reads XML cascades */
+  if (engine == GST_HANDDETECT_ENGINE_LEGACY &&
+      (gst_haar_cascade_is_binary (profile) ||
+          gst_haar_cascade_is_binary (profile_palm))) {
+    GST_ELEMENT_WARNING (filter, RESOURCE, SETTINGS,
+        ("The legacy engine can't load binary profiles, using the native one"),
+        ("%s is a binary cascade", gst_haar_cascade_is_binary (profile) ?
+            profile : profile_palm));
+    engine = GST_HANDDETECT_ENGINE_NATIVE;
+  }
+
+  p = g_new0 (GstHanddetectProfiles, 1);
+  p->engine = engine;
+  p->cvLock = g_mutex_new ();
+  p->haarLabel = -1;
+  p->haarLabel_palm = -1;
+  gst_handdetect_load_cascade (filter, profile, engine, &p->cvCascade,
+      &p->haarCascade);
+  gst_handdetect_load_cascade (filter, profile_palm, engine,
+      &p->cvCascade_palm, &p->haarCascade_palm);
+  g_free (profile);
+  g_free (profile_palm);
+
+  if (p->cvCascade)
+    p->window = p->cvCascade->orig_window_size;
+  else if (p->haarCascade)
+    p->window = cvSize (p->haarCascade->window_width,
+        p->haarCascade->window_height);
+
+  /* the native engine scans both cascades together, there is none for
+   * the legacy one */
+  p->haarDetector = gst_handdetect_new_detector (p);
+  if (p->haarCascade) {
+    p->haarLabel = 0;
+    if (p->haarCascade_palm)
+      p->haarLabel_palm = 1;
+  } else if (p->haarCascade_palm) {
+    p->haarLabel_palm = 0;
+  }
+  p->n_threads = 1;
+
+  do {
+    old = g_atomic_pointer_get (&filter->pending_profiles);
+  } while (!g_atomic_pointer_compare_and_exchange (&filter->pending_profiles,
+          old, p));
+  gst_handdetect_profiles_free (old);
+
+  g_mutex_lock (filter->lock);
+  if (--filter->loads == 0)
+    g_cond_broadcast (filter->loaded);
+  g_mutex_unlock (filter->lock);
+}
+
+/* queue a (re)load of the profiles, never blocks on the loading itself */
+static void
+gst_handdetect_load_profile (GstHanddetect * filter)
+{
+  g_mutex_lock (filter->lock);
+  filter->loads++;
+  g_mutex_unlock (filter->lock);
+  g_thread_pool_push (filter->loader, filter, NULL);
+}
+
+static void
+gst_handdetect_wait_profiles (GstHanddetect * filter)
+{
+  g_mutex_lock (filter->lock);
+  while (filter->loads > 0)
+    g_cond_wait (filter->loaded, filter->lock);
+  g_mutex_unlock (filter->lock);
+}
+
+/* Detection thread (the streaming thread, or the worker in async mode):
+ * take over the newest published set, if any. The old set is handed to
+ * the streaming thread, idle frame-parallel detectors may still use its
+ * cascades. Also applies n-threads and fixed-point here rather than under
+ * a running detection.
+ */
+static void
+gst_handdetect_update_profiles (GstHanddetect * filter)
+{
+  GstHanddetectProfiles *p = g_atomic_pointer_get (&filter->pending_profiles);
+  GError *err = NULL;
+
+  if (p && g_atomic_pointer_compare_and_exchange (&filter->pending_profiles,
+          p, NULL)) {
+    if (filter->profiles) {
+      g_mutex_lock (filter->lock);
+      filter->retired_profiles = g_slist_prepend (filter->retired_profiles,
+          filter->profiles);
+      g_mutex_unlock (filter->lock);
+    }
+    filter->profiles = p;
+    gst_handdetect_reset_tracks (filter);
+    gst_hand_motion_reset (filter->motion);
+    GST_DEBUG_OBJECT (filter, "Switched to new profiles\n");
+  }
+
+  p = filter->profiles;
+  if (!p || !p->haarDetector)
+    return;
+
+  p->haarDetector->fixed_point = filter->fixed_point;
+  p->haarDetector->min_edges = filter->prune_edges;
+  p->haarDetector->min_stddev = filter->prune_stddev;
+  p->haarDetector->history_refresh = MIN (filter->history_refresh, G_MAXINT);
+  p->haarDetector->history_depth = filter->history_depth;
+  if (p->n_threads == filter->n_threads)
+    return;
+
+  p->n_threads = filter->n_threads;
+  if (!gst_haar_detector_set_threads (p->haarDetector, p->n_threads, &err)) {
+    GST_WARNING_OBJECT (filter,
+        "WARNING: Could not start %u detection threads: %s.\n",
+        p->n_threads, err ? err->message : "unknown error");
+    g_clear_error (&err);
+  }
+}
+
+/* Streaming thread, with no frame in flight: frees the sets swapped out
+ * since the last call, along with the idle frames using one of them */
+static void
+gst_handdetect_free_retired (GstHanddetect * filter)
+{
+  GSList *retired, *l;
+
+  g_mutex_lock (filter->lock);
+  retired = filter->retired_profiles;
+  filter->retired_profiles = NULL;
+  g_mutex_unlock (filter->lock);
+
+  if (g_slist_find (retired, filter->frame_profiles)) {
+    gst_handdetect_free_frames (filter);
+    filter->frame_profiles = NULL;
+  }
+  for (l = retired; l; l = l->next)
+    gst_handdetect_profiles_free (l->data);
+  g_slist_free (retired);
+}
+
+#ifdef HAVE_INOTIFY
+/* whether @name is the file name of one of the profiles */
+static gboolean
+gst_handdetect_is_profile (GstHanddetect * filter, const gchar * name)
+{
+  gchar *base, *base_palm;
+  gboolean ret;
+
+  g_mutex_lock (filter->lock);
+  base = g_path_get_basename (filter->profile);
+  base_palm = g_path_get_basename (filter->profile_palm);
+  g_mutex_unlock (filter->lock);
+
+  ret = g_str_equal (name, base) || g_str_equal (name, base_palm);
+  g_free (base);
+  g_free (base_palm);
+  return ret;
+}
+
+/* Watches the directories rather than the files, editors and deployment
+ * tools tend to replace a file rather than rewrite it. Runs until woken up
+ * through watch_wake. */
+static gpointer
+gst_handdetect_watch_thread (gpointer data)
+{
+  GstHanddetect *filter = GST_HANDDETECT (data);
+  gchar buf[4096] __attribute__ ((aligned (__alignof__ (struct
+                  inotify_event))));
+  struct pollfd fds[2];
+
+  fds[0].fd = filter->watch_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = filter->watch_wake[0];
+  fds[1].events = POLLIN;
+
+  for (;;) {
+    gboolean reload = FALSE;
+    ssize_t len;
+    gchar *ptr;
+
+    if (poll (fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents)
+      break;
+
+    len = read (filter->watch_fd, buf, sizeof (buf));
+    for (ptr = buf; len > 0 && ptr < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *) ptr;
+
+      if (event->len && gst_handdetect_is_profile (filter, event->name))
+        reload = TRUE;
+      ptr += sizeof (struct inotify_event) + event->len;
+    }
+
+    if (reload) {
+      GST_DEBUG_OBJECT (filter, "Profile changed, reloading\n");
+      gst_handdetect_load_profile (filter);
+    }
+  }
+  return NULL;
+}
+
+static void
+gst_handdetect_set_watch (GstHanddetect * filter, gboolean watch)
+{
+  GError *err = NULL;
+  gchar *dir[2];
+  gint i;
+
+  /* stop any running watch, a new one is set up for the current profiles */
+  if (filter->watcher) {
+    if (write (filter->watch_wake[1], "", 1) != 1)
+      GST_WARNING_OBJECT (filter, "WARNING: Could not stop profile watch.\n");
+    g_thread_join (filter->watcher);
+    filter->watcher = NULL;
+    close (filter->watch_wake[0]);
+    close (filter->watch_wake[1]);
+    close (filter->watch_fd);
+    filter->watch_fd = -1;
+  }
+  filter->watch_profiles = watch;
+  if (!watch)
+    return;
+
+  filter->watch_fd = inotify_init ();
+  if (filter->watch_fd < 0 || pipe (filter->watch_wake) < 0) {
+    GST_WARNING_OBJECT (filter,
+        "WARNING: Could not watch profiles: %s.\n", g_strerror (errno));
+    if (filter->watch_fd >= 0)
+      close (filter->watch_fd);
+    filter->watch_fd = -1;
+    return;
+  }
+
+  g_mutex_lock (filter->lock);
+  dir[0] = g_path_get_dirname (filter->profile);
+  dir[1] = g_path_get_dirname (filter->profile_palm);
+  g_mutex_unlock (filter->lock);
+  for (i = 0; i < 2; i++) {
+    filter->watch_wd[i] = inotify_add_watch (filter->watch_fd, dir[i],
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (filter->watch_wd[i] < 0)
+      GST_WARNING_OBJECT (filter, "WARNING: Could not watch %s: %s.\n",
+          dir[i], g_strerror (errno));
+    g_free (dir[i]);
+  }
+
+  filter->watcher =
+      g_thread_create (gst_handdetect_watch_thread, filter, TRUE, &err);
+  if (!filter->watcher) {
+    GST_WARNING_OBJECT (filter,
+        "WARNING: Could not start profile watch: %s.\n", err->message);
+    g_clear_error (&err);
+    close (filter->watch_wake[0]);
+    close (filter->watch_wake[1]);
+    close (filter->watch_fd);
+    filter->watch_fd = -1;
+  }
+}
+#else
+static void
+gst_handdetect_set_watch (GstHanddetect * filter, gboolean watch)
+{
+  if (watch)
+    GST_WARNING_OBJECT (filter,
+        "WARNING: Watching profiles needs inotify, not available.\n");
+  filter->watch_profiles = FALSE;
+}
+#endif
+
 /* Entry point to initialize the plug-in
  * Initialize the plug-in itself
  * Register the element factories and other features
@@ -641,7 +2746,7 @@ gst_handdetect_plugin_init (GstPlugin * plugin)
       0,
       "Performs hand gesture detection (fist and palm), providing detected hand positions via bus messages/navigation events, and dealing with hand events");
   return gst_element_register (plugin, "handdetect", GST_RANK_NONE,
-      GST_TYPE_HANDDETECT);
+      GST_TYPE_HANDDETECT) && gst_handdetect_mux_plugin_init (plugin);
 }
 
 /* PACKAGE: this is usually set by autotools depending on some _INIT macro
@@ -55,6 +55,8 @@
 #include <stdlib.h>
 #include <gst/gst.h>
 #include <gst/video/gstvideofilter.h>
+#include <gst/video/video.h>
+#include <gst/video/video-overlay-composition.h>
 /* opencv includes */
 #include <opencv/cv.h>
 #include <opencv/cxcore.h>
@@ -63,6 +65,14 @@
 #include <opencv2/objdetect/objdetect.hpp>
 #endif
 #include "gstopencvvideofilter.h"
+#include "gsthaarcascade.h"
+#include "gsthaardetector.h"
+#include "gsthaarresample.h"
+#include "gsthanddetectbuffer.h"
+#include "gsthanddetectcommon.h"
+#include "gsthandtracker.h"
+#include "gsthandgesture.h"
+#include "gsthandmotion.h"
 
 G_BEGIN_DECLS
 /* #defines don't like whitespacey bits */
@@ -78,18 +88,138 @@ G_BEGIN_DECLS
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_HANDDETECT))
 typedef struct _GstHanddetect GstHanddetect;
 typedef struct _GstHanddetectClass GstHanddetectClass;
+typedef struct _GstHanddetectProfiles GstHanddetectProfiles;
+typedef struct _GstHanddetectResult GstHanddetectResult;
+typedef struct _GstHanddetectFrame GstHanddetectFrame;
+
+/* detection engines:
+ * LEGACY - cvHaarDetectObjects () on the OpenCV cascade,
+ * NATIVE - built-in SIMD cascade evaluator (gsthaardetector.c)
+ */
+typedef enum
+{
+  GST_HANDDETECT_ENGINE_LEGACY,
+  GST_HANDDETECT_ENGINE_NATIVE
+} GstHanddetectEngine;
+
+/* Everything loaded from profile and profile_palm. Sets are built by the
+ * loader thread and handed to the streaming thread as a whole, which owns
+ * the set in use:
+ * engine - the one the set runs on: native when the legacy engine was
+ * given a binary profile, which OpenCV can't read; only its cascades
+ * are loaded,
+ * cvCascade* - OpenCV cascades, for the legacy engine,
+ * cvLock - taken by the frames in flight around a legacy scan, as the
+ * cascades keep per scan state,
+ * haarCascade* - the same flattened for the native engine, shared with
+ * other instances through the cascade cache,
+ * haarDetector - native detector scanning both, haarLabel* tell their
+ * detections apart (-1 when not loaded),
+ * window - detection window of the fist cascade (0x0 when not loaded)
+ */
+struct _GstHanddetectProfiles
+{
+  GstHanddetectEngine engine;
+  CvSize window;
+  CvHaarClassifierCascade *cvCascade;
+  CvHaarClassifierCascade *cvCascade_palm;
+  GMutex *cvLock;
+  GstHaarCascade *haarCascade;
+  GstHaarCascade *haarCascade_palm;
+  GstHaarDetector *haarDetector;
+  gint haarLabel;
+  gint haarLabel_palm;
+  guint n_threads;
+};
+
+/* the hands the markers are drawn for and attached to the buffers, one
+ * per track found on the frame of @timestamp */
+struct _GstHanddetectResult
+{
+  guint n_hands;
+  GstHanddetectDetection hands[GST_HANDDETECT_MAX_DETECTIONS];
+  GstClockTime timestamp;
+};
+
+/* a frame in flight in frame-parallel mode: the buffer held back until
+ * its turn, the gray image detected on, and its own detector (the one
+ * of the profiles is not reentrant) */
+struct _GstHanddetectFrame
+{
+  GstBuffer *buffer;
+  IplImage *gray;
+  GstHaarDetector *detector;
+  CvMemStorage *storage;
+  GArray *objects;              /* GstHaarObject, label 0 fist, 1 palm */
+  gboolean done;
+};
 
 struct _GstHanddetect
 {
   GstOpencvVideoFilter element;
 
   gboolean display;
+  gboolean overlay;
   gchar *profile, *profile_palm;
-  /* region of interest */
+  GstHanddetectEngine engine;
+  guint n_threads;
+  gboolean fixed_point;
+  /* native engine prefilter and history, and the windows it saw, pruned
+   * and rejected from the history so far */
+  gdouble prune_edges;
+  gdouble prune_stddev;
+  guint history_refresh;
+  guint history_depth;
+  guint64 stats_windows;
+  guint64 stats_pruned;
+  guint64 stats_cached;
+  /* only scan the blocks of the gray frame that moved, keep the last
+   * result while none do */
+  gboolean motion_gate;
+  guint motion_threshold;
+  GstHandMotion *motion;
+  gboolean tracking;
+  gboolean tracks_reset;        /* under the object lock */
+  guint keyframe_interval;
+  /* region of interest, with roi_search only this region (plus a margin)
+   * is scanned */
+  gboolean roi_search;
   uint roi_x;
   uint roi_y;
   uint roi_width;
   uint roi_height;
+  /* working resolution, larger frames are detected on a downscaled copy */
+  guint detect_width;
+  guint detect_height;
+  gboolean async;
+  guint frames_in_flight;
+  /* detected_hand_info messages, at most one frame's every
+   * message_interval ms of stream time */
+  gboolean post_messages;
+  guint message_interval;
+  GstClockTime last_post;
+  /* post the gestures of the hands instead, one recognizer per track */
+  gboolean gestures;
+  GArray *hand_gestures;        /* GstHandGesture */
+
+  /* negotiated format, for GRAY8, I420 and NV12 cvGray is a view of the
+   * luma plane of the incoming buffer */
+  GstVideoFormat format;
+  /* the planes of YUV frames the markers are drawn into: headers, offsets,
+   * what each channel holds (0 Y, 1 U, 2 V) and their subsampling */
+  IplImage *cvPlane[3];
+  gint plane_offset[3];
+  gint plane_stride[3];
+  gint plane_comp[3][4];
+  gint plane_sx[3];
+  gint plane_sy[3];
+  gint n_planes;
+  /* frame size, frame size / detection size and the gray conversion
+   * doing it */
+  gint frame_width;
+  gint frame_height;
+  gint downscale;
+  GstHaarResampler *resampler;
 
   /* opencv
    * cvImage - image from video cam,
@@ -98,12 +228,59 @@ struct _GstHanddetect
    */
   IplImage *cvImage;
   IplImage *cvGray;
-  CvHaarClassifierCascade *cvCascade;
-  CvHaarClassifierCascade *cvCascade_palm;
   CvMemStorage *cvStorage;
   CvMemStorage *cvStorage_palm;
-  CvRect *prev_r;
-  CvRect *best_r;
+  GArray *haarHands;
+
+  /* profiles in use by the streaming thread, and the newest set from the
+   * loader waiting to be picked up by it (swapped atomically) */
+  GstHanddetectProfiles *profiles;
+  volatile gpointer pending_profiles;
+  GThreadPool *loader;
+  GMutex *lock;                 /* profile names and the fields below */
+  GCond *loaded;
+  gint loads;                   /* queued and running loads */
+  GSList *retired_profiles;     /* swapped out, freed by the streaming thread */
+  /* inotify watch on the profile directories */
+  gboolean watch_profiles;
+  gint watch_fd;
+  gint watch_wd[2];
+  gint watch_wake[2];
+  GThread *watcher;
+
+  /* the hands tracked, the detections of the last frame fed to them,
+   * and the frames run since the last full-frame scan */
+  GstHandTracks *tracks;
+  GArray *hand_objects;         /* GstHaarObject */
+  guint frames_since_keyframe;
+
+  /* async detection: the worker takes the newest gray frame from
+   * async_next (swapping it with async_gray), the latest result is
+   * drawn by the streaming thread; all under async_lock */
+  GThread *worker;
+  GMutex *async_lock;
+  GCond *async_cond;
+  IplImage *async_gray;
+  IplImage *async_next;
+  GstClockTime async_timestamp;
+  gboolean async_pending;
+  gboolean async_stop;
+  GstHanddetectResult result;
+
+  /* frame-parallel detection: frames in flight oldest first, detected
+   * by frame_pool and pushed in order by the streaming thread, and the
+   * idle ones kept for reuse with the detectors of frame_profiles */
+  GThreadPool *frame_pool;
+  GQueue *frames;
+  GQueue *free_frames;
+  GstHanddetectProfiles *frame_profiles;
+  GCond *frame_done;
+
+  /* the buffers pushed, with the result attached */
+  GstHanddetectBufferPool *buffer_pool;
+  /* ARGB markers for the overlay composition, indexed by
+   * GstHanddetectGesture and scaled to the hand when rendered */
+  GstBuffer *marker_pixels[2];
 };
 
 struct _GstHanddetectClass
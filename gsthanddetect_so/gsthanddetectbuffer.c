@@ -0,0 +1,213 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthanddetectbuffer.c: buffers carrying the hands detected on them
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gsthanddetectbuffer.h"
+
+/* idle buffers kept for reuse */
+#define MAX_IDLE_BUFFERS 16
+
+struct _GstHanddetectBufferPool
+{
+  GMutex *lock;
+  GQueue idle;
+  gboolean active;
+  volatile gint refcount;
+};
+
+static GstBufferClass *parent_class;
+
+static void
+gst_handdetect_buffer_pool_unref (GstHanddetectBufferPool * pool)
+{
+  if (!g_atomic_int_dec_and_test (&pool->refcount))
+    return;
+  g_mutex_free (pool->lock);
+  g_free (pool);
+}
+
+/* the last ref is gone: back to the pool while it is active, resurrected
+ * with a fresh ref, otherwise really freed */
+static void
+gst_handdetect_buffer_finalize (GstHanddetectBuffer * buffer)
+{
+  GstHanddetectBufferPool *pool = buffer->pool;
+
+  if (buffer->parent) {
+    gst_buffer_unref (buffer->parent);
+    buffer->parent = NULL;
+  }
+  GST_BUFFER_DATA (buffer) = NULL;
+  GST_BUFFER_SIZE (buffer) = 0;
+
+  g_mutex_lock (pool->lock);
+  if (pool->active && g_queue_get_length (&pool->idle) < MAX_IDLE_BUFFERS) {
+    gst_buffer_set_caps (GST_BUFFER_CAST (buffer), NULL);
+    GST_MINI_OBJECT_FLAGS (buffer) = 0;
+    gst_buffer_ref (GST_BUFFER_CAST (buffer));
+    g_queue_push_tail (&pool->idle, buffer);
+    g_mutex_unlock (pool->lock);
+    return;
+  }
+  g_mutex_unlock (pool->lock);
+
+  gst_handdetect_buffer_pool_unref (pool);
+  GST_MINI_OBJECT_CLASS (parent_class)->finalize (GST_MINI_OBJECT (buffer));
+}
+
+static void
+gst_handdetect_buffer_class_init (gpointer g_class, gpointer class_data)
+{
+  GstMiniObjectClass *mini_object_class = GST_MINI_OBJECT_CLASS (g_class);
+
+  parent_class = g_type_class_peek_parent (g_class);
+  mini_object_class->finalize =
+      (GstMiniObjectFinalizeFunction) gst_handdetect_buffer_finalize;
+}
+
+GType
+gst_handdetect_buffer_get_type (void)
+{
+  static volatile gsize type = 0;
+
+  if (g_once_init_enter (&type)) {
+    static const GTypeInfo info = {
+      sizeof (GstBufferClass),
+      NULL,
+      NULL,
+      gst_handdetect_buffer_class_init,
+      NULL,
+      NULL,
+      sizeof (GstHanddetectBuffer),
+      0,
+      NULL,
+      NULL
+    };
+    GType t = g_type_register_static (GST_TYPE_BUFFER, "GstHanddetectBuffer",
+        &info, 0);
+
+    g_once_init_leave (&type, t);
+  }
+  return type;
+}
+
+/* the detections attached to @buffer, NULL when it has none */
+const GstHanddetectDetection *
+gst_handdetect_buffer_get_detections (GstBuffer * buffer,
+    guint * n_detections, GstClockTime * detect_timestamp)
+{
+  GstHanddetectBuffer *hbuf;
+
+  if (!GST_IS_HANDDETECT_BUFFER (buffer)) {
+    *n_detections = 0;
+    return NULL;
+  }
+  hbuf = (GstHanddetectBuffer *) buffer;
+  *n_detections = hbuf->n_detections;
+  if (detect_timestamp)
+    *detect_timestamp = hbuf->detect_timestamp;
+  return hbuf->n_detections ? hbuf->detections : NULL;
+}
+
+void
+gst_handdetect_buffer_add (GstHanddetectBuffer * buffer,
+    GstHanddetectGesture gesture, const CvRect * r, gfloat score,
+    guint track_id)
+{
+  GstHanddetectDetection *d;
+
+  if (buffer->n_detections == GST_HANDDETECT_MAX_DETECTIONS)
+    return;
+  d = &buffer->detections[buffer->n_detections++];
+  d->x = r->x;
+  d->y = r->y;
+  d->width = r->width;
+  d->height = r->height;
+  d->gesture = gesture;
+  d->score = score;
+  d->track_id = track_id;
+}
+
+GstHanddetectBufferPool *
+gst_handdetect_buffer_pool_new (void)
+{
+  GstHanddetectBufferPool *pool = g_new0 (GstHanddetectBufferPool, 1);
+
+  pool->lock = g_mutex_new ();
+  g_queue_init (&pool->idle);
+  pool->active = TRUE;
+  pool->refcount = 1;
+  return pool;
+}
+
+/* frees the idle buffers; the ones still out are freed when released */
+void
+gst_handdetect_buffer_pool_free (GstHanddetectBufferPool * pool)
+{
+  GstBuffer *buffer;
+  GQueue idle;
+
+  g_mutex_lock (pool->lock);
+  pool->active = FALSE;
+  idle = pool->idle;
+  g_queue_init (&pool->idle);
+  g_mutex_unlock (pool->lock);
+
+  while ((buffer = g_queue_pop_head (&idle)))
+    gst_buffer_unref (buffer);
+  gst_handdetect_buffer_pool_unref (pool);
+}
+
+/* a buffer with the data, timestamps, flags and caps of @parent and no
+ * detections, taking over the reference to @parent; it is only writable
+ * when nobody but the caller and the @shared references it knows of,
+ * which will not touch the data again, hold @parent */
+GstHanddetectBuffer *
+gst_handdetect_buffer_pool_wrap (GstHanddetectBufferPool * pool,
+    GstBuffer * parent, gint shared)
+{
+  GstHanddetectBuffer *buffer;
+
+  g_mutex_lock (pool->lock);
+  buffer = g_queue_pop_head (&pool->idle);
+  g_mutex_unlock (pool->lock);
+  if (!buffer) {
+    buffer = (GstHanddetectBuffer *)
+        gst_mini_object_new (GST_TYPE_HANDDETECT_BUFFER);
+    buffer->pool = pool;
+    g_atomic_int_inc (&pool->refcount);
+  }
+
+  GST_BUFFER_DATA (buffer) = GST_BUFFER_DATA (parent);
+  GST_BUFFER_SIZE (buffer) = GST_BUFFER_SIZE (parent);
+  gst_buffer_copy_metadata (GST_BUFFER_CAST (buffer), parent,
+      GST_BUFFER_COPY_ALL);
+  if (GST_MINI_OBJECT_REFCOUNT_VALUE (parent) > 1 + shared ||
+      GST_MINI_OBJECT_FLAG_IS_SET (parent, GST_MINI_OBJECT_FLAG_READONLY))
+    GST_MINI_OBJECT_FLAG_SET (buffer, GST_MINI_OBJECT_FLAG_READONLY);
+  buffer->parent = parent;
+  buffer->detect_timestamp = GST_CLOCK_TIME_NONE;
+  buffer->n_detections = 0;
+  return buffer;
+}
@@ -0,0 +1,97 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthanddetectbuffer.h: buffers carrying the hands detected on them
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HANDDETECT_BUFFER_H__
+#define __GST_HANDDETECT_BUFFER_H__
+
+#include <gst/gst.h>
+#include <cv.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_HANDDETECT_BUFFER (gst_handdetect_buffer_get_type ())
+#define GST_IS_HANDDETECT_BUFFER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_HANDDETECT_BUFFER))
+#define GST_HANDDETECT_BUFFER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_HANDDETECT_BUFFER, \
+      GstHanddetectBuffer))
+
+/* detections a buffer has room for */
+#define GST_HANDDETECT_MAX_DETECTIONS 16
+
+typedef struct _GstHanddetectBuffer GstHanddetectBuffer;
+typedef struct _GstHanddetectBufferPool GstHanddetectBufferPool;
+typedef struct _GstHanddetectDetection GstHanddetectDetection;
+
+typedef enum
+{
+  GST_HANDDETECT_GESTURE_FIST,
+  GST_HANDDETECT_GESTURE_PALM
+} GstHanddetectGesture;
+
+/* a hand found on the frame, in frame coordinates; score is the number of
+ * detection windows merged into it and track_id 0 for untracked hands */
+struct _GstHanddetectDetection
+{
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+  GstHanddetectGesture gesture;
+  gfloat score;
+  guint track_id;
+};
+
+/* A buffer sharing the data of the one it wraps, with the hands found on
+ * it attached. The detections can be older than the frame when detection
+ * runs behind the stream, detect_timestamp is the timestamp of the frame
+ * they were found on.
+ */
+struct _GstHanddetectBuffer
+{
+  GstBuffer buffer;
+
+  GstClockTime detect_timestamp;
+  guint n_detections;
+  GstHanddetectDetection detections[GST_HANDDETECT_MAX_DETECTIONS];
+
+  /* private */
+  GstBuffer *parent;
+  GstHanddetectBufferPool *pool;
+};
+
+GType gst_handdetect_buffer_get_type (void);
+
+const GstHanddetectDetection *gst_handdetect_buffer_get_detections (GstBuffer *
+    buffer, guint * n_detections, GstClockTime * detect_timestamp);
+void gst_handdetect_buffer_add (GstHanddetectBuffer * buffer,
+    GstHanddetectGesture gesture, const CvRect * r, gfloat score,
+    guint track_id);
+
+/* Wrapper buffers are recycled once downstream releases them, so a
+ * stream allocates nothing per frame once it runs. */
+GstHanddetectBufferPool *gst_handdetect_buffer_pool_new (void);
+void gst_handdetect_buffer_pool_free (GstHanddetectBufferPool * pool);
+GstHanddetectBuffer *gst_handdetect_buffer_pool_wrap (GstHanddetectBufferPool *
+    pool, GstBuffer * parent, gint shared);
+
+G_END_DECLS
+#endif /* __GST_HANDDETECT_BUFFER_H__ */
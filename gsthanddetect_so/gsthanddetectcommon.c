@@ -0,0 +1,54 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthanddetectcommon.c: what handdetect and handdetectmux share
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "gsthanddetectcommon.h"
+#include "gsthaarresample.h"
+
+/* the smallest integer factor that fits a @width x @height frame into
+ * @detect_width x @detect_height (0 for no limit) */
+gint
+gst_handdetect_downscale_factor (gint width, gint height,
+    guint detect_width, guint detect_height)
+{
+  gint f = 1;
+
+  if (detect_width > 0)
+    f = MAX (f, (width + detect_width - 1) / detect_width);
+  if (detect_height > 0)
+    f = MAX (f, (height + detect_height - 1) / detect_height);
+  return MIN (f, GST_HAAR_MAX_DOWNSCALE);
+}
+
+/* whether the hands of the frame at @timestamp are posted: at most one
+ * frame's worth per @interval ms of stream time (0 for every frame);
+ * *@last_post is updated when they are */
+gboolean
+gst_handdetect_message_due (GstClockTime * last_post, GstClockTime timestamp,
+    guint interval)
+{
+  if (interval != 0 && GST_CLOCK_TIME_IS_VALID (timestamp)
+      && GST_CLOCK_TIME_IS_VALID (*last_post) && timestamp >= *last_post
+      && timestamp - *last_post < interval * GST_MSECOND)
+    return FALSE;
+
+  *last_post = timestamp;
+  return TRUE;
+}
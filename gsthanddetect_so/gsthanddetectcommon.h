@@ -0,0 +1,49 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthanddetectcommon.h: what handdetect and handdetectmux share
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HANDDETECT_COMMON_H__
+#define __GST_HANDDETECT_COMMON_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* default profiles */
+#define HAAR_FILE "/usr/local/share/opencv/haarcascades/fist.xml"
+#define HAAR_FILE_PALM "/usr/local/share/opencv/haarcascades/palm.xml"
+
+/* detection parameters of every engine */
+#define HAAR_SCALE_FACTOR 1.1
+#define HAAR_MIN_NEIGHBORS 2
+#define HAAR_MIN_SIZE 24
+
+#define GST_HANDDETECT_DETECT_WIDTH_BLURB \
+  "Detect on frames area downscaled by an integer factor to at most this width (0 = no limit), takes effect on caps negotiation"
+#define GST_HANDDETECT_DETECT_HEIGHT_BLURB \
+  "Detect on frames area downscaled by an integer factor to at most this height (0 = no limit), takes effect on caps negotiation"
+
+gint gst_handdetect_downscale_factor (gint width, gint height,
+    guint detect_width, guint detect_height);
+gboolean gst_handdetect_message_due (GstClockTime * last_post,
+    GstClockTime timestamp, guint interval);
+
+G_END_DECLS
+#endif /* __GST_HANDDETECT_COMMON_H__ */
@@ -0,0 +1,830 @@
+/*
+ * GStreamer hand gesture detection plugins
+ * Copyright (C) 2012 andol li <<andol@andol.info>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+/**
+ * SECTION:element-handdetectmux
+ *
+ * Detects hand gestures on any number of video streams with one shared
+ * pool of detection threads. Every sink_%d pad has a src_%d pad the
+ * buffers are passed on to right away; the newest frame of each stream
+ * waits for a thread, the streams are served round robin and a frame that
+ * waits longer than the deadline is skipped. The hands last found on a
+ * stream are attached to its outgoing buffers (see gsthanddetectbuffer.h)
+ * and posted as detected_hand_info element messages with the stream-id
+ * of the pad.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch handdetectmux name=m n-threads=4 \
+ *   v4l2src device=/dev/video0 ! ffmpegcolorspace ! m.sink_0  m.src_0 ! fakesink \
+ *   v4l2src device=/dev/video1 ! ffmpegcolorspace ! m.sink_1  m.src_1 ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include "gsthanddetectmux.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_handdetect_mux_debug);
+#define GST_CAT_DEFAULT gst_handdetect_mux_debug
+
+#define DEFAULT_N_THREADS 2
+#define MAX_N_THREADS 64
+#define DEFAULT_DETECT_WIDTH 320
+#define DEFAULT_DETECT_HEIGHT 240
+#define DEFAULT_DEADLINE 100
+#define DEFAULT_POST_MESSAGES TRUE
+#define DEFAULT_MESSAGE_INTERVAL 0
+
+enum
+{
+  PROP_0,
+  PROP_PROFILE,
+  PROP_PROFILE_PALM,
+  PROP_N_THREADS,
+  PROP_DETECT_WIDTH,
+  PROP_DETECT_HEIGHT,
+  PROP_DEADLINE,
+  PROP_POST_MESSAGES,
+  PROP_MESSAGE_INTERVAL
+};
+
+#define HANDDETECT_MUX_CAPS \
+    GST_VIDEO_CAPS_RGB "; " \
+    GST_VIDEO_CAPS_YUV ("{ I420, NV12, YUY2 }") "; " \
+    GST_VIDEO_CAPS_GRAY8
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink_%d",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (HANDDETECT_MUX_CAPS)
+    );
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src_%d",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS (HANDDETECT_MUX_CAPS)
+    );
+
+static void gst_handdetect_mux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_handdetect_mux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static GstPad *gst_handdetect_mux_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name);
+static void gst_handdetect_mux_release_pad (GstElement * element,
+    GstPad * pad);
+static GstStateChangeReturn gst_handdetect_mux_change_state (GstElement *
+    element, GstStateChange transition);
+
+static gboolean gst_handdetect_mux_sink_setcaps (GstPad * pad,
+    GstCaps * caps);
+static GstFlowReturn gst_handdetect_mux_chain (GstPad * pad,
+    GstBuffer * buffer);
+static GstIterator *gst_handdetect_mux_iterate_internal_links (GstPad * pad);
+static void gst_handdetect_mux_stream_free (GstHanddetectMuxStream * stream);
+
+GST_BOILERPLATE (GstHanddetectMux, gst_handdetect_mux, GstElement,
+    GST_TYPE_ELEMENT);
+
+static void
+gst_handdetect_mux_finalize (GObject * obj)
+{
+  GstHanddetectMux *mux = GST_HANDDETECT_MUX (obj);
+
+  /* dispose removed the pads still requested, not the streams behind them */
+  g_list_foreach (mux->streams, (GFunc) gst_handdetect_mux_stream_free, NULL);
+  g_list_free (mux->streams);
+  g_mutex_free (mux->lock);
+  g_cond_free (mux->cond);
+  gst_handdetect_buffer_pool_free (mux->buffer_pool);
+  g_free (mux->profile);
+  g_free (mux->profile_palm);
+
+  G_OBJECT_CLASS (parent_class)->finalize (obj);
+}
+
+static void
+gst_handdetect_mux_base_init (gpointer gclass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (gclass);
+
+  gst_element_class_set_details_simple (element_class,
+      "hand detect mux",
+      "Filter/Effect/Video",
+      "Performs hand gesture detection on several video streams with a shared pool of threads, providing detected hand positions via bus message",
+      "Andol Li <<andol@andol.info>>");
+
+  gst_element_class_add_static_pad_template (element_class, &src_factory);
+  gst_element_class_add_static_pad_template (element_class, &sink_factory);
+}
+
+static void
+gst_handdetect_mux_class_init (GstHanddetectMuxClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_handdetect_mux_finalize);
+  gobject_class->set_property = gst_handdetect_mux_set_property;
+  gobject_class->get_property = gst_handdetect_mux_get_property;
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_handdetect_mux_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_handdetect_mux_release_pad);
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_handdetect_mux_change_state);
+
+  g_object_class_install_property (gobject_class,
+      PROP_PROFILE,
+      g_param_spec_string ("profile",
+          "Profile",
+          "Location of HAAR cascade file (fist gesture)",
+          HAAR_FILE, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_PROFILE_PALM,
+      g_param_spec_string ("profile_palm",
+          "Profile_palm",
+          "Location of HAAR cascade file (palm gesture)",
+          HAAR_FILE_PALM, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_N_THREADS,
+      g_param_spec_uint ("n-threads",
+          "Number of threads",
+          "Detection threads shared by all streams, applied when going to PAUSED",
+          1, MAX_N_THREADS, DEFAULT_N_THREADS, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_DETECT_WIDTH,
+      g_param_spec_uint ("detect-width",
+          "Detect width",
+          GST_HANDDETECT_DETECT_WIDTH_BLURB,
+          0, G_MAXUINT, DEFAULT_DETECT_WIDTH, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_DETECT_HEIGHT,
+      g_param_spec_uint ("detect-height",
+          "Detect height",
+          GST_HANDDETECT_DETECT_HEIGHT_BLURB,
+          0, G_MAXUINT, DEFAULT_DETECT_HEIGHT, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_DEADLINE,
+      g_param_spec_uint ("deadline",
+          "Deadline",
+          "Skip the frame of a stream when no thread started on it within this many milliseconds of its arrival (0 = never)",
+          0, G_MAXUINT, DEFAULT_DEADLINE, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_POST_MESSAGES,
+      g_param_spec_boolean ("post-messages",
+          "Post messages",
+          "Post detected_hand_info messages on the bus; the hands are attached to the outgoing buffers either way",
+          DEFAULT_POST_MESSAGES, G_PARAM_READWRITE)
+      );
+  g_object_class_install_property (gobject_class,
+      PROP_MESSAGE_INTERVAL,
+      g_param_spec_uint ("message-interval",
+          "Message interval",
+          "Post the hands of at most one frame of a stream every this many milliseconds of stream time (0 = every frame)",
+          0, G_MAXUINT, DEFAULT_MESSAGE_INTERVAL, G_PARAM_READWRITE)
+      );
+}
+
+static void
+gst_handdetect_mux_init (GstHanddetectMux * mux,
+    GstHanddetectMuxClass * gclass)
+{
+  mux->profile = g_strdup (HAAR_FILE);
+  mux->profile_palm = g_strdup (HAAR_FILE_PALM);
+  mux->n_threads = DEFAULT_N_THREADS;
+  mux->detect_width = DEFAULT_DETECT_WIDTH;
+  mux->detect_height = DEFAULT_DETECT_HEIGHT;
+  mux->deadline = DEFAULT_DEADLINE;
+  mux->post_messages = DEFAULT_POST_MESSAGES;
+  mux->message_interval = DEFAULT_MESSAGE_INTERVAL;
+  mux->buffer_pool = gst_handdetect_buffer_pool_new ();
+  mux->haarLabel = -1;
+  mux->haarLabel_palm = -1;
+  mux->lock = g_mutex_new ();
+  mux->cond = g_cond_new ();
+}
+
+static void
+gst_handdetect_mux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstHanddetectMux *mux = GST_HANDDETECT_MUX (object);
+
+  switch (prop_id) {
+    case PROP_PROFILE:
+      g_free (mux->profile);
+      mux->profile = g_value_dup_string (value);
+      break;
+    case PROP_PROFILE_PALM:
+      g_free (mux->profile_palm);
+      mux->profile_palm = g_value_dup_string (value);
+      break;
+    case PROP_N_THREADS:
+      mux->n_threads = g_value_get_uint (value);
+      break;
+    case PROP_DETECT_WIDTH:
+      mux->detect_width = g_value_get_uint (value);
+      break;
+    case PROP_DETECT_HEIGHT:
+      mux->detect_height = g_value_get_uint (value);
+      break;
+    case PROP_DEADLINE:
+      mux->deadline = g_value_get_uint (value);
+      break;
+    case PROP_POST_MESSAGES:
+      mux->post_messages = g_value_get_boolean (value);
+      break;
+    case PROP_MESSAGE_INTERVAL:
+      mux->message_interval = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_handdetect_mux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstHanddetectMux *mux = GST_HANDDETECT_MUX (object);
+
+  switch (prop_id) {
+    case PROP_PROFILE:
+      g_value_set_string (value, mux->profile);
+      break;
+    case PROP_PROFILE_PALM:
+      g_value_set_string (value, mux->profile_palm);
+      break;
+    case PROP_N_THREADS:
+      g_value_set_uint (value, mux->n_threads);
+      break;
+    case PROP_DETECT_WIDTH:
+      g_value_set_uint (value, mux->detect_width);
+      break;
+    case PROP_DETECT_HEIGHT:
+      g_value_set_uint (value, mux->detect_height);
+      break;
+    case PROP_DEADLINE:
+      g_value_set_uint (value, mux->deadline);
+      break;
+    case PROP_POST_MESSAGES:
+      g_value_set_boolean (value, mux->post_messages);
+      break;
+    case PROP_MESSAGE_INTERVAL:
+      g_value_set_uint (value, mux->message_interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* pads */
+static GstPad *
+gst_handdetect_mux_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name)
+{
+  GstHanddetectMux *mux = GST_HANDDETECT_MUX (element);
+  GstHanddetectMuxStream *stream;
+  gchar *pad_name;
+  guint id;
+
+  if (templ->direction != GST_PAD_SINK)
+    return NULL;
+
+  GST_OBJECT_LOCK (mux);
+  if (name == NULL || sscanf (name, "sink_%u", &id) != 1)
+    id = mux->next_id;
+  mux->next_id = MAX (mux->next_id, id + 1);
+  GST_OBJECT_UNLOCK (mux);
+
+  stream = g_new0 (GstHanddetectMuxStream, 1);
+  stream->mux = mux;
+  stream->id = id;
+  stream->resampler = gst_haar_resampler_new ();
+  stream->tracks = gst_hand_tracks_new ();
+  stream->last_post = GST_CLOCK_TIME_NONE;
+  stream->result_timestamp = GST_CLOCK_TIME_NONE;
+
+  pad_name = g_strdup_printf ("sink_%u", id);
+  stream->sinkpad = gst_pad_new_from_static_template (&sink_factory, pad_name);
+  g_free (pad_name);
+  pad_name = g_strdup_printf ("src_%u", id);
+  stream->srcpad = gst_pad_new_from_static_template (&src_factory, pad_name);
+  g_free (pad_name);
+
+  gst_pad_set_element_private (stream->sinkpad, stream);
+  gst_pad_set_element_private (stream->srcpad, stream);
+  gst_pad_set_chain_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_handdetect_mux_chain));
+  gst_pad_set_setcaps_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_handdetect_mux_sink_setcaps));
+  /* caps, events and queries go straight through to the other pad */
+  gst_pad_set_getcaps_function (stream->sinkpad, gst_pad_proxy_getcaps);
+  gst_pad_set_getcaps_function (stream->srcpad, gst_pad_proxy_getcaps);
+  gst_pad_set_iterate_internal_links_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_handdetect_mux_iterate_internal_links));
+  gst_pad_set_iterate_internal_links_function (stream->srcpad,
+      GST_DEBUG_FUNCPTR (gst_handdetect_mux_iterate_internal_links));
+
+  g_mutex_lock (mux->lock);
+  mux->streams = g_list_append (mux->streams, stream);
+  g_mutex_unlock (mux->lock);
+
+  if (GST_STATE (mux) > GST_STATE_READY) {
+    gst_pad_set_active (stream->srcpad, TRUE);
+    gst_pad_set_active (stream->sinkpad, TRUE);
+  }
+  if (!gst_element_add_pad (element, stream->srcpad)
+      || !gst_element_add_pad (element, stream->sinkpad)) {
+    GST_WARNING_OBJECT (mux, "Could not add the pads of stream %u", id);
+    gst_handdetect_mux_release_pad (element, stream->sinkpad);
+    return NULL;
+  }
+  return stream->sinkpad;
+}
+
+static void
+gst_handdetect_mux_release_pad (GstElement * element, GstPad * pad)
+{
+  GstHanddetectMux *mux = GST_HANDDETECT_MUX (element);
+  GstHanddetectMuxStream *stream = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (mux->lock);
+  while (stream->busy)
+    g_cond_wait (mux->cond, mux->lock);
+  mux->streams = g_list_remove (mux->streams, stream);
+  g_mutex_unlock (mux->lock);
+
+  gst_pad_set_active (stream->srcpad, FALSE);
+  gst_pad_set_active (stream->sinkpad, FALSE);
+  if (GST_OBJECT_PARENT (stream->srcpad) == GST_OBJECT_CAST (mux))
+    gst_element_remove_pad (element, stream->srcpad);
+  else
+    gst_object_unref (gst_object_ref_sink (stream->srcpad));
+  if (GST_OBJECT_PARENT (stream->sinkpad) == GST_OBJECT_CAST (mux))
+    gst_element_remove_pad (element, stream->sinkpad);
+  else
+    gst_object_unref (gst_object_ref_sink (stream->sinkpad));
+
+  gst_handdetect_mux_stream_free (stream);
+}
+
+static void
+gst_handdetect_mux_stream_free (GstHanddetectMuxStream * stream)
+{
+  gst_haar_resampler_free (stream->resampler);
+  gst_hand_tracks_free (stream->tracks);
+  g_free (stream->scratch);
+  g_free (stream->pending);
+  g_free (stream->work);
+  g_free (stream);
+}
+
+static GstIterator *
+gst_handdetect_mux_iterate_internal_links (GstPad * pad)
+{
+  GstHanddetectMuxStream *stream = gst_pad_get_element_private (pad);
+  GstPad *other = pad == stream->sinkpad ? stream->srcpad : stream->sinkpad;
+
+  return gst_iterator_new_single (GST_TYPE_PAD, other,
+      (GstCopyFunction) gst_object_ref, (GFreeFunc) gst_object_unref);
+}
+
+static gboolean
+gst_handdetect_mux_sink_setcaps (GstPad * pad, GstCaps * caps)
+{
+  GstHanddetectMuxStream *stream = gst_pad_get_element_private (pad);
+  GstHanddetectMux *mux = stream->mux;
+  GstVideoFormat format;
+  gint width, height, f;
+  gsize size;
+
+  if (!gst_video_format_parse_caps (caps, &format, &width, &height)
+      || !gst_pad_set_caps (stream->srcpad, caps))
+    return FALSE;
+
+  f = gst_handdetect_downscale_factor (width, height, mux->detect_width,
+      mux->detect_height);
+
+  g_mutex_lock (mux->lock);
+  while (stream->busy)
+    g_cond_wait (mux->cond, mux->lock);
+
+  switch (format) {
+    case GST_VIDEO_FORMAT_RGB:
+      stream->pixel = GST_HAAR_PIXEL_RGB;
+      break;
+    case GST_VIDEO_FORMAT_YUY2:
+      stream->pixel = GST_HAAR_PIXEL_YUY2;
+      break;
+    default:
+      stream->pixel = GST_HAAR_PIXEL_GRAY;
+      break;
+  }
+  stream->width = width;
+  stream->height = height;
+  stream->offset =
+      gst_video_format_get_component_offset (format, 0, width, height);
+  stream->stride = gst_video_format_get_row_stride (format, 0, width);
+  stream->size = gst_video_format_get_size (format, width, height);
+  stream->downscale = f;
+  stream->gray_width = width / f;
+  stream->gray_height = height / f;
+
+  size = (gsize) stream->gray_width * stream->gray_height;
+  g_free (stream->scratch);
+  g_free (stream->pending);
+  g_free (stream->work);
+  stream->scratch = g_malloc (size);
+  stream->pending = g_malloc (size);
+  stream->work = g_malloc (size);
+  stream->has_pending = FALSE;
+  g_mutex_unlock (mux->lock);
+
+  GST_INFO_OBJECT (mux, "stream %u: detecting on %dx%d", stream->id,
+      stream->gray_width, stream->gray_height);
+  return TRUE;
+}
+
+/* converts the frame to gray for the workers, replacing a frame that is
+ * still waiting, and passes the buffer on with the hands last found
+ * attached */
+static GstFlowReturn
+gst_handdetect_mux_chain (GstPad * pad, GstBuffer * buffer)
+{
+  GstHanddetectMuxStream *stream = gst_pad_get_element_private (pad);
+  GstHanddetectMux *mux = stream->mux;
+  GstHanddetectBuffer *out;
+  guint8 *gray;
+
+  if (stream->scratch && GST_BUFFER_SIZE (buffer) < stream->size) {
+    GST_ELEMENT_ERROR (mux, STREAM, FORMAT, (NULL),
+        ("stream %u: buffer of %u bytes, a %dx%d frame takes %u", stream->id,
+            GST_BUFFER_SIZE (buffer), stream->width, stream->height,
+            stream->size));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+
+  out = gst_handdetect_buffer_pool_wrap (mux->buffer_pool, buffer, 0);
+
+  if (stream->scratch && mux->workers)
+    gst_haar_resampler_process (stream->resampler,
+        GST_BUFFER_DATA (out) + stream->offset, stream->width,
+        stream->height, stream->stride, stream->pixel, stream->downscale,
+        stream->scratch, stream->gray_width);
+
+  g_mutex_lock (mux->lock);
+  out->detect_timestamp = stream->result_timestamp;
+  out->n_detections = stream->n_result;
+  memcpy (out->detections, stream->result,
+      stream->n_result * sizeof (GstHanddetectDetection));
+
+  if (stream->scratch && mux->workers) {
+    gray = stream->pending;
+    stream->pending = stream->scratch;
+    stream->scratch = gray;
+    if (stream->has_pending)
+      stream->dropped++;
+    stream->has_pending = TRUE;
+    stream->timestamp = GST_BUFFER_TIMESTAMP (out);
+    stream->deadline = mux->deadline ?
+        gst_util_get_timestamp () + mux->deadline * GST_MSECOND :
+        GST_CLOCK_TIME_NONE;
+    g_cond_signal (mux->cond);
+  }
+  g_mutex_unlock (mux->lock);
+
+  return gst_pad_push (stream->srcpad, GST_BUFFER_CAST (out));
+}
+
+/* detection */
+static void
+gst_handdetect_mux_post_hand (GstHanddetectMux * mux,
+    GstHanddetectMuxStream * stream, const gchar * gesture, const CvRect * r,
+    guint track_id, GstClockTime timestamp)
+{
+  GstStructure *s;
+
+  s = gst_structure_new ("detected_hand_info",
+      "stream-id", G_TYPE_UINT, stream->id,
+      "gesture", G_TYPE_STRING, gesture,
+      "x", G_TYPE_UINT, (uint) (r->x + r->width * 0.5),
+      "y", G_TYPE_UINT, (uint) (r->y + r->height * 0.5),
+      "width", G_TYPE_UINT, (uint) r->width,
+      "height", G_TYPE_UINT, (uint) r->height,
+      "track-id", G_TYPE_UINT, track_id,
+      "timestamp", G_TYPE_UINT64, timestamp, NULL);
+  gst_element_post_message (GST_ELEMENT (mux),
+      gst_message_new_element (GST_OBJECT (mux), s));
+}
+
+/* detects on the work frame of @stream, tracks the hands found and posts
+ * the ones detected, as handdetect does */
+static void
+gst_handdetect_mux_detect (GstHanddetectMuxWorker * worker,
+    GstHanddetectMuxStream * stream, GstClockTime timestamp)
+{
+  GstHanddetectMux *mux = worker->mux;
+  GstHandTracks *tracks = stream->tracks;
+  gint f = stream->downscale;
+  guint i, n = 0;
+
+  if (!worker->detector)
+    return;
+
+  gst_haar_detector_detect (worker->detector, stream->work,
+      stream->gray_width, stream->gray_height, stream->gray_width,
+      worker->objects);
+
+  /* tracks are labelled with the gesture */
+  for (i = 0; i < worker->objects->len; i++) {
+    GstHaarObject *o = &g_array_index (worker->objects, GstHaarObject, i);
+    CvRect *r = &o->rect;
+
+    r->x *= f;
+    r->y *= f;
+    r->width *= f;
+    r->height *= f;
+    o->label = o->label == mux->haarLabel_palm ?
+        GST_HANDDETECT_GESTURE_PALM : GST_HANDDETECT_GESTURE_FIST;
+  }
+
+  gst_hand_tracks_update (tracks, (GstHaarObject *) worker->objects->data,
+      worker->objects->len);
+
+  g_mutex_lock (mux->lock);
+  stream->result_timestamp = timestamp;
+  for (i = 0; i < tracks->tracks->len; i++) {
+    GstHandTracker *t = &g_array_index (tracks->tracks, GstHandTracker, i);
+    GstHanddetectDetection *d = &stream->result[n];
+
+    if (!gst_hand_tracks_reported (tracks, t)
+        || n == GST_HANDDETECT_MAX_DETECTIONS)
+      continue;
+
+    d->x = t->rect.x;
+    d->y = t->rect.y;
+    d->width = t->rect.width;
+    d->height = t->rect.height;
+    d->gesture = t->label;
+    d->score = t->neighbors;
+    d->track_id = t->id;
+    n++;
+  }
+  stream->n_result = n;
+  g_mutex_unlock (mux->lock);
+
+  /* at most one frame's worth per message-interval of stream time; the
+   * results are only written by this worker */
+  if (n > 0 && mux->post_messages
+      && gst_handdetect_message_due (&stream->last_post, timestamp,
+          mux->message_interval)) {
+    for (i = 0; i < n; i++) {
+      GstHanddetectDetection *d = &stream->result[i];
+      CvRect r = cvRect (d->x, d->y, d->width, d->height);
+
+      gst_handdetect_mux_post_hand (mux, stream,
+          d->gesture == GST_HANDDETECT_GESTURE_FIST ? "fist" : "palm", &r,
+          d->track_id, timestamp);
+    }
+  }
+}
+
+/* the next stream with a frame waiting, round robin over the streams so
+ * none of them starves; frames past their deadline are skipped */
+static GstHanddetectMuxStream *
+gst_handdetect_mux_next_stream (GstHanddetectMux * mux)
+{
+  guint n = g_list_length (mux->streams);
+  GstClockTime now = gst_util_get_timestamp ();
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    guint k = (mux->next_stream + i) % n;
+    GstHanddetectMuxStream *stream = g_list_nth_data (mux->streams, k);
+
+    if (!stream->has_pending || stream->busy)
+      continue;
+    if (now > stream->deadline) {
+      stream->has_pending = FALSE;
+      stream->dropped++;
+      GST_LOG_OBJECT (mux, "stream %u: frame skipped, past its deadline",
+          stream->id);
+      continue;
+    }
+    mux->next_stream = k + 1;
+    return stream;
+  }
+  return NULL;
+}
+
+static gpointer
+gst_handdetect_mux_worker (gpointer data)
+{
+  GstHanddetectMuxWorker *worker = data;
+  GstHanddetectMux *mux = worker->mux;
+
+  g_mutex_lock (mux->lock);
+  while (!mux->stop) {
+    GstHanddetectMuxStream *stream = gst_handdetect_mux_next_stream (mux);
+    GstClockTime timestamp;
+    guint8 *gray;
+
+    if (!stream) {
+      g_cond_wait (mux->cond, mux->lock);
+      continue;
+    }
+
+    gray = stream->work;
+    stream->work = stream->pending;
+    stream->pending = gray;
+    stream->has_pending = FALSE;
+    stream->busy = TRUE;
+    timestamp = stream->timestamp;
+    g_mutex_unlock (mux->lock);
+
+    gst_handdetect_mux_detect (worker, stream, timestamp);
+
+    g_mutex_lock (mux->lock);
+    stream->busy = FALSE;
+    g_cond_broadcast (mux->cond);
+  }
+  g_mutex_unlock (mux->lock);
+  return NULL;
+}
+
+static GstHaarCascade *
+gst_handdetect_mux_load_cascade (GstHanddetectMux * mux, const gchar * profile)
+{
+  GstHaarCascade *cascade;
+  GError *err = NULL;
+
+  if (!profile)
+    return NULL;
+  cascade = gst_haar_cascade_open (profile, &err);
+  if (!cascade) {
+    GST_WARNING_OBJECT (mux, "Could not load profile %s: %s", profile,
+        err ? err->message : "unknown error");
+    g_clear_error (&err);
+  }
+  return cascade;
+}
+
+static void
+gst_handdetect_mux_stop (GstHanddetectMux * mux)
+{
+  GList *l;
+  guint i;
+
+  g_mutex_lock (mux->lock);
+  mux->stop = TRUE;
+  g_cond_broadcast (mux->cond);
+  g_mutex_unlock (mux->lock);
+
+  for (i = 0; i < mux->n_workers; i++) {
+    GstHanddetectMuxWorker *worker = &mux->workers[i];
+
+    if (worker->thread)
+      g_thread_join (worker->thread);
+    gst_haar_detector_free (worker->detector);
+    g_array_free (worker->objects, TRUE);
+  }
+  g_free (mux->workers);
+  mux->workers = NULL;
+  mux->n_workers = 0;
+
+  for (l = mux->streams; l; l = l->next) {
+    GstHanddetectMuxStream *stream = l->data;
+
+    if (stream->dropped)
+      GST_INFO_OBJECT (mux, "stream %u: %" G_GUINT64_FORMAT
+          " frames not detected on", stream->id, stream->dropped);
+    stream->has_pending = FALSE;
+    stream->dropped = 0;
+    gst_hand_tracks_reset (stream->tracks);
+    stream->n_result = 0;
+    stream->last_post = GST_CLOCK_TIME_NONE;
+  }
+
+  gst_haar_cascade_unref (mux->haarCascade);
+  gst_haar_cascade_unref (mux->haarCascade_palm);
+  mux->haarCascade = NULL;
+  mux->haarCascade_palm = NULL;
+}
+
+/* loads the cascades and starts the workers, each with a detector
+ * scanning both cascades in one pass */
+static gboolean
+gst_handdetect_mux_start (GstHanddetectMux * mux)
+{
+  GstHanddetectMuxWorker *workers;
+  guint i;
+
+  mux->haarCascade = gst_handdetect_mux_load_cascade (mux, mux->profile);
+  mux->haarCascade_palm =
+      gst_handdetect_mux_load_cascade (mux, mux->profile_palm);
+  mux->haarLabel = mux->haarCascade ? 0 : -1;
+  mux->haarLabel_palm =
+      mux->haarCascade_palm ? (mux->haarCascade ? 1 : 0) : -1;
+
+  workers = g_new0 (GstHanddetectMuxWorker, mux->n_threads);
+  for (i = 0; i < mux->n_threads; i++) {
+    GstHanddetectMuxWorker *worker = &workers[i];
+
+    worker->mux = mux;
+    worker->objects = g_array_new (FALSE, FALSE, sizeof (GstHaarObject));
+    if (mux->haarCascade) {
+      worker->detector = gst_haar_detector_new (mux->haarCascade,
+          HAAR_SCALE_FACTOR, HAAR_MIN_NEIGHBORS, HAAR_MIN_SIZE,
+          HAAR_MIN_SIZE);
+      if (mux->haarCascade_palm)
+        gst_haar_detector_add_cascade (worker->detector,
+            mux->haarCascade_palm);
+    } else if (mux->haarCascade_palm) {
+      worker->detector = gst_haar_detector_new (mux->haarCascade_palm,
+          HAAR_SCALE_FACTOR, HAAR_MIN_NEIGHBORS, HAAR_MIN_SIZE,
+          HAAR_MIN_SIZE);
+    }
+  }
+
+  g_mutex_lock (mux->lock);
+  mux->stop = FALSE;
+  mux->workers = workers;
+  mux->n_workers = mux->n_threads;
+  g_mutex_unlock (mux->lock);
+
+  for (i = 0; i < mux->n_workers; i++) {
+    GError *err = NULL;
+
+    workers[i].thread =
+        g_thread_create (gst_handdetect_mux_worker, &workers[i], TRUE, &err);
+    if (!workers[i].thread) {
+      GST_ELEMENT_ERROR (mux, RESOURCE, FAILED, (NULL),
+          ("Could not start the detection threads: %s", err->message));
+      g_error_free (err);
+      gst_handdetect_mux_stop (mux);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static GstStateChangeReturn
+gst_handdetect_mux_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstHanddetectMux *mux = GST_HANDDETECT_MUX (element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED
+      && !gst_handdetect_mux_start (mux))
+    return GST_STATE_CHANGE_FAILURE;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+    gst_handdetect_mux_stop (mux);
+  return ret;
+}
+
+gboolean
+gst_handdetect_mux_plugin_init (GstPlugin * plugin)
+{
+  GST_DEBUG_CATEGORY_INIT (gst_handdetect_mux_debug, "handdetectmux", 0,
+      "Performs hand gesture detection on several streams with a shared thread pool");
+  return gst_element_register (plugin, "handdetectmux", GST_RANK_NONE,
+      GST_TYPE_HANDDETECT_MUX);
+}
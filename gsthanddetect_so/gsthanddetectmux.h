@@ -0,0 +1,146 @@
+/*
+ * GStreamer hand gesture detection plugins
+ * Copyright (C) 2012 andol li <<andol@andol.info>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HANDDETECT_MUX_H__
+#define __GST_HANDDETECT_MUX_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <opencv/cv.h>
+
+#include "gsthaarcascade.h"
+#include "gsthaardetector.h"
+#include "gsthaarresample.h"
+#include "gsthanddetectbuffer.h"
+#include "gsthanddetectcommon.h"
+#include "gsthandtracker.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_HANDDETECT_MUX \
+  (gst_handdetect_mux_get_type())
+#define GST_HANDDETECT_MUX(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_HANDDETECT_MUX,GstHanddetectMux))
+#define GST_HANDDETECT_MUX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_HANDDETECT_MUX,GstHanddetectMuxClass))
+#define GST_IS_HANDDETECT_MUX(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_HANDDETECT_MUX))
+#define GST_IS_HANDDETECT_MUX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_HANDDETECT_MUX))
+typedef struct _GstHanddetectMux GstHanddetectMux;
+typedef struct _GstHanddetectMuxClass GstHanddetectMuxClass;
+typedef struct _GstHanddetectMuxStream GstHanddetectMuxStream;
+typedef struct _GstHanddetectMuxWorker GstHanddetectMuxWorker;
+
+/* One input stream, a sink_%d / src_%d pad pair. Frames are converted to
+ * gray in scratch by the streaming thread of the stream and swapped with
+ * pending; a worker swaps pending with work and detects on it while the
+ * stream is busy, so a stream is detected on by one worker at a time.
+ */
+struct _GstHanddetectMuxStream
+{
+  GstHanddetectMux *mux;
+  guint id;
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* negotiated input and the detection size */
+  GstHaarPixel pixel;
+  gint width;
+  gint height;
+  gint offset;
+  gint stride;
+  guint size;                   /* of a frame */
+  gint downscale;
+  gint gray_width;
+  gint gray_height;
+  GstHaarResampler *resampler;
+
+  /* gray frames, under the mux lock except scratch and work */
+  guint8 *scratch;
+  guint8 *pending;
+  guint8 *work;
+  gboolean has_pending;
+  gboolean busy;
+  GstClockTime timestamp;       /* of the pending frame */
+  GstClockTime deadline;        /* to start detecting it */
+  guint64 dropped;
+
+  /* the hands tracked, owned by the worker detecting on the stream, as is
+   * last_post */
+  GstHandTracks *tracks;
+  GstClockTime last_post;
+
+  /* hands found on the last frame detected on, attached to the buffers
+   * going out; under the mux lock */
+  GstHanddetectDetection result[GST_HANDDETECT_MAX_DETECTIONS];
+  guint n_result;
+  GstClockTime result_timestamp;
+};
+
+/* a thread of the shared pool, with its own detector */
+struct _GstHanddetectMuxWorker
+{
+  GstHanddetectMux *mux;
+  GThread *thread;
+  GstHaarDetector *detector;
+  GArray *objects;              /* GstHaarObject */
+};
+
+struct _GstHanddetectMux
+{
+  GstElement element;
+
+  gchar *profile, *profile_palm;
+  guint n_threads;
+  guint detect_width;
+  guint detect_height;
+  guint deadline;               /* ms */
+  gboolean post_messages;
+  guint message_interval;       /* ms */
+
+  /* cascades shared by all workers, and the labels of the detections */
+  GstHaarCascade *haarCascade;
+  GstHaarCascade *haarCascade_palm;
+  gint haarLabel;
+  gint haarLabel_palm;
+
+  GMutex *lock;                 /* streams, workers and the fields below */
+  GCond *cond;
+  GList *streams;
+  guint next_id;
+  guint next_stream;            /* round robin position */
+  GstHanddetectMuxWorker *workers;
+  guint n_workers;
+  gboolean stop;
+
+  GstHanddetectBufferPool *buffer_pool;
+};
+
+struct _GstHanddetectMuxClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_handdetect_mux_get_type (void);
+
+gboolean gst_handdetect_mux_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* __GST_HANDDETECT_MUX_H__ */
@@ -0,0 +1,218 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthandgesture.c: recognition of hand gestures from tracked hands
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "gsthandgesture.h"
+
+/* distances are in hand widths, so gestures don't depend on how far the
+ * hand is from the camera */
+
+/* a swipe: the hand travels SWIPE_DISTANCE within SWIPE_WINDOW, mostly
+ * along one axis, and the next one needs it to slow down to less than
+ * SWIPE_REARM over the window first */
+#define SWIPE_WINDOW (400 * GST_MSECOND)
+#define SWIPE_DISTANCE 1.5
+#define SWIPE_REARM 0.3
+#define SWIPE_AXIS_RATIO 2.0
+/* a hold: the hand rests within HOLD_RADIUS for HOLD_TIME, and the next
+ * one needs it to move HOLD_REARM away first */
+#define HOLD_TIME (1000 * GST_MSECOND)
+#define HOLD_RADIUS 0.25
+#define HOLD_REARM 0.75
+/* frames a new hand shape has to last */
+#define SHAPE_FRAMES 3
+
+/* stands for the frame duration when the stream has no timestamps */
+#define DEFAULT_FRAME_DURATION (GST_SECOND / 30)
+
+void
+gst_hand_gesture_init (GstHandGesture * gesture, guint track_id)
+{
+  memset (gesture, 0, sizeof (GstHandGesture));
+  gesture->track_id = track_id;
+  gesture->swipe_armed = TRUE;
+  gesture->hold_armed = TRUE;
+  gesture->still_since = GST_CLOCK_TIME_NONE;
+}
+
+/* the oldest sample at most @window older than the newest one */
+static const GstHandGestureSample *
+gst_hand_gesture_window_start (const GstHandGesture * gesture,
+    GstClockTime window)
+{
+  const GstHandGestureSample *newest = &gesture->history[gesture->head];
+  const GstHandGestureSample *start = newest;
+  guint i;
+
+  for (i = 1; i < gesture->n_samples; i++) {
+    const GstHandGestureSample *s = &gesture->history[(gesture->head +
+            GST_HAND_GESTURE_HISTORY - i) % GST_HAND_GESTURE_HISTORY];
+
+    if (newest->timestamp - s->timestamp > window)
+      break;
+    start = s;
+  }
+  return start;
+}
+
+static GstHandGestureEvent
+gst_hand_gesture_swipe (GstHandGesture * gesture)
+{
+  const GstHandGestureSample *newest = &gesture->history[gesture->head];
+  const GstHandGestureSample *start =
+      gst_hand_gesture_window_start (gesture, SWIPE_WINDOW);
+  gdouble dx = newest->x - start->x, dy = newest->y - start->y;
+  gdouble adx = fabs (dx), ady = fabs (dy);
+  gdouble distance = MAX (adx, ady);
+
+  if (!gesture->swipe_armed) {
+    if (distance < SWIPE_REARM * newest->size)
+      gesture->swipe_armed = TRUE;
+    return GST_HAND_GESTURE_NONE;
+  }
+
+  if (distance < SWIPE_DISTANCE * newest->size)
+    return GST_HAND_GESTURE_NONE;
+
+  if (adx >= SWIPE_AXIS_RATIO * ady) {
+    gesture->swipe_armed = FALSE;
+    return dx < 0 ? GST_HAND_GESTURE_SWIPE_LEFT : GST_HAND_GESTURE_SWIPE_RIGHT;
+  }
+  if (ady >= SWIPE_AXIS_RATIO * adx) {
+    gesture->swipe_armed = FALSE;
+    return dy < 0 ? GST_HAND_GESTURE_SWIPE_UP : GST_HAND_GESTURE_SWIPE_DOWN;
+  }
+  return GST_HAND_GESTURE_NONE;
+}
+
+static GstHandGestureEvent
+gst_hand_gesture_hold (GstHandGesture * gesture)
+{
+  const GstHandGestureSample *newest = &gesture->history[gesture->head];
+
+  if (!GST_CLOCK_TIME_IS_VALID (gesture->still_since)
+      || hypot (newest->x - gesture->still_x,
+          newest->y - gesture->still_y) > HOLD_RADIUS * newest->size) {
+    gesture->still_x = newest->x;
+    gesture->still_y = newest->y;
+    gesture->still_since = newest->timestamp;
+  }
+
+  if (!gesture->hold_armed) {
+    if (hypot (newest->x - gesture->hold_x,
+            newest->y - gesture->hold_y) > HOLD_REARM * newest->size)
+      gesture->hold_armed = TRUE;
+    return GST_HAND_GESTURE_NONE;
+  }
+
+  if (newest->timestamp - gesture->still_since < HOLD_TIME)
+    return GST_HAND_GESTURE_NONE;
+
+  gesture->hold_armed = FALSE;
+  gesture->hold_x = newest->x;
+  gesture->hold_y = newest->y;
+  return GST_HAND_GESTURE_HOLD;
+}
+
+static GstHandGestureEvent
+gst_hand_gesture_shape (GstHandGesture * gesture, GstHanddetectGesture shape)
+{
+  if (gesture->n_samples == 1) {
+    gesture->shape = shape;
+    return GST_HAND_GESTURE_NONE;
+  }
+
+  if (shape == gesture->shape) {
+    gesture->pending_frames = 0;
+    return GST_HAND_GESTURE_NONE;
+  }
+  if (gesture->pending_frames == 0 || shape != gesture->pending_shape) {
+    gesture->pending_shape = shape;
+    gesture->pending_frames = 0;
+  }
+  if (++gesture->pending_frames < SHAPE_FRAMES)
+    return GST_HAND_GESTURE_NONE;
+
+  gesture->shape = shape;
+  gesture->pending_frames = 0;
+  return shape == GST_HANDDETECT_GESTURE_PALM ?
+      GST_HAND_GESTURE_PALM_OPEN : GST_HAND_GESTURE_PALM_CLOSE;
+}
+
+/* Adds the hand, centred at @x, @y and @size wide, to the trajectory and
+ * returns the gesture it completes, if any; at most one per frame, the
+ * change of hand shape first, then swipes, then holds.
+ */
+GstHandGestureEvent
+gst_hand_gesture_update (GstHandGesture * gesture, gdouble x, gdouble y,
+    gdouble size, GstHanddetectGesture shape, GstClockTime timestamp)
+{
+  GstHandGestureSample *s;
+  GstHandGestureEvent shape_event, swipe, hold;
+
+  if (gesture->n_samples > 0) {
+    GstClockTime last = gesture->history[gesture->head].timestamp;
+
+    /* without timestamps, or when they go back, count frames */
+    if (!GST_CLOCK_TIME_IS_VALID (timestamp) || timestamp < last)
+      timestamp = last + DEFAULT_FRAME_DURATION;
+    gesture->head = (gesture->head + 1) % GST_HAND_GESTURE_HISTORY;
+  } else if (!GST_CLOCK_TIME_IS_VALID (timestamp)) {
+    timestamp = 0;
+  }
+  gesture->n_samples = MIN (gesture->n_samples + 1, GST_HAND_GESTURE_HISTORY);
+
+  s = &gesture->history[gesture->head];
+  s->x = x;
+  s->y = y;
+  s->size = MAX (size, 1.0);
+  s->timestamp = timestamp;
+
+  /* all three run every frame to keep their state current */
+  shape_event = gst_hand_gesture_shape (gesture, shape);
+  swipe = gst_hand_gesture_swipe (gesture);
+  hold = gst_hand_gesture_hold (gesture);
+
+  if (shape_event != GST_HAND_GESTURE_NONE)
+    return shape_event;
+  if (swipe != GST_HAND_GESTURE_NONE)
+    return swipe;
+  return hold;
+}
+
+/* the value of the gesture field of the messages */
+const gchar *
+gst_hand_gesture_event_name (GstHandGestureEvent event)
+{
+  static const gchar *names[] = {
+    NULL, "swipe-left", "swipe-right", "swipe-up", "swipe-down", "hold",
+    "palm-open", "palm-close"
+  };
+
+  g_return_val_if_fail (event < G_N_ELEMENTS (names), NULL);
+  return names[event];
+}
@@ -0,0 +1,92 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthandgesture.h: recognition of hand gestures from tracked hands
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAND_GESTURE_H__
+#define __GST_HAND_GESTURE_H__
+
+#include <gst/gst.h>
+
+#include "gsthanddetectbuffer.h"
+
+G_BEGIN_DECLS
+
+/* samples of the trajectory kept, enough for the swipe window at 60 fps */
+#define GST_HAND_GESTURE_HISTORY 32
+
+typedef struct _GstHandGestureSample GstHandGestureSample;
+typedef struct _GstHandGesture GstHandGesture;
+
+typedef enum
+{
+  GST_HAND_GESTURE_NONE,
+  GST_HAND_GESTURE_SWIPE_LEFT,
+  GST_HAND_GESTURE_SWIPE_RIGHT,
+  GST_HAND_GESTURE_SWIPE_UP,
+  GST_HAND_GESTURE_SWIPE_DOWN,
+  GST_HAND_GESTURE_HOLD,
+  GST_HAND_GESTURE_PALM_OPEN,
+  GST_HAND_GESTURE_PALM_CLOSE
+} GstHandGestureEvent;
+
+/* a point of the trajectory: centre and width of the hand */
+struct _GstHandGestureSample
+{
+  gdouble x;
+  gdouble y;
+  gdouble size;
+  GstClockTime timestamp;
+};
+
+/* The recognizer of one tracked hand, fed once per frame the hand is
+ * detected on. Every event has to be released before it fires again: a
+ * swipe once the hand slows down, a hold once the hand moves away, and
+ * the hand shape changes only when it lasts a few frames.
+ */
+struct _GstHandGesture
+{
+  guint track_id;
+
+  /* ring buffer of the trajectory, history[head] the newest sample */
+  GstHandGestureSample history[GST_HAND_GESTURE_HISTORY];
+  guint head;
+  guint n_samples;
+
+  gboolean swipe_armed;
+  gboolean hold_armed;
+  gdouble still_x;              /* where the hand rests since still_since */
+  gdouble still_y;
+  GstClockTime still_since;
+  gdouble hold_x;               /* where the last hold fired */
+  gdouble hold_y;
+
+  GstHanddetectGesture shape;   /* debounced hand shape */
+  GstHanddetectGesture pending_shape;
+  guint pending_frames;
+};
+
+void gst_hand_gesture_init (GstHandGesture * gesture, guint track_id);
+GstHandGestureEvent gst_hand_gesture_update (GstHandGesture * gesture,
+    gdouble x, gdouble y, gdouble size, GstHanddetectGesture shape,
+    GstClockTime timestamp);
+const gchar *gst_hand_gesture_event_name (GstHandGestureEvent event);
+
+G_END_DECLS
+#endif /* __GST_HAND_GESTURE_H__ */
@@ -0,0 +1,244 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthandmotion.c: block-wise frame differencing of the gray image
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "gsthandmotion.h"
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_HAAR_NEON 1
+#endif
+
+GstHandMotion *
+gst_hand_motion_new (guint threshold)
+{
+  GstHandMotion *motion = g_new0 (GstHandMotion, 1);
+
+  motion->threshold = threshold;
+  return motion;
+}
+
+void
+gst_hand_motion_free (GstHandMotion * motion)
+{
+  if (!motion)
+    return;
+
+  g_free (motion->mask);
+  g_free (motion->prev);
+  g_free (motion->sad);
+  g_free (motion);
+}
+
+/* the next frame moves everywhere */
+void
+gst_hand_motion_reset (GstHandMotion * motion)
+{
+  motion->width = motion->height = 0;
+}
+
+/* adds the absolute differences of the pixels of a row to the sums of
+ * their blocks */
+static inline void
+gst_hand_motion_row_c (const guint8 * cur, const guint8 * prev, gint x,
+    gint width, guint32 * sad)
+{
+  for (; x < width; x++)
+    sad[x >> GST_HAND_MOTION_SHIFT] += ABS (cur[x] - prev[x]);
+}
+
+#if defined (__AVX2__) || defined (__SSE2__)
+static void
+gst_hand_motion_row (const guint8 * cur, const guint8 * prev, gint width,
+    guint32 * sad)
+{
+  gint x = 0;
+
+#if defined (__AVX2__)
+  /* two blocks at a time, each summed in two 64 bit lanes */
+  for (; x + 32 <= width; x += 32) {
+    __m256i d = _mm256_sad_epu8 (_mm256_loadu_si256 ((const __m256i *)
+            (cur + x)), _mm256_loadu_si256 ((const __m256i *) (prev + x)));
+
+    sad[x >> GST_HAND_MOTION_SHIFT] += _mm256_extract_epi32 (d, 0) +
+        _mm256_extract_epi32 (d, 2);
+    sad[(x >> GST_HAND_MOTION_SHIFT) + 1] += _mm256_extract_epi32 (d, 4) +
+        _mm256_extract_epi32 (d, 6);
+  }
+#endif
+  for (; x + 16 <= width; x += 16) {
+    __m128i d = _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *) (cur + x)),
+        _mm_loadu_si128 ((const __m128i *) (prev + x)));
+
+    sad[x >> GST_HAND_MOTION_SHIFT] += _mm_cvtsi128_si32 (d) +
+        _mm_cvtsi128_si32 (_mm_srli_si128 (d, 8));
+  }
+  gst_hand_motion_row_c (cur, prev, x, width, sad);
+}
+#elif defined (HAVE_HAAR_NEON)
+static void
+gst_hand_motion_row (const guint8 * cur, const guint8 * prev, gint width,
+    guint32 * sad)
+{
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    uint8x16_t d = vabdq_u8 (vld1q_u8 (cur + x), vld1q_u8 (prev + x));
+    uint64x2_t s = vpaddlq_u32 (vpaddlq_u16 (vpaddlq_u8 (d)));
+
+    sad[x >> GST_HAND_MOTION_SHIFT] +=
+        (guint32) (vgetq_lane_u64 (s, 0) + vgetq_lane_u64 (s, 1));
+  }
+  gst_hand_motion_row_c (cur, prev, x, width, sad);
+}
+#else
+static void
+gst_hand_motion_row (const guint8 * cur, const guint8 * prev, gint width,
+    guint32 * sad)
+{
+  gst_hand_motion_row_c (cur, prev, 0, width, sad);
+}
+#endif
+
+/* Compares @gray to the previous frame and keeps it for the next one,
+ * returns the number of moving blocks. */
+gint
+gst_hand_motion_update (GstHandMotion * motion, const guint8 * gray,
+    gint width, gint height, gint stride)
+{
+  gint r, c, y;
+
+  g_return_val_if_fail (motion != NULL, 0);
+  g_return_val_if_fail (gray != NULL && width > 0 && height > 0, 0);
+
+  if (width != motion->width || height != motion->height) {
+    motion->cols = (width + GST_HAND_MOTION_BLOCK - 1) >> GST_HAND_MOTION_SHIFT;
+    motion->rows =
+        (height + GST_HAND_MOTION_BLOCK - 1) >> GST_HAND_MOTION_SHIFT;
+    g_free (motion->mask);
+    g_free (motion->prev);
+    g_free (motion->sad);
+    motion->mask = g_new (guint8, motion->cols * motion->rows);
+    motion->prev = g_new (guint8, width * height);
+    motion->sad = g_new (guint32, motion->cols);
+    motion->width = width;
+    motion->height = height;
+
+    for (y = 0; y < height; y++)
+      memcpy (motion->prev + y * width, gray + y * stride, width);
+    memset (motion->mask, 1, motion->cols * motion->rows);
+    motion->n_moving = motion->cols * motion->rows;
+    return motion->n_moving;
+  }
+
+  motion->n_moving = 0;
+  for (r = 0; r < motion->rows; r++) {
+    gint y0 = r << GST_HAND_MOTION_SHIFT;
+    gint h = MIN (GST_HAND_MOTION_BLOCK, height - y0);
+    guint8 *mask = motion->mask + r * motion->cols;
+
+    memset (motion->sad, 0, motion->cols * sizeof (guint32));
+    for (y = y0; y < y0 + h; y++) {
+      const guint8 *cur = gray + y * stride;
+      guint8 *prev = motion->prev + y * width;
+
+      gst_hand_motion_row (cur, prev, width, motion->sad);
+      memcpy (prev, cur, width);
+    }
+
+    for (c = 0; c < motion->cols; c++) {
+      gint w = MIN (GST_HAND_MOTION_BLOCK,
+          width - (c << GST_HAND_MOTION_SHIFT));
+
+      mask[c] = motion->sad[c] > motion->threshold * w * h;
+      motion->n_moving += mask[c];
+    }
+  }
+  return motion->n_moving;
+}
+
+/* marks the blocks under @rect as moving */
+void
+gst_hand_motion_mark (GstHandMotion * motion, const CvRect * rect)
+{
+  gint c0, c1, r0, r1, r, c;
+
+  g_return_if_fail (motion != NULL && rect != NULL);
+
+  if (rect->width <= 0 || rect->height <= 0 || rect->x >= motion->width ||
+      rect->y >= motion->height || rect->x + rect->width <= 0 ||
+      rect->y + rect->height <= 0)
+    return;
+
+  c0 = MAX (rect->x, 0) >> GST_HAND_MOTION_SHIFT;
+  r0 = MAX (rect->y, 0) >> GST_HAND_MOTION_SHIFT;
+  c1 = MIN (rect->x + rect->width, motion->width) - 1;
+  r1 = MIN (rect->y + rect->height, motion->height) - 1;
+  c1 >>= GST_HAND_MOTION_SHIFT;
+  r1 >>= GST_HAND_MOTION_SHIFT;
+
+  for (r = r0; r <= r1; r++) {
+    for (c = c0; c <= c1; c++) {
+      guint8 *m = &motion->mask[r * motion->cols + c];
+
+      motion->n_moving += !*m;
+      *m = 1;
+    }
+  }
+}
+
+/* the pixels covered by the moving blocks, as one box; FALSE when nothing
+ * moves */
+gboolean
+gst_hand_motion_bounds (GstHandMotion * motion, CvRect * rect)
+{
+  gint c0, c1 = -1, r0, r1 = -1, r, c;
+
+  g_return_val_if_fail (motion != NULL && rect != NULL, FALSE);
+
+  c0 = motion->cols;
+  r0 = motion->rows;
+  for (r = 0; r < motion->rows; r++) {
+    for (c = 0; c < motion->cols; c++) {
+      if (!motion->mask[r * motion->cols + c])
+        continue;
+      c0 = MIN (c0, c);
+      c1 = MAX (c1, c);
+      r0 = MIN (r0, r);
+      r1 = r;
+    }
+  }
+  if (c1 < 0)
+    return FALSE;
+
+  rect->x = c0 << GST_HAND_MOTION_SHIFT;
+  rect->y = r0 << GST_HAND_MOTION_SHIFT;
+  rect->width = MIN ((c1 + 1) << GST_HAND_MOTION_SHIFT, motion->width)
+      - rect->x;
+  rect->height = MIN ((r1 + 1) << GST_HAND_MOTION_SHIFT, motion->height)
+      - rect->y;
+  return TRUE;
+}
@@ -0,0 +1,67 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthandmotion.h: block-wise frame differencing of the gray image
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAND_MOTION_H__
+#define __GST_HAND_MOTION_H__
+
+#include <glib.h>
+#include <cv.h>
+
+G_BEGIN_DECLS
+
+/* blocks are GST_HAND_MOTION_BLOCK pixels square */
+#define GST_HAND_MOTION_SHIFT 4
+#define GST_HAND_MOTION_BLOCK (1 << GST_HAND_MOTION_SHIFT)
+
+typedef struct _GstHandMotion GstHandMotion;
+
+/* The moving blocks of a gray image: each frame is compared to the
+ * previous one, a block moves when the mean absolute difference of its
+ * pixels is above threshold. mask holds one byte per block, row by row,
+ * non-zero for the moving ones. The first frame, and any after a reset or
+ * a size change, moves everywhere.
+ */
+struct _GstHandMotion
+{
+  guint threshold;
+  guint8 *mask;
+  gint cols;
+  gint rows;
+  gint n_moving;
+
+  /* private */
+  guint8 *prev;
+  guint32 *sad;
+  gint width;
+  gint height;
+};
+
+GstHandMotion *gst_hand_motion_new (guint threshold);
+void gst_hand_motion_free (GstHandMotion * motion);
+void gst_hand_motion_reset (GstHandMotion * motion);
+
+gint gst_hand_motion_update (GstHandMotion * motion, const guint8 * gray,
+    gint width, gint height, gint stride);
+void gst_hand_motion_mark (GstHandMotion * motion, const CvRect * rect);
+gboolean gst_hand_motion_bounds (GstHandMotion * motion, CvRect * rect);
+
+G_END_DECLS
+#endif /* __GST_HAND_MOTION_H__ */
@@ -0,0 +1,400 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthandtracker.c: constant velocity Kalman tracking of hands
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include "gsthandtracker.h"
+
+/* process noise: standard deviation of the acceleration per frame, in
+ * pixels, of the centre and of the width */
+#define POS_ACCEL 8.0
+#define SIZE_ACCEL 2.0
+/* measurement noise: detection jitter as a fraction of the hand width */
+#define POS_JITTER 0.08
+#define SIZE_JITTER 0.1
+/* initial velocity variance, nothing is known about the motion yet */
+#define INITIAL_VELOCITY_VAR 400.0
+
+/* the gate of a track: detections centred within this many hand widths
+ * plus deviations of the predicted centre may continue it */
+#define GATE_SIZE 1.0
+#define GATE_SIGMAS 3.0
+/* nearest detections in the gate of a track competing for it */
+#define MAX_CANDIDATES 4
+
+typedef struct
+{
+  gdouble cx;
+  gdouble cy;
+  gdouble gate;
+  gint object;                  /* matched, -1 if none */
+} GstHandPrediction;
+
+typedef struct
+{
+  gdouble cost;
+  gint track;
+  gint object;
+} GstHandPair;
+
+static void
+gst_hand_kalman_init (GstHandKalman * k, gdouble z, gdouble r)
+{
+  k->x = z;
+  k->v = 0;
+  k->p00 = r;
+  k->p01 = 0;
+  k->p11 = INITIAL_VELOCITY_VAR;
+}
+
+/* time update, F = [1 1; 0 1] and Q = q [1/4 1/2; 1/2 1] for white
+ * acceleration noise of variance q */
+static void
+gst_hand_kalman_predict (GstHandKalman * k, gdouble q)
+{
+  k->x += k->v;
+  k->p00 += 2 * k->p01 + k->p11 + q * 0.25;
+  k->p01 += k->p11 + q * 0.5;
+  k->p11 += q;
+}
+
+/* measurement update with a position z of variance r */
+static void
+gst_hand_kalman_correct (GstHandKalman * k, gdouble z, gdouble r)
+{
+  gdouble s = k->p00 + r;
+  gdouble k0 = k->p00 / s;
+  gdouble k1 = k->p01 / s;
+  gdouble y = z - k->x;
+
+  k->x += k0 * y;
+  k->v += k1 * y;
+  k->p11 -= k1 * k->p01;
+  k->p01 -= k0 * k->p01;
+  k->p00 -= k0 * k->p00;
+}
+
+/* starts tracking the hand detected at @rect */
+void
+gst_hand_tracker_start (GstHandTracker * tracker, const CvRect * rect,
+    guint id)
+{
+  gdouble w = rect->width;
+  gdouble r = POS_JITTER * w * POS_JITTER * w;
+
+  tracker->id = id;
+  tracker->hits = 1;
+  tracker->misses = 0;
+  tracker->rect = *rect;
+  tracker->aspect = w > 0 ? rect->height / w : 1.0;
+  gst_hand_kalman_init (&tracker->cx, rect->x + w * 0.5, r);
+  gst_hand_kalman_init (&tracker->cy, rect->y + rect->height * 0.5, r);
+  gst_hand_kalman_init (&tracker->size, w, SIZE_JITTER * w * SIZE_JITTER * w);
+}
+
+/* the hand expected on the next frame, with the standard deviations of
+ * its centre and width */
+void
+gst_hand_tracker_predict (const GstHandTracker * tracker, CvRect * rect,
+    gdouble * pos_sigma, gdouble * size_sigma)
+{
+  GstHandKalman cx = tracker->cx, cy = tracker->cy, size = tracker->size;
+  gdouble w, h;
+
+  gst_hand_kalman_predict (&cx, POS_ACCEL * POS_ACCEL);
+  gst_hand_kalman_predict (&cy, POS_ACCEL * POS_ACCEL);
+  gst_hand_kalman_predict (&size, SIZE_ACCEL * SIZE_ACCEL);
+
+  w = MAX (size.x, 1);
+  h = w * tracker->aspect;
+  *rect = cvRect (cvRound (cx.x - w * 0.5), cvRound (cy.x - h * 0.5),
+      cvRound (w), cvRound (h));
+  *pos_sigma = sqrt (MAX (cx.p00, cy.p00));
+  *size_sigma = sqrt (size.p00);
+}
+
+/* advances the track by one frame, with the hand detected on it or NULL
+ * when it was not found */
+void
+gst_hand_tracker_update (GstHandTracker * tracker, const CvRect * rect)
+{
+  gdouble w, r;
+
+  gst_hand_kalman_predict (&tracker->cx, POS_ACCEL * POS_ACCEL);
+  gst_hand_kalman_predict (&tracker->cy, POS_ACCEL * POS_ACCEL);
+  gst_hand_kalman_predict (&tracker->size, SIZE_ACCEL * SIZE_ACCEL);
+  if (!rect) {
+    tracker->misses++;
+    return;
+  }
+
+  w = rect->width;
+  r = POS_JITTER * w * POS_JITTER * w;
+  tracker->rect = *rect;
+  tracker->aspect = w > 0 ? rect->height / w : 1.0;
+  tracker->misses = 0;
+  tracker->hits++;
+  gst_hand_kalman_correct (&tracker->cx, rect->x + w * 0.5, r);
+  gst_hand_kalman_correct (&tracker->cy, rect->y + rect->height * 0.5, r);
+  gst_hand_kalman_correct (&tracker->size, w,
+      SIZE_JITTER * w * SIZE_JITTER * w);
+}
+
+GstHandTracks *
+gst_hand_tracks_new (void)
+{
+  GstHandTracks *tracks = g_new0 (GstHandTracks, 1);
+
+  tracks->tracks = g_array_new (FALSE, FALSE, sizeof (GstHandTracker));
+  tracks->predictions =
+      g_array_new (FALSE, FALSE, sizeof (GstHandPrediction));
+  tracks->pairs = g_array_new (FALSE, FALSE, sizeof (GstHandPair));
+  tracks->min_hits = GST_HAND_TRACKS_MIN_HITS;
+  tracks->max_misses = GST_HAND_TRACKS_MAX_MISSES;
+  tracks->max_tracks = GST_HAND_TRACKS_MAX_TRACKS;
+  return tracks;
+}
+
+void
+gst_hand_tracks_free (GstHandTracks * tracks)
+{
+  if (!tracks)
+    return;
+  g_array_free (tracks->tracks, TRUE);
+  g_array_free (tracks->predictions, TRUE);
+  g_array_free (tracks->pairs, TRUE);
+  g_free (tracks->buckets);
+  g_free (tracks->chain);
+  g_free (tracks->assigned);
+  g_free (tracks);
+}
+
+/* ends all tracks, ids keep counting */
+void
+gst_hand_tracks_reset (GstHandTracks * tracks)
+{
+  g_array_set_size (tracks->tracks, 0);
+}
+
+/* whether @tracker is established and was detected on the last frame */
+gboolean
+gst_hand_tracks_reported (const GstHandTracks * tracks,
+    const GstHandTracker * tracker)
+{
+  return tracker->misses == 0 && tracker->hits >= tracks->min_hits;
+}
+
+static void
+gst_hand_tracks_reserve (GstHandTracks * tracks, gint n_objects)
+{
+  gint n_buckets = MAX (tracks->n_buckets, 16);
+
+  if (n_objects > tracks->allocated) {
+    tracks->allocated = MAX (n_objects, 2 * tracks->allocated);
+    tracks->chain = g_renew (gint, tracks->chain, tracks->allocated);
+    tracks->assigned = g_renew (gint, tracks->assigned, tracks->allocated);
+  }
+  while (n_buckets < 2 * n_objects)
+    n_buckets *= 2;
+  if (n_buckets != tracks->n_buckets) {
+    tracks->buckets = g_renew (gint, tracks->buckets, n_buckets);
+    tracks->n_buckets = n_buckets;
+  }
+}
+
+static inline gint
+gst_hand_tracks_bucket (const GstHandTracks * tracks, gint gx, gint gy)
+{
+  return (((guint) gx * 73856093u) ^ ((guint) gy * 19349663u)) &
+      (tracks->n_buckets - 1);
+}
+
+static gint
+gst_hand_pair_compare (gconstpointer a, gconstpointer b)
+{
+  const GstHandPair *pa = a, *pb = b;
+
+  return pa->cost < pb->cost ? -1 : pa->cost > pb->cost;
+}
+
+/* whether the centre of detection @i lies on a detection already taken,
+ * i.e. it is the other gesture found on the same hand */
+static gboolean
+gst_hand_tracks_covered (const GstHandTracks * tracks,
+    const GstHaarObject * objects, gint i, gdouble cell)
+{
+  const CvRect *r = &objects[i].rect;
+  gdouble cx = r->x + r->width * 0.5, cy = r->y + r->height * 0.5;
+  gint gx = (gint) floor (cx / cell), gy = (gint) floor (cy / cell);
+  gint dx, dy, j;
+
+  for (dy = -1; dy <= 1; dy++)
+    for (dx = -1; dx <= 1; dx++)
+      for (j = tracks->buckets[gst_hand_tracks_bucket (tracks, gx + dx,
+                  gy + dy)]; j >= 0; j = tracks->chain[j]) {
+        const CvRect *o = &objects[j].rect;
+
+        if (j != i && tracks->assigned[j] >= 0 && cx >= o->x
+            && cx < o->x + o->width && cy >= o->y && cy < o->y + o->height)
+          return TRUE;
+      }
+  return FALSE;
+}
+
+/* Advances all tracks by one frame with the detections on it. The
+ * detections are hashed into a grid of cells as large as the largest gate,
+ * so each track only looks at the 3x3 cells around its prediction and
+ * keeps its MAX_CANDIDATES nearest detections; the candidate pairs are then
+ * assigned greedily, cheapest first. The work is linear in the number of
+ * detections and tracks.
+ */
+void
+gst_hand_tracks_update (GstHandTracks * tracks,
+    const GstHaarObject * objects, guint n_objects)
+{
+  gint n_tracks = tracks->tracks->len;
+  gdouble cell = 1;
+  gint i, j, dx, dy;
+  guint n;
+
+  gst_hand_tracks_reserve (tracks, n_objects);
+
+  /* predictions and the cell size */
+  g_array_set_size (tracks->predictions, n_tracks);
+  for (i = 0; i < n_tracks; i++) {
+    GstHandTracker *t = &g_array_index (tracks->tracks, GstHandTracker, i);
+    GstHandPrediction *p =
+        &g_array_index (tracks->predictions, GstHandPrediction, i);
+    gdouble pos_sigma, size_sigma;
+    CvRect r;
+
+    gst_hand_tracker_predict (t, &r, &pos_sigma, &size_sigma);
+    p->cx = r.x + r.width * 0.5;
+    p->cy = r.y + r.height * 0.5;
+    p->gate = r.width * GATE_SIZE + GATE_SIGMAS * pos_sigma;
+    p->object = -1;
+    cell = MAX (cell, p->gate);
+  }
+
+  /* grid hash of the detection centres */
+  for (i = 0; i < tracks->n_buckets; i++)
+    tracks->buckets[i] = -1;
+  for (n = 0; n < n_objects; n++) {
+    const CvRect *r = &objects[n].rect;
+    gint b = gst_hand_tracks_bucket (tracks,
+        (gint) floor ((r->x + r->width * 0.5) / cell),
+        (gint) floor ((r->y + r->height * 0.5) / cell));
+
+    tracks->chain[n] = tracks->buckets[b];
+    tracks->buckets[b] = n;
+    tracks->assigned[n] = -1;
+  }
+
+  /* candidate pairs: the nearest detections within the gate of each track */
+  g_array_set_size (tracks->pairs, 0);
+  for (i = 0; i < n_tracks; i++) {
+    GstHandPrediction *p =
+        &g_array_index (tracks->predictions, GstHandPrediction, i);
+    gint gx = (gint) floor (p->cx / cell), gy = (gint) floor (p->cy / cell);
+    GstHandPair best[MAX_CANDIDATES];
+    gint n_best = 0;
+
+    for (dy = -1; dy <= 1; dy++)
+      for (dx = -1; dx <= 1; dx++)
+        for (j = tracks->buckets[gst_hand_tracks_bucket (tracks, gx + dx,
+                    gy + dy)]; j >= 0; j = tracks->chain[j]) {
+          const CvRect *r = &objects[j].rect;
+          gdouble ox = r->x + r->width * 0.5, oy = r->y + r->height * 0.5;
+          gdouble cost = (ox - p->cx) * (ox - p->cx) +
+              (oy - p->cy) * (oy - p->cy);
+          gint k;
+
+          /* buckets are shared by colliding cells */
+          if ((gint) floor (ox / cell) != gx + dx
+              || (gint) floor (oy / cell) != gy + dy
+              || cost > p->gate * p->gate)
+            continue;
+          if (n_best == MAX_CANDIDATES) {
+            if (cost >= best[n_best - 1].cost)
+              continue;
+            n_best--;
+          }
+          for (k = n_best++; k > 0 && best[k - 1].cost > cost; k--)
+            best[k] = best[k - 1];
+          best[k].cost = cost;
+          best[k].track = i;
+          best[k].object = j;
+        }
+    g_array_append_vals (tracks->pairs, best, n_best);
+  }
+
+  /* greedy assignment, cheapest pair first */
+  g_array_sort (tracks->pairs, gst_hand_pair_compare);
+  for (n = 0; n < tracks->pairs->len; n++) {
+    GstHandPair *pair = &g_array_index (tracks->pairs, GstHandPair, n);
+    GstHandPrediction *p = &g_array_index (tracks->predictions,
+        GstHandPrediction, pair->track);
+
+    if (p->object < 0 && tracks->assigned[pair->object] < 0) {
+      p->object = pair->object;
+      tracks->assigned[pair->object] = pair->track;
+    }
+  }
+
+  /* update the tracks, backwards so removing one only moves a track that
+   * is done with */
+  for (i = n_tracks - 1; i >= 0; i--) {
+    GstHandTracker *t = &g_array_index (tracks->tracks, GstHandTracker, i);
+    GstHandPrediction *p =
+        &g_array_index (tracks->predictions, GstHandPrediction, i);
+
+    if (p->object >= 0) {
+      gst_hand_tracker_update (t, &objects[p->object].rect);
+      t->label = objects[p->object].label;
+      t->neighbors = objects[p->object].neighbors;
+    } else {
+      gst_hand_tracker_update (t, NULL);
+      if (t->misses > tracks->max_misses || t->hits < tracks->min_hits)
+        g_array_remove_index_fast (tracks->tracks, i);
+    }
+  }
+
+  /* the detections left start new tracks */
+  for (n = 0; n < n_objects; n++) {
+    GstHandTracker t;
+
+    if (tracks->assigned[n] >= 0
+        || gst_hand_tracks_covered (tracks, objects, n, cell))
+      continue;
+    if (tracks->tracks->len >= tracks->max_tracks)
+      break;
+
+    gst_hand_tracker_start (&t, &objects[n].rect, ++tracks->next_id);
+    t.label = objects[n].label;
+    t.neighbors = objects[n].neighbors;
+    g_array_append_val (tracks->tracks, t);
+    tracks->assigned[n] = tracks->tracks->len - 1;
+  }
+}
@@ -0,0 +1,109 @@
+/* GStreamer
+ * Copyright (C) <2012> Andol Li <<andol@andol.info>>
+ *
+ * gsthandtracker.h: constant velocity Kalman tracking of hands
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAND_TRACKER_H__
+#define __GST_HAND_TRACKER_H__
+
+#include <glib.h>
+#include <cv.h>
+
+#include "gsthaardetector.h"
+
+G_BEGIN_DECLS
+
+/* defaults of the track life cycle */
+#define GST_HAND_TRACKS_MIN_HITS 1
+#define GST_HAND_TRACKS_MAX_MISSES 3
+#define GST_HAND_TRACKS_MAX_TRACKS 16
+
+typedef struct _GstHandKalman GstHandKalman;
+typedef struct _GstHandTracker GstHandTracker;
+typedef struct _GstHandTracks GstHandTracks;
+
+/* one axis of the constant velocity model: position, velocity per frame
+ * and their covariance */
+struct _GstHandKalman
+{
+  gdouble x;
+  gdouble v;
+  gdouble p00;
+  gdouble p01;
+  gdouble p11;
+};
+
+/* A tracked hand: centre and width filtered independently, the height
+ * following the width at the aspect of the last detection. The tracker
+ * owns its rectangles, nothing points into detection results.
+ */
+struct _GstHandTracker
+{
+  guint id;
+  guint hits;                   /* detections so far */
+  guint misses;                 /* frames since the last detection */
+  CvRect rect;                  /* last detection */
+  gint label;                   /* and its label and neighbours */
+  gint neighbors;
+  gdouble aspect;
+  GstHandKalman cx;
+  GstHandKalman cy;
+  GstHandKalman size;
+};
+
+/* All hands of a stream. Each frame the detections are matched to the
+ * predicted tracks, unmatched ones start tentative tracks reported after
+ * min_hits detections, and tracks undetected for more than max_misses
+ * frames end (tentative ones on their first miss).
+ */
+struct _GstHandTracks
+{
+  GArray *tracks;               /* GstHandTracker */
+  guint min_hits;
+  guint max_misses;
+  guint max_tracks;
+  guint next_id;
+
+  /* private, per frame: predictions, the grid hash of the detections and
+   * the candidate pairs */
+  GArray *predictions;
+  gint *buckets;
+  gint n_buckets;
+  gint *chain;
+  gint *assigned;
+  gint allocated;
+  GArray *pairs;
+};
+
+void gst_hand_tracker_start (GstHandTracker * tracker, const CvRect * rect,
+    guint id);
+void gst_hand_tracker_predict (const GstHandTracker * tracker, CvRect * rect,
+    gdouble * pos_sigma, gdouble * size_sigma);
+void gst_hand_tracker_update (GstHandTracker * tracker, const CvRect * rect);
+
+GstHandTracks *gst_hand_tracks_new (void);
+void gst_hand_tracks_free (GstHandTracks * tracks);
+void gst_hand_tracks_reset (GstHandTracks * tracks);
+void gst_hand_tracks_update (GstHandTracks * tracks,
+    const GstHaarObject * objects, guint n_objects);
+gboolean gst_hand_tracks_reported (const GstHandTracks * tracks,
+    const GstHandTracker * tracker);
+
+G_END_DECLS
+#endif /* __GST_HAND_TRACKER_H__ */
@@ -194,9 +194,11 @@ gst_opencv_video_filter_transform_ip (GstBaseTransform * trans,
   g_return_val_if_fail (fclass->cv_trans_ip_func != NULL, GST_FLOW_ERROR);
   g_return_val_if_fail (transform->cvImage != NULL, GST_FLOW_ERROR);
 
-  /* TODO this is not always needed and should be solved at BaseTransform
-   * level */
-  buffer = gst_buffer_make_writable (buffer);
+  /* in passthrough the subclass only reads the buffer, or makes it
+   * writable itself on the frames it draws on; otherwise BaseTransform
+   * already handed over a writable one */
+  if (!gst_base_transform_is_passthrough (trans))
+    buffer = gst_buffer_make_writable (buffer);
 
   transform->cvImage->imageData = (char *) GST_BUFFER_DATA (buffer);
 